@@ -0,0 +1,176 @@
+// Compares the old per attribute, per element glTF conversion loops with the
+// single pass kernels in vk_vertex_convert on a synthetic mesh.
+//
+//   cmake --build <build> --target vertex-convert-bench
+//   <build>/bin/vertex-convert-bench [vertexCount]
+
+#include <vk_vertex_convert.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace
+{
+
+constexpr int ITERATIONS = 20;
+
+struct SyntheticMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec4> colors;
+    std::vector<uint32_t> indices;
+
+    VertexStreams streams() const
+    {
+        return VertexStreams { positions.data(), normals.data(), uvs.data(), colors.data(), positions.size() };
+    }
+};
+
+SyntheticMesh
+make_mesh(size_t vertexCount)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+    SyntheticMesh mesh;
+    mesh.positions.resize(vertexCount);
+    mesh.normals.resize(vertexCount);
+    mesh.uvs.resize(vertexCount);
+    mesh.colors.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        mesh.positions[i] = glm::vec3(dist(rng), dist(rng), dist(rng));
+        mesh.normals[i] = glm::vec3(dist(rng), dist(rng), dist(rng));
+        mesh.uvs[i] = glm::vec2(dist(rng), dist(rng));
+        mesh.colors[i] = glm::vec4(dist(rng), dist(rng), dist(rng), 1.f);
+    }
+
+    // roughly two triangles per vertex, like a closed mesh
+    mesh.indices.resize(vertexCount * 6);
+    std::uniform_int_distribution<uint32_t> indexDist(0, (uint32_t)vertexCount - 1);
+    for (uint32_t& index : mesh.indices)
+    {
+        index = indexDist(rng);
+    }
+
+    return mesh;
+}
+
+// Per element callback, like fastgltf::iterateAccessorWithIndex
+template <typename T, typename Function>
+void
+for_each_element(const std::vector<T>& data, Function&& function)
+{
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        function(data[i], i);
+    }
+}
+
+// The conversion as the loader did it before: one pass per attribute plus a
+// pass for the color override, and indices rebased one at a time
+void
+convert_per_element(const SyntheticMesh& mesh, uint32_t base, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+{
+    for_each_element(mesh.indices, [&](uint32_t idx, size_t index) {
+        indices[index] = idx + base;
+    });
+
+    for_each_element(mesh.positions, [&](glm::vec3 v, size_t index) {
+        Vertex newvtx;
+        newvtx.position = v;
+        newvtx.normal = { 1, 0, 0 };
+        newvtx.color = glm::vec4 { 1.f };
+        newvtx.uv_x = 0;
+        newvtx.uv_y = 0;
+        vertices[index] = newvtx;
+    });
+    for_each_element(mesh.normals, [&](glm::vec3 v, size_t index) {
+        vertices[index].normal = v;
+    });
+    for_each_element(mesh.uvs, [&](glm::vec2 v, size_t index) {
+        vertices[index].uv_x = v.x;
+        vertices[index].uv_y = v.y;
+    });
+    for_each_element(mesh.colors, [&](glm::vec4 v, size_t index) {
+        vertices[index].color = v;
+    });
+    for (Vertex& vtx : vertices)
+    {
+        vtx.color = glm::vec4(vtx.normal, 1.f);
+    }
+}
+
+void
+convert_bulk_scalar(const SyntheticMesh& mesh, uint32_t base, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+{
+    std::memcpy(indices.data(), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    rebase_indices_scalar(indices.data(), indices.size(), base);
+    interleave_vertices_scalar(mesh.streams(), true, vertices.data());
+}
+
+void
+convert_bulk_simd(const SyntheticMesh& mesh, uint32_t base, std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+{
+    std::memcpy(indices.data(), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    rebase_indices(indices.data(), indices.size(), base);
+    interleave_vertices(mesh.streams(), true, vertices.data());
+}
+
+template <typename Function>
+double
+best_seconds(Function&& function)
+{
+    double best = 1e30;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    size_t vertexCount = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    const uint32_t base = 12345;
+
+    SyntheticMesh mesh = make_mesh(vertexCount);
+
+    std::vector<uint32_t> referenceIndices(mesh.indices.size());
+    std::vector<Vertex> referenceVertices(vertexCount);
+    std::vector<uint32_t> indices(mesh.indices.size());
+    std::vector<Vertex> vertices(vertexCount);
+
+    // every path has to produce the same bytes
+    convert_per_element(mesh, base, referenceIndices, referenceVertices);
+    convert_bulk_simd(mesh, base, indices, vertices);
+    if (indices != referenceIndices
+        || std::memcmp(vertices.data(), referenceVertices.data(), vertexCount * sizeof(Vertex)) != 0)
+    {
+        spdlog::error("Bulk conversion does not match the per element conversion");
+        return 1;
+    }
+
+    double perElement = best_seconds([&]() { convert_per_element(mesh, base, indices, vertices); });
+    double bulkScalar = best_seconds([&]() { convert_bulk_scalar(mesh, base, indices, vertices); });
+    double bulkSimd = best_seconds([&]() { convert_bulk_simd(mesh, base, indices, vertices); });
+
+    spdlog::info("{} vertices, {} indices, best of {} runs", vertexCount, mesh.indices.size(), ITERATIONS);
+    spdlog::info("    per element:   {:8.2f} ms  {:8.1f} M vertices/s", perElement * 1000.0, vertexCount / perElement / 1e6);
+    spdlog::info("    bulk scalar:   {:8.2f} ms  {:8.1f} M vertices/s", bulkScalar * 1000.0, vertexCount / bulkScalar / 1e6);
+    spdlog::info("    bulk {:<8} {:8.2f} ms  {:8.1f} M vertices/s", std::string(vertex_convert_isa()) + ":", bulkSimd * 1000.0,
+        vertexCount / bulkSimd / 1e6);
+
+    return 0;
+}
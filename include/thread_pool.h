@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed size pool of worker threads for CPU side work (asset decoding etc.)
+// Workers are started on construction and joined on destruction
+class ThreadPool
+{
+public:
+    // threadCount of 0 uses one worker per hardware thread, minus the calling thread
+    explicit ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        for (unsigned int i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Queue a single task, the returned future holds its result
+    template <typename Function>
+    auto submit(Function&& function) -> std::future<std::invoke_result_t<Function>>
+    {
+        using Result = std::invoke_result_t<Function>;
+
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        queueCondition.notify_one();
+
+        return result;
+    }
+
+    // Run function(i) for every i in [0, count) and block until all of them are done.
+    // The calling thread takes work as well, so this is safe to call from inside a task.
+    void parallel_for(size_t count, std::function<void(size_t)> function)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        // Shared so that helpers which only get scheduled after we return still
+        // see valid state (they will find no work left and exit)
+        struct ForState
+        {
+            std::function<void(size_t)> function;
+            size_t count;
+            std::atomic<size_t> next {0};
+            std::atomic<size_t> done {0};
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+        };
+        auto state = std::make_shared<ForState>();
+        state->function = std::move(function);
+        state->count = count;
+
+        auto run = [state]() {
+            size_t finished = 0;
+            for (size_t i = state->next++; i < state->count; i = state->next++)
+            {
+                state->function(i);
+                finished++;
+            }
+
+            if (finished > 0 && state->done.fetch_add(finished) + finished == state->count)
+            {
+                std::lock_guard<std::mutex> lock(state->doneMutex);
+                state->doneCondition.notify_all();
+            }
+        };
+
+        size_t helpers = std::min(count - 1, workers.size());
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            for (size_t i = 0; i < helpers; i++)
+            {
+                tasks.emplace(run);
+            }
+        }
+        queueCondition.notify_all();
+
+        run();
+
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&]() { return state->done.load() == state->count; });
+    }
+
+private:
+    void worker_loop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (stopping && tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping {false};
+};
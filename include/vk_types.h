@@ -28,6 +28,16 @@
     } while (0)
 
 
+// Block compression of imported textures, see vk_texture_compress.h
+enum class TextureCompression : uint32_t
+{
+    None, // RGBA8, mip chain blitted on the GPU
+    BC1,  // RGB, 4 bits per texel
+    BC3,  // RGBA with interpolated alpha, 8 bits per texel
+    BC7,  // RGBA, 8 bits per texel, higher quality and slower to encode
+    Auto, // BC1 for opaque images, BC3 for the rest
+};
+
 struct AllocatedImage
 {
     VkImage image;
@@ -35,6 +45,7 @@ struct AllocatedImage
     VmaAllocation allocation;
     VkExtent3D imageExtent;
     VkFormat imageFormat;
+    uint32_t mipLevels {1};
 };
 
 struct AllocatedBuffer
@@ -53,12 +64,82 @@ struct Vertex
 	glm::vec4 color;
 };
 
-// holds the resources needed for a mesh
+// Compressed vertex, 16 bytes instead of the 48 of Vertex
+// position: snorm16 xyz, mapped back to object space with VertexQuantization
+// normal: octahedral encoded into 2x unorm8
+// uv: 2x half float
+// color: 4x unorm8
+struct PackedVertex
+{
+    uint32_t positionXY;      // x | y << 16
+    uint32_t positionZNormal; // z | normal.x << 16 | normal.y << 24
+    uint32_t uv;              // u | v << 16
+    uint32_t color;           // r | g << 8 | b << 16 | a << 24
+};
+
+enum class VertexFormat : uint32_t
+{
+    Standard, // Vertex
+    Packed,   // PackedVertex
+};
+
+// Per mesh dequantization of packed positions: position = packed * positionScale + positionOffset
+struct VertexQuantization
+{
+    glm::vec4 positionScale {1.f};
+    glm::vec4 positionOffset {0.f};
+};
+
+// Handle to an asynchronous GPU upload, it is complete once the upload
+// timeline semaphore reaches value. A value of 0 is always complete.
+struct UploadTicket
+{
+    uint64_t value {0};
+};
+
+// Suballocated range of one of the GeometryPool buffers
+struct GeometryRange
+{
+    VmaVirtualAllocation allocation {VK_NULL_HANDLE};
+    VkDeviceSize offset {0};
+    VkDeviceSize size {0};
+};
+
+// Small cluster of neighbouring triangles of a surface, culled as a whole on the GPU
+struct Meshlet
+{
+    // bounding sphere, xyz is the center and w the radius
+    glm::vec4 bounds;
+    // normal cone, xyz is the axis and w the sine of its half angle (1 when the cone is too wide to cull)
+    glm::vec4 cone;
+    // triangles of the meshlet, counted from the first index of the mesh
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t padding[2];
+};
+
+// holds the resources needed for a mesh, its vertices and indices live in the engine's GeometryPool
 struct GPUMeshBuffers
 {
-    AllocatedBuffer indexBuffer;
-    AllocatedBuffer vertexBuffer;
+    GeometryRange vertexRange;
+    GeometryRange indexRange;
+
+    // address of the first vertex of the mesh
     VkDeviceAddress vertexBufferAddress;
+    // meshlets are stored after the vertices, 0 when the mesh has none
+    VkDeviceAddress meshletBufferAddress {0};
+
+    // meshes with fewer than 65536 vertices get 16 bit indices
+    VkIndexType indexType {VK_INDEX_TYPE_UINT32};
+    // first index of the mesh in the pool index buffer, counted in indexType sized indices
+    uint32_t firstIndex {0};
+
+    // layout of the vertex buffer, packed vertices need the quantization to decode
+    VertexFormat vertexFormat {VertexFormat::Standard};
+    VertexQuantization quantization;
+
+    // buffers can not be used before this upload has completed
+    UploadTicket uploadTicket;
 };
 
 // push constants for our mesh object draws
@@ -68,6 +149,33 @@ struct GPUDrawPushConstants
     VkDeviceAddress vertexBuffer;
 };
 
+// push constants for mesh draws using PackedVertex
+struct GPUPackedDrawPushConstants
+{
+    glm::mat4 worldMatrix;
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    VkDeviceAddress vertexBuffer;
+};
+
+// per instance data of instanced mesh draws, the vertex shader reads it at gl_InstanceIndex
+struct GPUInstanceData
+{
+    glm::mat4 worldMatrix;
+    // multiplies the vertex color
+    glm::vec4 color {1.f};
+};
+
+// push constants for instanced mesh draws, the quantization is only read for PackedVertex
+struct GPUInstancedDrawPushConstants
+{
+    glm::mat4 viewProjection;
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    VkDeviceAddress vertexBuffer;
+    VkDeviceAddress instanceBuffer;
+};
+
 
 /*******************************************************
  * Formatters
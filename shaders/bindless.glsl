@@ -0,0 +1,10 @@
+// Descriptor table bound as set 0, must match BindlessTable in vk_bindless.h
+// Arrays are indexed by the slots the table handed out, passed in push constants.
+// Include it before any declaration, it enables an extension.
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform texture2D bindlessTextures[];
+// storage images need their format, each one used gets its own declaration of the binding
+layout(rgba16f, set = 0, binding = 1) uniform image2D bindlessImagesRgba16f[];
+layout(r32f, set = 0, binding = 1) uniform image2D bindlessImagesR32f[];
+layout(set = 0, binding = 2) uniform sampler bindlessSamplers[];
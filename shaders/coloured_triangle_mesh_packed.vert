@@ -0,0 +1,30 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "mesh_vertex.glsl"
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+//push constants block, matches GPUPackedDrawPushConstants
+layout( push_constant ) uniform constants
+{	
+	mat4 render_matrix;
+	vec4 position_scale;
+	vec4 position_offset;
+	PackedVertexBuffer vertexBuffer;
+} PushConstants;
+
+void main() 
+{	
+	//load and decode vertex data from device adress
+	Vertex v = unpack_vertex(PushConstants.vertexBuffer.vertices[gl_VertexIndex],
+		PushConstants.position_scale, PushConstants.position_offset);
+
+	//output data
+	gl_Position = PushConstants.render_matrix *vec4(v.position, 1.0f);
+	outColor = v.color.xyz;
+	outUV.x = v.uv_x;
+	outUV.y = v.uv_y;
+}
@@ -0,0 +1,27 @@
+// Object of the GPU driven path, must match IndirectRenderer::IndirectObject in vk_indirect.h
+// Needs GL_EXT_buffer_reference enabled and VERTEX_BUFFER_TYPE defined by the including shader
+
+struct IndirectObject {
+
+	mat4 worldMatrix;
+	// bounding sphere in object space, xyz is the center and w the radius
+	vec4 bounds;
+	vec4 positionScale;
+	vec4 positionOffset;
+	// error of each level of detail, relative to the bounding radius
+	vec4 lodErrors;
+	VERTEX_BUFFER_TYPE vertexBuffer;
+	// first index of the mesh in the geometry pool index buffer
+	uint firstIndex;
+	// which indirect count draw the object goes into
+	uint bucket;
+	uint lodCount;
+	uint padding0;
+	// start index and count of each level of detail, relative to firstIndex
+	uvec2 lods[4];
+	uint padding1[2];
+};
+
+layout(buffer_reference, std430) readonly buffer ObjectBuffer{
+	IndirectObject objects[];
+};
@@ -0,0 +1,37 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "mesh_vertex.glsl"
+
+#define VERTEX_BUFFER_TYPE PackedVertexBuffer
+#include "indirect_object.glsl"
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+// the depth prepass runs the same shader, the color pass has to land on its depths exactly
+invariant gl_Position;
+
+//push constants block, the object comes from firstInstance of the indirect draw
+layout( push_constant ) uniform constants
+{
+	mat4 viewProjection;
+	ObjectBuffer objectBuffer;
+} PushConstants;
+
+void main()
+{
+	mat4 worldMatrix = PushConstants.objectBuffer.objects[gl_InstanceIndex].worldMatrix;
+	vec4 positionScale = PushConstants.objectBuffer.objects[gl_InstanceIndex].positionScale;
+	vec4 positionOffset = PushConstants.objectBuffer.objects[gl_InstanceIndex].positionOffset;
+	PackedVertexBuffer vertexBuffer = PushConstants.objectBuffer.objects[gl_InstanceIndex].vertexBuffer;
+
+	//load and decode vertex data from device adress
+	Vertex v = unpack_vertex(vertexBuffer.vertices[gl_VertexIndex], positionScale, positionOffset);
+
+	//output data
+	gl_Position = PushConstants.viewProjection * worldMatrix * vec4(v.position, 1.0f);
+	outColor = v.color.xyz;
+	outUV.x = v.uv_x;
+	outUV.y = v.uv_y;
+}
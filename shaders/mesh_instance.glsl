@@ -0,0 +1,12 @@
+// Per instance data of instanced mesh draws, must match GPUInstanceData in vk_types.h
+// Needs GL_EXT_buffer_reference enabled by the including shader
+
+struct InstanceData {
+
+	mat4 worldMatrix;
+	vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{ 
+	InstanceData instances[];
+};
@@ -0,0 +1,32 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "mesh_vertex.glsl"
+#include "mesh_instance.glsl"
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+//push constants block, matches GPUInstancedDrawPushConstants
+layout( push_constant ) uniform constants
+{	
+	mat4 viewProjection;
+	vec4 position_scale;
+	vec4 position_offset;
+	VertexBuffer vertexBuffer;
+	InstanceBuffer instanceBuffer;
+} PushConstants;
+
+void main() 
+{	
+	//load vertex and instance data from device adress, firstInstance of the draw offsets gl_InstanceIndex
+	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	InstanceData instance = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+
+	//output data
+	gl_Position = PushConstants.viewProjection * instance.worldMatrix * vec4(v.position, 1.0f);
+	outColor = v.color.xyz * instance.color.xyz;
+	outUV.x = v.uv_x;
+	outUV.y = v.uv_y;
+}
@@ -0,0 +1,58 @@
+// Vertex layouts shared by the mesh vertex shaders, must match vk_types.h
+// Needs GL_EXT_buffer_reference enabled by the including shader
+
+struct Vertex {
+
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
+	Vertex vertices[];
+};
+
+struct PackedVertex {
+
+	uint positionXY;
+	uint positionZNormal;
+	uint uv;
+	uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer PackedVertexBuffer{ 
+	PackedVertex vertices[];
+};
+
+// Inverse of the octahedral encoding in vk_vertex_format.cpp
+vec3 decode_octahedral(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// Expands a packed vertex back to the full layout
+Vertex unpack_vertex(PackedVertex packed, vec4 positionScale, vec4 positionOffset)
+{
+	Vertex v;
+
+	vec2 xy = unpackSnorm2x16(packed.positionXY);
+	float z = unpackSnorm2x16(packed.positionZNormal).x;
+	v.position = vec3(xy, z) * positionScale.xyz + positionOffset.xyz;
+
+	v.normal = decode_octahedral(unpackUnorm4x8(packed.positionZNormal).zw);
+
+	vec2 uv = unpackHalf2x16(packed.uv);
+	v.uv_x = uv.x;
+	v.uv_y = uv.y;
+
+	v.color = unpackUnorm4x8(packed.color);
+
+	return v;
+}
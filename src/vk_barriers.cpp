@@ -0,0 +1,105 @@
+#include <vk_barriers.h>
+
+VkImageAspectFlags
+vkutil::aspect_for_format(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+vkutil::BarrierBuilder&
+vkutil::BarrierBuilder::image(VkImage image, const BarrierScope& src, const BarrierScope& dst,
+    VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount, uint32_t baseArrayLayer,
+    uint32_t layerCount)
+{
+    VkImageMemoryBarrier2& barrier = _imageBarriers.emplace_back();
+    barrier = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = src.stages;
+    barrier.srcAccessMask = src.access;
+    barrier.dstStageMask = dst.stages;
+    barrier.dstAccessMask = dst.access;
+    barrier.oldLayout = src.layout;
+    barrier.newLayout = dst.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspect;
+    barrier.subresourceRange.baseMipLevel = baseMipLevel;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.baseArrayLayer = baseArrayLayer;
+    barrier.subresourceRange.layerCount = layerCount;
+    return *this;
+}
+
+vkutil::BarrierBuilder&
+vkutil::BarrierBuilder::buffer(VkBuffer buffer, const BarrierScope& src, const BarrierScope& dst,
+    VkDeviceSize offset, VkDeviceSize size)
+{
+    return buffer_ownership(buffer, src, dst, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, offset, size);
+}
+
+vkutil::BarrierBuilder&
+vkutil::BarrierBuilder::buffer_ownership(VkBuffer buffer, const BarrierScope& src, const BarrierScope& dst,
+    uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkDeviceSize offset, VkDeviceSize size)
+{
+    VkBufferMemoryBarrier2& barrier = _bufferBarriers.emplace_back();
+    barrier = {.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+    barrier.srcStageMask = src.stages;
+    barrier.srcAccessMask = src.access;
+    barrier.dstStageMask = dst.stages;
+    barrier.dstAccessMask = dst.access;
+    barrier.srcQueueFamilyIndex = srcQueueFamily;
+    barrier.dstQueueFamilyIndex = dstQueueFamily;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    return *this;
+}
+
+vkutil::BarrierBuilder&
+vkutil::BarrierBuilder::memory(const BarrierScope& src, const BarrierScope& dst)
+{
+    VkMemoryBarrier2& barrier = _memoryBarriers.emplace_back();
+    barrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = src.stages;
+    barrier.srcAccessMask = src.access;
+    barrier.dstStageMask = dst.stages;
+    barrier.dstAccessMask = dst.access;
+    return *this;
+}
+
+void
+vkutil::BarrierBuilder::flush(VkCommandBuffer cmd)
+{
+    if (empty())
+    {
+        return;
+    }
+
+    VkDependencyInfo depInfo {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    depInfo.memoryBarrierCount = (uint32_t)_memoryBarriers.size();
+    depInfo.pMemoryBarriers = _memoryBarriers.data();
+    depInfo.bufferMemoryBarrierCount = (uint32_t)_bufferBarriers.size();
+    depInfo.pBufferMemoryBarriers = _bufferBarriers.data();
+    depInfo.imageMemoryBarrierCount = (uint32_t)_imageBarriers.size();
+    depInfo.pImageMemoryBarriers = _imageBarriers.data();
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    // keeps the allocations for the next batch
+    _memoryBarriers.clear();
+    _bufferBarriers.clear();
+    _imageBarriers.clear();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vk_types.h>
+
+namespace vkutil
+{
+
+// One side of a barrier: the stages and accesses to wait for or to block, and the
+// image layout on that side. The layout is ignored for buffer and memory barriers.
+struct BarrierScope
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout {VK_IMAGE_LAYOUT_UNDEFINED};
+};
+
+// Scopes of the common uses, pair them up as source and destination,
+// e.g. image(drawImage, scope::ComputeWrite, scope::ColorAttachment)
+namespace scope
+{
+
+// nothing to wait for, the contents are discarded
+inline constexpr BarrierScope None { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+
+inline constexpr BarrierScope ComputeRead { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+inline constexpr BarrierScope ComputeWrite { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+
+inline constexpr BarrierScope ColorAttachment { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+inline constexpr BarrierScope DepthAttachment { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL };
+
+inline constexpr BarrierScope TransferSrc { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+    VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+inline constexpr BarrierScope TransferDst { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+    VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+
+// sampled by the fragment or compute shaders
+inline constexpr BarrierScope ShaderSampled { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+inline constexpr BarrierScope IndirectCommands { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT };
+inline constexpr BarrierScope HostRead { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT };
+
+// handed to the presentation engine, which waits on a semaphore instead
+inline constexpr BarrierScope Present { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+
+} // namespace scope
+
+// Aspects of a whole image of the format: depth, depth and stencil, or color
+VkImageAspectFlags aspect_for_format(VkFormat format);
+
+// Collects image, buffer and global memory barriers and records them as a single
+// vkCmdPipelineBarrier2. Each barrier has its own stage and access masks, so one
+// batch can hold unrelated dependencies without widening any of them.
+class BarrierBuilder
+{
+public:
+    // Layout transition or dependency on a range of mip levels and array layers
+    BarrierBuilder& image(VkImage image, const BarrierScope& src, const BarrierScope& dst,
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT, uint32_t baseMipLevel = 0,
+        uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t baseArrayLayer = 0,
+        uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS);
+
+    BarrierBuilder& buffer(VkBuffer buffer, const BarrierScope& src, const BarrierScope& dst,
+        VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+    // One half of a queue family ownership transfer, recorded on both queues with the same families
+    BarrierBuilder& buffer_ownership(VkBuffer buffer, const BarrierScope& src, const BarrierScope& dst,
+        uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkDeviceSize offset, VkDeviceSize size);
+
+    // Covers every resource, cheaper than many buffer barriers with the same masks
+    BarrierBuilder& memory(const BarrierScope& src, const BarrierScope& dst);
+
+    bool empty() const { return _imageBarriers.empty() && _bufferBarriers.empty() && _memoryBarriers.empty(); }
+    uint32_t image_count() const { return (uint32_t)_imageBarriers.size(); }
+    uint32_t buffer_count() const { return (uint32_t)_bufferBarriers.size(); }
+
+    // Records everything added since the last flush, nothing when empty
+    void flush(VkCommandBuffer cmd);
+
+private:
+    std::vector<VkImageMemoryBarrier2> _imageBarriers;
+    std::vector<VkBufferMemoryBarrier2> _bufferBarriers;
+    std::vector<VkMemoryBarrier2> _memoryBarriers;
+};
+
+} // namespace vkutil
@@ -0,0 +1,175 @@
+#include <vk_bindless.h>
+
+#include <vk_descriptors.h>
+#include <vk_engine.h>
+
+namespace
+{
+
+constexpr uint32_t BINDING_COUNT = 3;
+constexpr uint32_t BINDING_CAPACITIES[BINDING_COUNT] = {
+	BINDLESS_MAX_SAMPLED_IMAGES,
+	BINDLESS_MAX_STORAGE_IMAGES,
+	BINDLESS_MAX_SAMPLERS,
+};
+
+} // namespace
+
+bool
+BindlessTable::init(VulkanEngine* engine)
+{
+	_engine = engine;
+
+	const VkDescriptorType types[BINDING_COUNT] = {
+		VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		VK_DESCRIPTOR_TYPE_SAMPLER,
+	};
+
+	// Slots are written while the set is bound by frames in flight, and most of them never are
+	const VkDescriptorBindingFlags bindingFlags[BINDING_COUNT] = {
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+	bindingFlagsInfo.bindingCount = BINDING_COUNT;
+	bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+	DescriptorLayoutBuilder builder;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (uint32_t binding = 0; binding < BINDING_COUNT; binding++)
+	{
+		builder.add_binding(binding, types[binding], BINDING_CAPACITIES[binding]);
+		poolSizes.push_back({ types[binding], BINDING_CAPACITIES[binding] });
+		_slots[binding] = { BINDING_CAPACITIES[binding], 0, {} };
+	}
+	_layout = builder.build(_engine->_device, VK_SHADER_STAGE_ALL, &bindingFlagsInfo,
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+	VkDescriptorPoolCreateInfo poolInfo { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+	if (vkCreateDescriptorPool(_engine->_device, &poolInfo, nullptr, &_pool) != VK_SUCCESS)
+	{
+		_engine->m_logger->error("Failed to create the bindless descriptor pool");
+		cleanup();
+		return false;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.descriptorPool = _pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &_layout;
+	VK_CHECK(vkAllocateDescriptorSets(_engine->_device, &allocInfo, &_set));
+
+	return true;
+}
+
+void
+BindlessTable::cleanup()
+{
+	vkDestroyDescriptorPool(_engine->_device, _pool, nullptr);
+	vkDestroyDescriptorSetLayout(_engine->_device, _layout, nullptr);
+	_pool = VK_NULL_HANDLE;
+	_layout = VK_NULL_HANDLE;
+	_set = VK_NULL_HANDLE;
+}
+
+std::optional<uint32_t>
+BindlessTable::add_sampled_image(VkImageView view, VkImageLayout layout)
+{
+	VkDescriptorImageInfo imageInfo {};
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = layout;
+	return write(Binding::SampledImages, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfo);
+}
+
+std::optional<uint32_t>
+BindlessTable::add_storage_image(VkImageView view)
+{
+	VkDescriptorImageInfo imageInfo {};
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	return write(Binding::StorageImages, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfo);
+}
+
+std::optional<uint32_t>
+BindlessTable::add_sampler(VkSampler sampler)
+{
+	VkDescriptorImageInfo imageInfo {};
+	imageInfo.sampler = sampler;
+	return write(Binding::Samplers, VK_DESCRIPTOR_TYPE_SAMPLER, imageInfo);
+}
+
+void
+BindlessTable::release(Binding binding, uint32_t slot)
+{
+	// The frame with this number is either being recorded or the next one to be,
+	// so it is the last one that could read the slot
+	_pendingReleases.push_back({ binding, slot, _engine->_frameNumber });
+}
+
+void
+BindlessTable::collect(int frameNumber)
+{
+	// Frame n shares its resources and fence with frame n + FRAME_OVERLAP, which
+	// only starts recording once frame n has completed
+	std::erase_if(_pendingReleases, [&](const PendingRelease& release) {
+		if (release.frameNumber + (int)FRAME_OVERLAP > frameNumber)
+		{
+			return false;
+		}
+
+		_slots[(uint32_t)release.binding].freeSlots.push_back(release.slot);
+		return true;
+	});
+}
+
+void
+BindlessTable::bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout) const
+{
+	vkCmdBindDescriptorSets(cmd, bindPoint, pipelineLayout, 0, 1, &_set, 0, nullptr);
+}
+
+std::optional<uint32_t>
+BindlessTable::write(Binding binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo)
+{
+	std::optional<uint32_t> slot = _slots[(uint32_t)binding].allocate();
+	if (!slot)
+	{
+		_engine->m_logger->error("Bindless table is out of slots for {}", string_VkDescriptorType(type));
+		return std::nullopt;
+	}
+
+	VkWriteDescriptorSet write { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write.dstSet = _set;
+	write.dstBinding = (uint32_t)binding;
+	write.dstArrayElement = *slot;
+	write.descriptorCount = 1;
+	write.descriptorType = type;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(_engine->_device, 1, &write, 0, nullptr);
+
+	return slot;
+}
+
+std::optional<uint32_t>
+BindlessTable::SlotAllocator::allocate()
+{
+	if (!freeSlots.empty())
+	{
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
+	}
+
+	if (next < capacity)
+	{
+		return next++;
+	}
+
+	return std::nullopt;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vk_types.h>
+
+//forward declaration
+class VulkanEngine;
+
+// Sizes of the arrays of the table, well below the update after bind limits
+// every device with descriptor indexing has
+constexpr uint32_t BINDLESS_MAX_SAMPLED_IMAGES = 16 * 1024;
+constexpr uint32_t BINDLESS_MAX_STORAGE_IMAGES = 1024;
+constexpr uint32_t BINDLESS_MAX_SAMPLERS = 64;
+
+// One descriptor set holding every image and sampler the shaders use, in an array per
+// descriptor type. Resources are written to a slot once when they are created, pipelines
+// bind the set once and shaders index the arrays by slots passed in push constants, see
+// shaders/bindless.glsl. The set is update after bind and partially bound, so slots can
+// be written while it is bound by frames still in flight as long as those do not use them.
+// Not thread safe, slots are handed out and released on the main thread.
+class BindlessTable
+{
+public:
+    // binding of each array in the set
+    enum class Binding : uint32_t
+    {
+        SampledImages,
+        StorageImages,
+        Samplers,
+    };
+
+    bool init(VulkanEngine* engine);
+    void cleanup();
+
+    // Nothing when the array is full
+    std::optional<uint32_t> add_sampled_image(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    std::optional<uint32_t> add_storage_image(VkImageView view);
+    std::optional<uint32_t> add_sampler(VkSampler sampler);
+
+    // The slot is handed out again once every frame recorded up to now has retired, frames
+    // in flight may still read it until then. The resource has to live as long.
+    void release(Binding binding, uint32_t slot);
+
+    // Frees the released slots no frame in flight can read anymore, called once the fence
+    // of frameNumber's resources has been waited on and before it is recorded
+    void collect(int frameNumber);
+
+    VkDescriptorSetLayout layout() const { return _layout; }
+    VkDescriptorSet set() const { return _set; }
+
+    // Binds the table as set 0 of layout, which has to be created with layout() as its first set
+    void bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout) const;
+
+private:
+    // Slots never used come from the end, released ones are reused first
+    struct SlotAllocator
+    {
+        uint32_t capacity;
+        uint32_t next;
+        std::vector<uint32_t> freeSlots;
+
+        std::optional<uint32_t> allocate();
+    };
+
+    // A slot waiting for the frames that may read it to retire
+    struct PendingRelease
+    {
+        Binding binding;
+        uint32_t slot;
+        // engine frame number when it was released
+        int frameNumber;
+    };
+
+    std::optional<uint32_t> write(Binding binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo);
+
+    VulkanEngine* _engine;
+
+    VkDescriptorPool _pool {VK_NULL_HANDLE};
+    VkDescriptorSetLayout _layout {VK_NULL_HANDLE};
+    VkDescriptorSet _set {VK_NULL_HANDLE};
+
+    // indexed by Binding
+    SlotAllocator _slots[3];
+    std::vector<PendingRelease> _pendingReleases;
+};
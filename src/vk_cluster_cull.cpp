@@ -0,0 +1,229 @@
+#include <vk_cluster_cull.h>
+
+#include <vk_barriers.h>
+#include <vk_engine.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+
+// Dispatches are limited to 65535 workgroups per dimension, larger surfaces spread over y
+constexpr uint32_t MAX_DISPATCH_X = 65535;
+
+glm::vec4
+normalize_plane(const glm::vec4& plane)
+{
+	return plane / glm::length(glm::vec3(plane));
+}
+
+// Scale factors within a percent of each other, which keeps the normal cones valid after the transform
+bool
+is_uniform_scale(const glm::mat4& matrix)
+{
+	float x = glm::length(glm::vec3(matrix[0]));
+	float y = glm::length(glm::vec3(matrix[1]));
+	float z = glm::length(glm::vec3(matrix[2]));
+	float largest = std::max({ x, y, z });
+	return largest > 0.f && std::min({ x, y, z }) >= largest * 0.99f;
+}
+
+} // namespace
+
+bool
+ClusterCuller::init(VulkanEngine* engine)
+{
+	_engine = engine;
+
+	VkPushConstantRange pushConstant {};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(ClusterCullPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	// everything is read through buffer device addresses, so there are no descriptors
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	layoutInfo.pushConstantRangeCount = 1;
+	VK_CHECK(vkCreatePipelineLayout(_engine->_device, &layoutInfo, nullptr, &_pipelineLayout));
+
+	std::string shaderPath = SHADERS_PATH;
+	shaderPath += "cluster_cull.comp.spv";
+	VkShaderModule shader;
+	if (!vkutil::load_shader_module(shaderPath.c_str(), _engine->_device, &shader))
+	{
+		_engine->m_logger->error("Error when building the compute shader: [{}]", shaderPath);
+		vkDestroyPipelineLayout(_engine->_device, _pipelineLayout, nullptr);
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.layout = _pipelineLayout;
+	pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+	VK_CHECK(vkCreateComputePipelines(_engine->_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline));
+
+	vkDestroyShaderModule(_engine->_device, shader, nullptr);
+
+	_frames.resize(FRAME_OVERLAP);
+	for (FrameResources& frame : _frames)
+	{
+		frame.drawBuffer = _engine->create_buffer(sizeof(CullData) + CLUSTER_CULL_MAX_DRAWS * sizeof(ClusterDraw),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = frame.drawBuffer.buffer };
+		frame.drawBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+
+		frame.indexBuffer = _engine->create_buffer(CLUSTER_CULL_MAX_INDICES * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY);
+
+		deviceAdressInfo.buffer = frame.indexBuffer.buffer;
+		frame.indexBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+	}
+
+	return true;
+}
+
+void
+ClusterCuller::cleanup()
+{
+	for (FrameResources& frame : _frames)
+	{
+		_engine->destroy_buffer(frame.drawBuffer);
+		_engine->destroy_buffer(frame.indexBuffer);
+	}
+	_frames.clear();
+
+	vkDestroyPipeline(_engine->_device, _pipeline, nullptr);
+	vkDestroyPipelineLayout(_engine->_device, _pipelineLayout, nullptr);
+}
+
+ClusterCuller::ClusterDraw*
+ClusterCuller::draws(FrameResources& frame)
+{
+	return reinterpret_cast<ClusterDraw*>(static_cast<uint8_t*>(frame.drawBuffer.info.pMappedData) + sizeof(CullData));
+}
+
+void
+ClusterCuller::begin_frame(uint32_t frameIndex)
+{
+	_frameIndex = frameIndex % _frames.size();
+	FrameResources& frame = _frames[_frameIndex];
+
+	// the fence of this frame was waited on, so what the GPU counted for it is done
+	if (!frame.dispatches.empty())
+	{
+		VK_CHECK(vmaInvalidateAllocation(_engine->_allocator, frame.drawBuffer.allocation, 0, VK_WHOLE_SIZE));
+
+		Stats stats {};
+		stats.surfaces = (uint32_t)frame.dispatches.size();
+		stats.triangles = frame.triangles;
+		const ClusterDraw* frameDraws = draws(frame);
+		for (uint32_t i = 0; i < stats.surfaces; i++)
+		{
+			stats.meshlets += frame.dispatches[i].meshletCount;
+			stats.visibleMeshlets += frameDraws[i].visibleMeshlets;
+			stats.visibleTriangles += frameDraws[i].command.indexCount / 3;
+		}
+		_stats = stats;
+	}
+	else
+	{
+		_stats = {};
+	}
+
+	frame.dispatches.clear();
+	frame.indexCount = 0;
+	frame.triangles = 0;
+}
+
+std::optional<uint32_t>
+ClusterCuller::add(const MeshAsset& mesh, const GeoSurface& surface, const glm::mat4& worldMatrix)
+{
+	FrameResources& frame = _frames[_frameIndex];
+
+	const GeoLod& level = surface.lods[0];
+	if (surface.meshletCount == 0 || mesh.meshBuffers.meshletBufferAddress == 0
+		|| frame.dispatches.size() == CLUSTER_CULL_MAX_DRAWS || level.count > CLUSTER_CULL_MAX_INDICES - frame.indexCount)
+	{
+		return std::nullopt;
+	}
+
+	uint32_t drawIndex = (uint32_t)frame.dispatches.size();
+
+	// the culling pass fills in the index count
+	ClusterDraw& draw = draws(frame)[drawIndex];
+	draw = {};
+	draw.command.instanceCount = 1;
+	draw.command.firstIndex = frame.indexCount;
+	draw.worldMatrix = worldMatrix;
+
+	ClusterCullPushConstants& dispatch = frame.dispatches.emplace_back();
+	dispatch.meshletBuffer = mesh.meshBuffers.meshletBufferAddress;
+	dispatch.indexBuffer = _engine->_geometryPool.index_buffer_address();
+	dispatch.outputIndexBuffer = frame.indexBufferAddress;
+	dispatch.draw = frame.drawBufferAddress + sizeof(CullData) + drawIndex * sizeof(ClusterDraw);
+	dispatch.cullData = frame.drawBufferAddress;
+	dispatch.firstMeshlet = surface.firstMeshlet;
+	dispatch.meshletCount = surface.meshletCount;
+	dispatch.sourceFirstIndex = mesh.meshBuffers.firstIndex;
+	dispatch.shortIndices = mesh.meshBuffers.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+	dispatch.outputFirstIndex = frame.indexCount;
+	dispatch.coneCulling = is_uniform_scale(worldMatrix) ? 1 : 0;
+
+	frame.indexCount += level.count;
+	frame.triangles += level.count / 3;
+	return drawIndex;
+}
+
+void
+ClusterCuller::record(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& viewProjection)
+{
+	FrameResources& frame = _frames[_frameIndex];
+	if (frame.dispatches.empty())
+	{
+		return;
+	}
+
+	// Side planes of the frustum from the rows of the view projection matrix (Gribb & Hartmann).
+	// Near and far are left out, meshes rarely reach past either.
+	glm::mat4 rows = glm::transpose(viewProjection);
+	CullData* cullData = static_cast<CullData*>(frame.drawBuffer.info.pMappedData);
+	cullData->planes[0] = normalize_plane(rows[3] + rows[0]);
+	cullData->planes[1] = normalize_plane(rows[3] - rows[0]);
+	cullData->planes[2] = normalize_plane(rows[3] + rows[1]);
+	cullData->planes[3] = normalize_plane(rows[3] - rows[1]);
+	cullData->cameraPosition = glm::inverse(view)[3];
+
+	// host writes are visible to the queue submit that follows, but may need a flush to get there
+	VK_CHECK(vmaFlushAllocation(_engine->_allocator, frame.drawBuffer.allocation, 0, VK_WHOLE_SIZE));
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+	for (const ClusterCullPushConstants& dispatch : frame.dispatches)
+	{
+		vkCmdPushConstants(cmd, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullPushConstants), &dispatch);
+
+		uint32_t groupsX = std::min(dispatch.meshletCount, MAX_DISPATCH_X);
+		uint32_t groupsY = (dispatch.meshletCount + MAX_DISPATCH_X - 1) / MAX_DISPATCH_X;
+		vkCmdDispatch(cmd, groupsX, groupsY, 1);
+	}
+
+	// indices and counts are read by the draws, the counts by the CPU once the frame is done
+	vkutil::BarrierScope consumers {
+		VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | vkutil::scope::IndirectCommands.stages | vkutil::scope::HostRead.stages,
+		VK_ACCESS_2_INDEX_READ_BIT | vkutil::scope::IndirectCommands.access | vkutil::scope::HostRead.access};
+	vkutil::BarrierBuilder().memory(vkutil::scope::ComputeWrite, consumers).flush(cmd);
+}
+
+void
+ClusterCuller::draw_indirect(VkCommandBuffer cmd, uint32_t drawIndex)
+{
+	const FrameResources& frame = _frames[_frameIndex];
+	vkCmdDrawIndexedIndirect(cmd, frame.drawBuffer.buffer, sizeof(CullData) + drawIndex * sizeof(ClusterDraw), 1,
+		sizeof(ClusterDraw));
+}
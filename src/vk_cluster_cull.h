@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+//forward declaration
+class VulkanEngine;
+
+// Indices a frame can write out for culled surfaces, surfaces that no longer fit are drawn whole
+constexpr uint32_t CLUSTER_CULL_MAX_INDICES = 4 * 1024 * 1024;
+// Surfaces a frame can cull
+constexpr uint32_t CLUSTER_CULL_MAX_DRAWS = 1024;
+
+// Culls the meshlets of surfaces against the view frustum and by their normal cones
+// in a compute pass. The indices of the meshlets that survive are copied to an index
+// buffer of the frame and every surface is drawn with one indirect draw, whose count
+// the compute pass fills in. Usage per frame:
+//   begin_frame(), add() for each surface, record() before rendering starts,
+//   then bind index_buffer() and draw_indirect() for each surface added.
+class ClusterCuller
+{
+public:
+    struct Stats
+    {
+        uint32_t surfaces;
+        uint32_t meshlets;
+        uint32_t visibleMeshlets;
+        uint64_t triangles;
+        uint64_t visibleTriangles;
+    };
+
+    bool init(VulkanEngine* engine);
+    void cleanup();
+
+    // Starts a new frame once its fence has been waited on, which makes
+    // the results of the last frame that used the same resources readable
+    void begin_frame(uint32_t frameIndex);
+
+    // Queues the LOD 0 meshlets of a surface drawn with worldMatrix for culling. Returns the draw
+    // index to pass to draw_indirect(), or nothing when the surface has to be drawn without culling.
+    std::optional<uint32_t> add(const MeshAsset& mesh, const GeoSurface& surface, const glm::mat4& worldMatrix);
+
+    // Records the culling pass, must come before the render pass that draws the surfaces
+    void record(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& viewProjection);
+
+    // 32 bit indices of the culled surfaces
+    VkBuffer index_buffer() const { return _frames[_frameIndex].indexBuffer.buffer; }
+    void draw_indirect(VkCommandBuffer cmd, uint32_t drawIndex);
+
+    // Results of the last completed frame
+    Stats stats() const { return _stats; }
+
+private:
+    struct CullData
+    {
+        glm::vec4 planes[4];
+        glm::vec4 cameraPosition;
+    };
+
+    // VkDrawIndexedIndirectCommand followed by what the culling pass counted and the
+    // transform of the meshlet bounds, 96 byte stride
+    struct ClusterDraw
+    {
+        VkDrawIndexedIndirectCommand command;
+        uint32_t visibleMeshlets;
+        uint32_t padding[2];
+        glm::mat4 worldMatrix;
+    };
+
+    struct ClusterCullPushConstants
+    {
+        VkDeviceAddress meshletBuffer;
+        VkDeviceAddress indexBuffer;
+        VkDeviceAddress outputIndexBuffer;
+        VkDeviceAddress draw;
+        VkDeviceAddress cullData;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t sourceFirstIndex;
+        uint32_t shortIndices;
+        uint32_t outputFirstIndex;
+        // normal cones only hold under uniform scale
+        uint32_t coneCulling;
+    };
+
+    struct FrameResources
+    {
+        // CullData followed by one ClusterDraw per surface, host visible so the counts can be read back
+        AllocatedBuffer drawBuffer;
+        VkDeviceAddress drawBufferAddress;
+
+        AllocatedBuffer indexBuffer;
+        VkDeviceAddress indexBufferAddress;
+
+        // surfaces queued this frame
+        std::vector<ClusterCullPushConstants> dispatches;
+        uint32_t indexCount {0};
+        uint64_t triangles {0};
+    };
+
+    ClusterDraw* draws(FrameResources& frame);
+
+    VulkanEngine* _engine;
+
+    VkPipelineLayout _pipelineLayout;
+    VkPipeline _pipeline;
+
+    // one per frame in flight
+    std::vector<FrameResources> _frames;
+    uint32_t _frameIndex {0};
+
+    Stats _stats {};
+};
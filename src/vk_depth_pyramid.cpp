@@ -0,0 +1,194 @@
+#include <vk_depth_pyramid.h>
+
+#include <vk_barriers.h>
+#include <vk_engine.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+#include <algorithm>
+
+namespace
+{
+
+uint32_t
+previous_pow2(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result * 2 <= value)
+	{
+		result *= 2;
+	}
+	return result;
+}
+
+} // namespace
+
+bool
+DepthPyramid::init(VulkanEngine* engine)
+{
+	_engine = engine;
+
+	// Power of two levels halve exactly, so every texel of a level covers 2x2 of the one above
+	const VkExtent3D depthExtent = _engine->_depthImage.imageExtent;
+	_extent = { previous_pow2(depthExtent.width), previous_pow2(depthExtent.height) };
+	_image = _engine->create_image(VkExtent3D { _extent.width, _extent.height, 1 }, VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
+	for (uint32_t level = 0; level < _image.mipLevels; level++)
+	{
+		VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(_image.imageFormat, _image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		VK_CHECK(vkCreateImageView(_engine->_device, &viewInfo, nullptr, &_levelViews.emplace_back()));
+	}
+
+	// Linear filtering with a min reduction returns the smallest of the 2x2 texels around
+	// the sample point, sampling at a texel center of the next level reduces its 2x2 block
+	VkSamplerReductionModeCreateInfo reductionInfo { .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO };
+	reductionInfo.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+
+	VkSamplerCreateInfo samplerInfo { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.pNext = &reductionInfo;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK(vkCreateSampler(_engine->_device, &samplerInfo, nullptr, &_sampler));
+
+	// Every level is written as a storage image and sampled to reduce the next one,
+	// level 0 samples the depth image instead
+	BindlessTable& bindless = _engine->_bindless;
+	std::optional<uint32_t> depthSlot = bindless.add_sampled_image(_engine->_depthImage.imageView);
+	std::optional<uint32_t> imageSlot = bindless.add_sampled_image(_image.imageView, VK_IMAGE_LAYOUT_GENERAL);
+	std::optional<uint32_t> samplerSlot = bindless.add_sampler(_sampler);
+	if (!depthSlot || !imageSlot || !samplerSlot)
+	{
+		cleanup();
+		return false;
+	}
+	_depthSlot = *depthSlot;
+	_imageSlot = *imageSlot;
+	_samplerSlot = *samplerSlot;
+
+	for (VkImageView view : _levelViews)
+	{
+		std::optional<uint32_t> storageSlot = bindless.add_storage_image(view);
+		std::optional<uint32_t> sampledSlot = bindless.add_sampled_image(view, VK_IMAGE_LAYOUT_GENERAL);
+		if (!storageSlot || !sampledSlot)
+		{
+			cleanup();
+			return false;
+		}
+		_levelStorageSlots.push_back(*storageSlot);
+		_levelSampledSlots.push_back(*sampledSlot);
+	}
+
+	// Reduction pass
+	VkPushConstantRange pushConstant {};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(PushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayout bindlessLayout = bindless.layout();
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.pSetLayouts = &bindlessLayout;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	layoutInfo.pushConstantRangeCount = 1;
+	VK_CHECK(vkCreatePipelineLayout(_engine->_device, &layoutInfo, nullptr, &_pipelineLayout));
+
+	std::string shaderPath = SHADERS_PATH;
+	shaderPath += "depth_pyramid.comp.spv";
+	VkShaderModule shader;
+	if (!vkutil::load_shader_module(shaderPath.c_str(), _engine->_device, &shader))
+	{
+		_engine->m_logger->error("Error when building the compute shader: [{}]", shaderPath);
+		cleanup();
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.layout = _pipelineLayout;
+	pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+	VK_CHECK(vkCreateComputePipelines(_engine->_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline));
+
+	vkDestroyShaderModule(_engine->_device, shader, nullptr);
+
+	// Readers bind the chain before the first build, it has to be in its layout already
+	_engine->immediate_submit([&](VkCommandBuffer cmd) {
+		vkutil::BarrierScope computeSampled { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL };
+		vkutil::BarrierBuilder().image(_image.image, vkutil::scope::None, computeSampled).flush(cmd);
+	});
+
+	return true;
+}
+
+void
+DepthPyramid::cleanup()
+{
+	vkDestroyPipeline(_engine->_device, _pipeline, nullptr);
+	vkDestroyPipelineLayout(_engine->_device, _pipelineLayout, nullptr);
+
+	// the slots are only released with the table, the pyramid lives as long as the engine
+	_levelStorageSlots.clear();
+	_levelSampledSlots.clear();
+
+	vkDestroySampler(_engine->_device, _sampler, nullptr);
+	for (VkImageView view : _levelViews)
+	{
+		vkDestroyImageView(_engine->_device, view, nullptr);
+	}
+	_levelViews.clear();
+	_engine->destroy_image(_image);
+}
+
+void
+DepthPyramid::build(VkCommandBuffer cmd)
+{
+	const VkImage depthImage = _engine->_depthImage.image;
+	const vkutil::BarrierScope computeSampled { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	const vkutil::BarrierScope levelWritten { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL };
+	const vkutil::BarrierScope levelSampled { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		VK_IMAGE_LAYOUT_GENERAL };
+	// last frame's culling may still be reading the old chain, which is discarded
+	const vkutil::BarrierScope previousReads { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE,
+		VK_IMAGE_LAYOUT_UNDEFINED };
+
+	vkutil::BarrierBuilder barriers;
+	barriers.image(depthImage, vkutil::scope::DepthAttachment, computeSampled, VK_IMAGE_ASPECT_DEPTH_BIT)
+		.image(_image.image, previousReads, levelWritten)
+		.flush(cmd);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+	_engine->_bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout);
+
+	VkExtent2D levelExtent = _extent;
+	for (uint32_t level = 0; level < _image.mipLevels; level++)
+	{
+		PushConstants pushConstants;
+		pushConstants.outWidth = (float)levelExtent.width;
+		pushConstants.outHeight = (float)levelExtent.height;
+		pushConstants.inImage = level == 0 ? _depthSlot : _levelSampledSlots[level - 1];
+		pushConstants.outImage = _levelStorageSlots[level];
+		pushConstants.reductionSampler = _samplerSlot;
+		vkCmdPushConstants(cmd, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(cmd, (levelExtent.width + 15) / 16, (levelExtent.height + 15) / 16, 1);
+
+		// the next level reads this one, and the culling reads them all
+		barriers.image(_image.image, levelWritten, levelSampled, VK_IMAGE_ASPECT_COLOR_BIT, level, 1).flush(cmd);
+
+		levelExtent = { std::max(levelExtent.width / 2, 1u), std::max(levelExtent.height / 2, 1u) };
+	}
+
+	// the depth is loaded again by the passes drawing the rest of the frame
+	barriers.image(depthImage, computeSampled, vkutil::scope::DepthAttachment, VK_IMAGE_ASPECT_DEPTH_BIT).flush(cmd);
+}
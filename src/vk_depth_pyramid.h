@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vk_types.h>
+
+//forward declaration
+class VulkanEngine;
+
+// Hierarchical Z buffer: a mip chain built from the depth image where every texel holds
+// the farthest depth of the texels it covers. Depth tests pass with GREATER_OR_EQUAL, so
+// the farthest depth is the smallest one and the chain is reduced with a min sampler.
+// One sample of the right level tells whether anything in a screen rectangle can be in
+// front of a given depth. Level 0 is the largest power of two that fits in the depth image.
+class DepthPyramid
+{
+public:
+    bool init(VulkanEngine* engine);
+    void cleanup();
+
+    // Records the reduction of the depth image, which has to be in DEPTH_ATTACHMENT_OPTIMAL
+    // with the depth writes done, and is back in that layout with its contents kept afterwards.
+    // The whole pyramid is then in GENERAL and readable by compute shaders.
+    void build(VkCommandBuffer cmd);
+
+    // Bindless slots of the whole chain and of the min reduction sampler to read it with
+    uint32_t image_slot() const { return _imageSlot; }
+    uint32_t sampler_slot() const { return _samplerSlot; }
+
+    VkExtent2D extent() const { return _extent; }
+    uint32_t mip_levels() const { return _image.mipLevels; }
+
+private:
+    // must match depth_pyramid.comp
+    struct PushConstants
+    {
+        float outWidth;
+        float outHeight;
+        uint32_t inImage;
+        uint32_t outImage;
+        uint32_t reductionSampler;
+    };
+
+    VulkanEngine* _engine;
+
+    AllocatedImage _image;
+    VkExtent2D _extent;
+    // one view per level, written as a storage image and read when reducing the next one
+    std::vector<VkImageView> _levelViews;
+    VkSampler _sampler {VK_NULL_HANDLE};
+
+    // bindless slots, all of the images in GENERAL except the depth image
+    std::vector<uint32_t> _levelStorageSlots;
+    std::vector<uint32_t> _levelSampledSlots;
+    uint32_t _depthSlot;
+    uint32_t _imageSlot;
+    uint32_t _samplerSlot;
+
+    VkPipelineLayout _pipelineLayout {VK_NULL_HANDLE};
+    VkPipeline _pipeline {VK_NULL_HANDLE};
+};
@@ -1,11 +1,13 @@
 #include <vk_descriptors.h>
 
+#include <algorithm>
+
 void
-DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type)
+DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type, uint32_t count)
 {
     VkDescriptorSetLayoutBinding newbind {};
     newbind.binding = binding;
-    newbind.descriptorCount = 1;
+    newbind.descriptorCount = count;
     newbind.descriptorType = type;
 
     bindings.push_back(newbind);
@@ -38,49 +40,116 @@ DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shaderStages,
     return set;
 }
 
-void
-DescriptorAllocator::init_pool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios)
+namespace
 {
-    std::vector<VkDescriptorPoolSize> poolSizes;
-    for (PoolSizeRatio ratio : poolRatios) {
-        poolSizes.push_back(VkDescriptorPoolSize{
-            .type = ratio.type,
-            .descriptorCount = uint32_t(ratio.ratio * maxSets)
-        });
-    }
 
-	VkDescriptorPoolCreateInfo pool_info = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-	pool_info.flags = 0;
-	pool_info.maxSets = maxSets;
-	pool_info.poolSizeCount = (uint32_t)poolSizes.size();
-	pool_info.pPoolSizes = poolSizes.data();
+// Pools grow by half each time, up to this many sets
+constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+} // namespace
 
-	vkCreateDescriptorPool(device, &pool_info, nullptr, &pool);
+void
+DescriptorAllocator::init(uint32_t initialSets, std::span<PoolSizeRatio> poolRatios)
+{
+    ratios.assign(poolRatios.begin(), poolRatios.end());
+    setsPerPool = std::min(initialSets, MAX_SETS_PER_POOL);
 }
 
 void
-DescriptorAllocator::clear_descriptors(VkDevice device)
+DescriptorAllocator::clear_pools(VkDevice device)
 {
-    vkResetDescriptorPool(device, pool, 0);
+    for (VkDescriptorPool pool : readyPools)
+    {
+        VK_CHECK(vkResetDescriptorPool(device, pool, 0));
+    }
+    for (VkDescriptorPool pool : fullPools)
+    {
+        VK_CHECK(vkResetDescriptorPool(device, pool, 0));
+        readyPools.push_back(pool);
+    }
+    fullPools.clear();
 }
 
 void
-DescriptorAllocator::destroy_pool(VkDevice device)
+DescriptorAllocator::destroy_pools(VkDevice device)
 {
-    vkDestroyDescriptorPool(device,pool,nullptr);
+    for (VkDescriptorPool pool : readyPools)
+    {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : fullPools)
+    {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    readyPools.clear();
+    fullPools.clear();
 }
 
 VkDescriptorSet
-DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout)
+DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout, void* pNext)
 {
+    VkDescriptorPool pool = get_pool(device);
+
     VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-    allocInfo.pNext = nullptr;
+    allocInfo.pNext = pNext;
     allocInfo.descriptorPool = pool;
     allocInfo.descriptorSetCount = 1;
     allocInfo.pSetLayouts = &layout;
 
     VkDescriptorSet ds;
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds));
+    VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &ds);
+
+    // the pool is done for until the next clear, retry once with a fresh one
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+    {
+        fullPools.push_back(pool);
 
+        pool = get_pool(device);
+        allocInfo.descriptorPool = pool;
+        VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &ds));
+    }
+    else
+    {
+        VK_CHECK(result);
+    }
+
+    readyPools.push_back(pool);
     return ds;
 }
+
+VkDescriptorPool
+DescriptorAllocator::get_pool(VkDevice device)
+{
+    if (!readyPools.empty())
+    {
+        VkDescriptorPool pool = readyPools.back();
+        readyPools.pop_back();
+        return pool;
+    }
+
+    VkDescriptorPool pool = create_pool(device, setsPerPool);
+    setsPerPool = std::min(setsPerPool + setsPerPool / 2, MAX_SETS_PER_POOL);
+    return pool;
+}
+
+VkDescriptorPool
+DescriptorAllocator::create_pool(VkDevice device, uint32_t setCount)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (PoolSizeRatio ratio : ratios) {
+        poolSizes.push_back(VkDescriptorPoolSize{
+            .type = ratio.type,
+            .descriptorCount = uint32_t(ratio.ratio * setCount)
+        });
+    }
+
+	VkDescriptorPoolCreateInfo pool_info = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+	pool_info.flags = 0;
+	pool_info.maxSets = setCount;
+	pool_info.poolSizeCount = (uint32_t)poolSizes.size();
+	pool_info.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+	VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+    return pool;
+}
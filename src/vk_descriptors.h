@@ -6,11 +6,16 @@ struct DescriptorLayoutBuilder
 {
     std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-    void add_binding(uint32_t binding, VkDescriptorType type);
+    void add_binding(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
     void clear();
     VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages, void* pNext = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
 };
 
+// Hands out descriptor sets from a chain of pools. When a pool runs out another one is
+// taken from the ready list or created, each new pool holding more sets than the last.
+// No pool is created before the first allocation, an allocator nothing uses costs nothing.
+// Sets are never freed one by one, clear_pools() resets every pool at once and keeps
+// them for reuse, which makes it a fit for sets that only live for one frame.
 struct DescriptorAllocator
 {
     struct PoolSizeRatio
@@ -19,12 +24,21 @@ struct DescriptorAllocator
 		float ratio;
     };
 
-    VkDescriptorPool pool;
+    // poolRatios is the number of descriptors of each type per set, initialSets the size of the first pool
+    void init(uint32_t initialSets, std::span<PoolSizeRatio> poolRatios);
+    void clear_pools(VkDevice device);
+    void destroy_pools(VkDevice device);
 
-    void init_pool(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios);
-    void clear_descriptors(VkDevice device);
-    void destroy_pool(VkDevice device);
+    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout, void* pNext = nullptr);
 
-    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout);
-};
+private:
+    VkDescriptorPool get_pool(VkDevice device);
+    VkDescriptorPool create_pool(VkDevice device, uint32_t setCount);
 
+    std::vector<PoolSizeRatio> ratios;
+    // pools allocation failed from, and pools with room left
+    std::vector<VkDescriptorPool> fullPools;
+    std::vector<VkDescriptorPool> readyPools;
+    // size of the next pool created
+    uint32_t setsPerPool {0};
+};
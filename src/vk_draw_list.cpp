@@ -0,0 +1,141 @@
+#include <vk_draw_list.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+
+constexpr uint32_t DEPTH_SHIFT = 0;
+constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + drawkey::DEPTH_BITS;
+constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + drawkey::MESH_BITS;
+constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + drawkey::MATERIAL_BITS;
+constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + drawkey::PIPELINE_BITS;
+static_assert(PASS_SHIFT + drawkey::PASS_BITS == 64, "the key fields have to fill 64 bits");
+
+uint64_t
+field(uint32_t value, uint32_t bits, uint32_t shift)
+{
+	return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+constexpr uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+
+} // namespace
+
+uint64_t
+drawkey::make(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	// The bits of a non negative float order the same way as its value,
+	// the top ones keep the exponent and as much of the mantissa as fits
+	uint32_t depthBits = std::bit_cast<uint32_t>(std::max(depth, 0.f)) >> (32 - DEPTH_BITS);
+
+	return field(pass, PASS_BITS, PASS_SHIFT)
+		| field(pipeline, PIPELINE_BITS, PIPELINE_SHIFT)
+		| field(material, MATERIAL_BITS, MATERIAL_SHIFT)
+		| field(mesh, MESH_BITS, MESH_SHIFT)
+		| field(depthBits, DEPTH_BITS, DEPTH_SHIFT);
+}
+
+void
+DrawList::sort()
+{
+	// Histograms of every digit in one read of the keys
+	uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (const Item& item : _items)
+	{
+		for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+		{
+			histograms[pass][(item.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+		}
+	}
+
+	_scratch.resize(_items.size());
+	for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+	{
+		// Digits every key shares leave the order as it is, which is common for the
+		// pass and material fields
+		uint32_t* histogram = histograms[pass];
+		const uint64_t digit = _items.empty() ? 0 : (_items[0].key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+		if (histogram[digit] == _items.size())
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+		{
+			uint32_t count = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += count;
+		}
+
+		for (const Item& item : _items)
+		{
+			_scratch[histogram[(item.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++] = item;
+		}
+		_items.swap(_scratch);
+	}
+}
+
+BindStats&
+BindStats::operator+=(const BindStats& other)
+{
+	issued.pipelines += other.issued.pipelines;
+	issued.descriptorSets += other.issued.descriptorSets;
+	issued.indexBuffers += other.issued.indexBuffers;
+	elided.pipelines += other.elided.pipelines;
+	elided.descriptorSets += other.elided.descriptorSets;
+	elided.indexBuffers += other.elided.indexBuffers;
+	return *this;
+}
+
+void
+BindState::bind_pipeline(VkPipeline pipeline)
+{
+	if (_pipeline == pipeline)
+	{
+		_stats.elided.pipelines++;
+		return;
+	}
+
+	vkCmdBindPipeline(_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	_pipeline = pipeline;
+	_stats.issued.pipelines++;
+}
+
+void
+BindState::bind_descriptor_set(VkPipelineLayout layout, uint32_t setIndex, VkDescriptorSet set)
+{
+	if (setIndex < MAX_SETS && _sets[setIndex] == set)
+	{
+		_stats.elided.descriptorSets++;
+		return;
+	}
+
+	vkCmdBindDescriptorSets(_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setIndex, 1, &set, 0, nullptr);
+	if (setIndex < MAX_SETS)
+	{
+		_sets[setIndex] = set;
+	}
+	_stats.issued.descriptorSets++;
+}
+
+void
+BindState::bind_index_buffer(VkBuffer buffer, VkIndexType indexType)
+{
+	if (_indexBuffer == buffer && _indexType == indexType)
+	{
+		_stats.elided.indexBuffers++;
+		return;
+	}
+
+	vkCmdBindIndexBuffer(_cmd, buffer, 0, indexType);
+	_indexBuffer = buffer;
+	_indexType = indexType;
+	_stats.issued.indexBuffers++;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vk_types.h>
+
+// 64 bit sort keys of the draws of a frame, from the most significant bits: pass, pipeline,
+// material, mesh and depth. Sorting by them groups the draws that share state, so the
+// state changes between consecutive draws are as rare as the order of the fields allows.
+// Values wider than their field are masked, which only costs elided binds, the recorder
+// compares the state it actually binds.
+namespace drawkey
+{
+
+constexpr uint32_t PASS_BITS = 4;
+constexpr uint32_t PIPELINE_BITS = 8;
+// descriptor set or any other state shared by the draws of one pipeline
+constexpr uint32_t MATERIAL_BITS = 12;
+constexpr uint32_t MESH_BITS = 16;
+constexpr uint32_t DEPTH_BITS = 24;
+
+// depth is the view space distance, smaller ones sort first for front to back drawing
+uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+} // namespace drawkey
+
+// The draws of a frame in key order. Draws are added with their key and sorted with an
+// LSD radix sort, which is stable and linear in the number of draws. items() then gives
+// the index every draw was added at in sorted order.
+class DrawList
+{
+public:
+    struct Item
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    void clear() { _items.clear(); }
+    // index is the position of the draw in the caller's own array
+    void add(uint64_t key, uint32_t index) { _items.push_back({ key, index }); }
+    void sort();
+
+    std::span<const Item> items() const { return _items; }
+    size_t size() const { return _items.size(); }
+
+private:
+    std::vector<Item> _items;
+    // other buffer of the radix sort, kept to reuse the allocation
+    std::vector<Item> _scratch;
+};
+
+// Binds that reached the command buffer and the ones skipped because the state was already bound
+struct BindStats
+{
+    struct Counts
+    {
+        uint32_t pipelines;
+        uint32_t descriptorSets;
+        uint32_t indexBuffers;
+    };
+
+    Counts issued {};
+    Counts elided {};
+
+    BindStats& operator+=(const BindStats& other);
+};
+
+// State last bound on one command buffer. Binds that would not change it are skipped.
+// Recording threads each use their own, it starts out with nothing bound.
+class BindState
+{
+public:
+    explicit BindState(VkCommandBuffer cmd) : _cmd(cmd) {}
+
+    void bind_pipeline(VkPipeline pipeline);
+    // graphics bind point, every set bound through one BindState has to use layouts compatible with it
+    void bind_descriptor_set(VkPipelineLayout layout, uint32_t setIndex, VkDescriptorSet set);
+    void bind_index_buffer(VkBuffer buffer, VkIndexType indexType);
+
+    const BindStats& stats() const { return _stats; }
+
+private:
+    static constexpr uint32_t MAX_SETS = 4;
+
+    VkCommandBuffer _cmd;
+    VkPipeline _pipeline {VK_NULL_HANDLE};
+    VkDescriptorSet _sets[MAX_SETS] {};
+    VkBuffer _indexBuffer {VK_NULL_HANDLE};
+    VkIndexType _indexType {VK_INDEX_TYPE_MAX_ENUM};
+
+    BindStats _stats;
+};
@@ -5,8 +5,10 @@
 
 #include <vk_types.h>
 #include <vk_initializers.h>
+#include <vk_barriers.h>
 #include <vk_images.h>
 #include <vk_pipelines.h>
+#include <vk_upload.h>
 
 #include <VkBootstrap.h>
 
@@ -18,7 +20,10 @@
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_vulkan.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <thread>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -80,7 +85,13 @@ VulkanEngine::init(std::shared_ptr<spdlog::logger> logger)
 
 	init_sync_structures();
 
-    init_descriptors();
+	init_instance_buffers();
+
+    if (!init_descriptors())
+    {
+        m_logger->error("Failed to initialize descriptors");
+        return false;
+    }
 
     if (!init_pipelines())
     {
@@ -116,6 +127,10 @@ VulkanEngine::cleanup()
         {
             //already written from before
             vkDestroyCommandPool(_device, _frames[i]._commandPool, nullptr);
+            for (VkCommandPool pool : _frames[i]._recordingCommandPools)
+            {
+                vkDestroyCommandPool(_device, pool, nullptr);
+            }
 
             //destroy sync objects
             vkDestroyFence(_device, _frames[i]._renderFence, nullptr);
@@ -124,12 +139,6 @@ VulkanEngine::cleanup()
             _frames[i]._deletionQueue.flush();
         }
 
-		for (auto& mesh : testMeshes)
-		{
-			destroy_buffer(mesh->meshBuffers.indexBuffer);
-			destroy_buffer(mesh->meshBuffers.vertexBuffer);
-		}
-
         // Flush the global deletion queue
         _mainDeletionQueue.flush();
 
@@ -157,6 +166,19 @@ VulkanEngine::draw()
     
     // Cleanup frame objects
     get_current_frame()._deletionQueue.flush();
+    get_current_frame()._frameDescriptors.clear_pools(_device);
+
+	// Recycle upload resources and staging memory of uploads that have finished
+	_uploader.collect();
+	_stagingRing.reclaim();
+	_bindless.collect(_frameNumber);
+
+	// Make room for meshes streaming in, this frame's slot is no longer read by the GPU
+	_meshResidency.update(_frameNumber);
+
+	// The culling results of this frame's last use can be read back now
+	_clusterCuller.begin_frame(_frameNumber % FRAME_OVERLAP);
+	_indirectRenderer.begin_frame(_frameNumber % FRAME_OVERLAP);
 
     // request image from the swapchain
 	uint32_t swapchainImageIndex;
@@ -168,6 +190,10 @@ VulkanEngine::draw()
 	// now that we are sure that the commands finished executing, we can safely
 	// reset the command buffer to begin recording again.
 	VK_CHECK(vkResetCommandBuffer(cmd, 0));
+	for (VkCommandPool pool : get_current_frame()._recordingCommandPools)
+	{
+		VK_CHECK(vkResetCommandPool(_device, pool, 0));
+	}
 
 	// begin the command buffer recording. We will use this command buffer exactly once, so we want to let vulkan know that
 	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
@@ -177,32 +203,75 @@ VulkanEngine::draw()
 
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
-	// transition our main draw image into general layout so we can write into it
-	// we will overwrite it all so we dont care about what was the older layout
-	vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-	draw_background(cmd);
-
-	vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	vkutil::transition_image(cmd, _depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	// Only the uploads of meshes drawn this frame matter, and those are only waited
+	// on by the GPU. Meshes that are not resident yet are skipped until their upload is done.
+	std::vector<const MeshAsset*> readyMeshes(testMeshes.size(), nullptr);
+	for (uint32_t meshIndex : _scene.used_meshes())
+	{
+		if (meshIndex < testMeshes.size())
+		{
+			readyMeshes[meshIndex] = _meshResidency.request(testMeshes[meshIndex], cmd, _frameNumber);
+		}
+	}
+	if (readyMeshes != _readyMeshes)
+	{
+		_readyMeshes = std::move(readyMeshes);
+		_sceneVersion++;
+	}
 
-	draw_geometry(cmd);
+	// The instance buffer of this frame is no longer read now that its fence was waited on
+	FrameData& frame = get_current_frame();
+	if (!_pendingInstances.empty())
+	{
+		const VkDeviceSize instancesSize = _pendingInstances.size() * sizeof(GPUInstanceData);
+		memcpy(frame._instanceBuffer.info.pMappedData, _pendingInstances.data(), instancesSize);
+		VK_CHECK(vmaFlushAllocation(_allocator, frame._instanceBuffer.allocation, 0, instancesSize));
+		_pendingInstances.clear();
+	}
+	for (InstanceBatch& batch : _instanceBatches)
+	{
+		batch.asset = _meshResidency.request(batch.mesh, cmd, _frameNumber);
+	}
 
-	//transition the draw image and the swapchain image into their correct transfer layouts
-	vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	// The passes of the frame declare how they use the images, the render graph places the
+	// layout transitions and barriers between them. The draw and depth images are overwritten
+	// every frame, so their old contents never matter. The swapchain image can only be
+	// written once the acquire semaphore wait at the color attachment output stage is done.
+	VkImage swapchainImage = _swapchainImages[swapchainImageIndex];
+	VkImageView swapchainImageView = _swapchainImageViews[swapchainImageIndex];
+
+	_renderGraph.reset();
+	RenderGraph::ImageHandle drawImage = _renderGraph.import_image("draw", _drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED);
+	RenderGraph::ImageHandle depthImage = _renderGraph.import_image("depth", _depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED);
+	RenderGraph::ImageHandle presentImage = _renderGraph.import_image("swapchain", swapchainImage, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+	_renderGraph.export_image(presentImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	_renderGraph.add_pass("background", [this](VkCommandBuffer cmd) { draw_background(cmd); })
+		.write(drawImage, RenderGraph::ImageUsage::ComputeStorage);
+
+	// meshes blend onto the background
+	_renderGraph.add_pass("geometry", [this](VkCommandBuffer cmd) { draw_geometry(cmd); })
+		.read(drawImage, RenderGraph::ImageUsage::ColorAttachment)
+		.write(drawImage, RenderGraph::ImageUsage::ColorAttachment)
+		.write(depthImage, RenderGraph::ImageUsage::DepthAttachment);
 
 	// execute a copy from the draw image into the swapchain
-	vkutil::copy_image_to_image(cmd, _drawImage.image, _swapchainImages[swapchainImageIndex], _drawExtent, _swapchainExtent);
-
-	// set swapchain image layout to Attachment Optimal so we can draw it
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	_renderGraph.add_pass("blit", [this, swapchainImage](VkCommandBuffer cmd) {
+		vkutil::copy_image_to_image(cmd, _drawImage.image, swapchainImage, _drawExtent, _swapchainExtent);
+	})
+		.read(drawImage, RenderGraph::ImageUsage::TransferSrc)
+		.write(presentImage, RenderGraph::ImageUsage::TransferDst);
 
 	//draw imgui into the swapchain image
-	draw_imgui(cmd,  _swapchainImageViews[swapchainImageIndex]);
+	_renderGraph.add_pass("imgui", [this, swapchainImageView](VkCommandBuffer cmd) { draw_imgui(cmd, swapchainImageView); })
+		.read(presentImage, RenderGraph::ImageUsage::ColorAttachment)
+		.write(presentImage, RenderGraph::ImageUsage::ColorAttachment);
 
-	// set swapchain image layout to Present so we can draw it
-	vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	_renderGraph.execute(cmd);
+	_instanceBatches.clear();
 
 	//finalize the command buffer (we can no longer add commands, but it can now be executed)
 	VK_CHECK(vkEndCommandBuffer(cmd));
@@ -213,13 +282,24 @@ VulkanEngine::draw()
 
 	VkCommandBufferSubmitInfo cmdinfo = vkinit::command_buffer_submit_info(cmd);	
 	
-	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, get_current_frame()._swapchainSemaphore);
+	VkSemaphoreSubmitInfo waitInfos[2];
+	waitInfos[0] = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, get_current_frame()._swapchainSemaphore);
 	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, _renderSemaphores[swapchainImageIndex]);	
 	
-	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);	
+	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfos[0]);	
+
+	// also wait on the upload timeline for the meshes acquired this frame
+	if (uint64_t uploadWaitValue = _uploader.take_graphics_wait_value(); uploadWaitValue > 0)
+	{
+		waitInfos[1] = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			_uploader.semaphore());
+		waitInfos[1].value = uploadWaitValue;
+		submit.waitSemaphoreInfoCount = 2;
+	}
 
 	// submit command buffer to the queue and execute it.
 	// _renderFence will now block until the graphic commands finish execution
+	std::lock_guard<std::mutex> queueLock(_graphicsQueueMutex);
 	VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, get_current_frame()._renderFence));
 
     // prepare present
@@ -251,10 +331,12 @@ VulkanEngine::draw_background(VkCommandBuffer cmd)
 	// bind the background compute pipeline
 	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
 
-	// bind the descriptor set containing the draw image for the compute pipeline
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _gradientPipelineLayout, 0, 1, &_drawImageDescriptors, 0, nullptr);
+	// bind the bindless table, the effect finds the draw image in it by its slot
+	_bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _gradientPipelineLayout);
 
-	vkCmdPushConstants(cmd, _gradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
+	ComputePushConstants pushConstants = effect.data;
+	pushConstants.drawImage = _drawImageSlot;
+	vkCmdPushConstants(cmd, _gradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
 	// execute the compute pipeline dispatch. We are using 16x16 workgroup size so we need to divide by it
 	vkCmdDispatch(cmd, std::ceil(_drawExtent.width / 16.0), std::ceil(_drawExtent.height / 16.0), 1);
 }
@@ -275,17 +357,139 @@ VulkanEngine::draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView)
 void
 VulkanEngine::draw_geometry(VkCommandBuffer cmd)
 {
+	// Mesh rendering
+	GPUDrawPushConstants push_constants;
+	//push_constants.worldMatrix = glm::mat4{ 1.f };
+
+	// THIS VIEW AND PROJECTION DOES NOT WORK!!
+	//glm::mat4 view = glm::translate(glm::vec3{ 0,0,-5 });
+	//glm::mat4 view = glm::translate(_view) * glm::rotate();
+	glm::mat4 view = glm::rotate(glm::radians(_rotate.x), glm::vec3{ 1,0,0}) *
+					 glm::rotate(glm::radians(_rotate.y), glm::vec3{ 0,1,0}) *
+					 glm::rotate(glm::radians(_rotate.z), glm::vec3{ 0,0,1}) *
+					 glm::translate(_view);
+	// camera projection
+	//glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_drawExtent.width / (float)_drawExtent.height, 10000.f, 0.1f);
+	//glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_drawExtent.width / (float)_drawExtent.height, 0.1f, 10000.f);
+	glm::mat4 projection = glm::perspective(glm::radians(_fovy), (float)_drawExtent.width / (float)_drawExtent.height, _near, _far);
+
+	// invert the Y direction on projection matrix so that we are more similar
+	// to opengl and gltf axis
+	projection[1][1] *= -1;
+	//push_constants.worldMatrix[1][1] *= -1;
+
+	//push_constants.worldMatrix = projection * view;
+	push_constants.worldMatrix = projection * view;
+
+	/*if (!loggedOnce)
+	{
+		loggedOnce = true;
+
+		m_logger->warn("view: {}", view);
+		m_logger->warn("projection: {}", projection);
+		m_logger->warn("worldMatrix: {}", push_constants.worldMatrix);
+	}*/
+
+	const glm::mat4 viewProjection = push_constants.worldMatrix;
+
+	// Only the subtrees whose transforms changed since the last frame are recomputed
+	_scene.update_transforms();
+	if (_scene.stats().updatedNodes > 0)
+	{
+		_sceneVersion++;
+	}
+
+	if (_gpuDriven)
+	{
+		draw_geometry_indirect(cmd, view, projection);
+		return;
+	}
+
+	// Pick the level of every surface of the scene nodes whose meshes have completed their uploads.
+	// Surfaces drawn at full detail have their meshlets culled on the GPU first, which has to
+	// be recorded outside of the render pass.
+	const float lodScale = _drawExtent.height / (2.f * std::tan(glm::radians(_fovy) * 0.5f));
+	std::fill(std::begin(_lodTriangles), std::end(_lodTriangles), 0);
+
+	_geometryDraws.clear();
+	_drawList.clear();
+	for (uint32_t node : _scene.mesh_nodes())
+	{
+		const MeshHandle meshHandle = _scene.mesh(node);
+		const MeshAsset* mesh = _readyMeshes[meshHandle];
+		if (!mesh)
+		{
+			continue;
+		}
+
+		const glm::mat4& worldMatrix = _scene.world_matrix(node);
+		const glm::mat4 modelView = view * worldMatrix;
+		const uint32_t pipeline = (uint32_t)mesh->meshBuffers.vertexFormat;
+		for (const GeoSurface& surface : mesh->surfaces)
+		{
+			uint32_t lod = select_lod(surface, modelView, lodScale);
+			_lodTriangles[lod] += surface.lods[lod].count / 3;
+
+			GeometryDraw& draw = _geometryDraws.emplace_back();
+			draw.mesh = mesh;
+			draw.lod = &surface.lods[lod];
+			draw.worldMatrix = &worldMatrix;
+			if (_clusterCulling && lod == 0)
+			{
+				draw.clusterDraw = _clusterCuller.add(*mesh, surface, worldMatrix);
+			}
+
+			// There are no materials yet, the state the draws of a pipeline can differ in
+			// is whether they read the culler's index buffer or the geometry pool's
+			const uint32_t material = draw.clusterDraw ? 1 : 0;
+			const float depth = glm::length(glm::vec3(modelView * glm::vec4(glm::vec3(surface.bounds), 1.f)));
+			_drawList.add(drawkey::make((uint32_t)DrawPass::Opaque, pipeline, material, meshHandle, depth),
+				(uint32_t)_geometryDraws.size() - 1);
+		}
+	}
+
+	// Grouped by pipeline, index buffer and mesh, then front to back
+	const auto sortStart = std::chrono::steady_clock::now();
+	_drawList.sort();
+	_recordingStats.sortMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sortStart).count();
+
+	_clusterCuller.record(cmd, view, viewProjection);
+
 	//begin a render pass  connected to our draw image
 	VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(_drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	VkRenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(_depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 	VkRenderingInfo renderInfo = vkinit::rendering_info(_drawExtent, &colorAttachment, &depthAttachment);
 
-	vkCmdBeginRendering(cmd, &renderInfo);
+	// Recording scales with the number of draws, so many of them are split over the
+	// worker threads, each recording a secondary command buffer
+	const auto recordStart = std::chrono::steady_clock::now();
+	const uint32_t recordingChunks = _parallelRecording
+		? std::min<uint32_t>(get_current_frame()._recordingCommandBuffers.size(),
+			(uint32_t)_geometryDraws.size() / PARALLEL_RECORDING_MIN_DRAWS)
+		: 0;
+	if (recordingChunks > 1)
+	{
+		_recordingStats.binds = record_geometry_parallel(cmd, renderInfo, recordingChunks, viewProjection);
+	}
+	else
+	{
+		vkCmdBeginRendering(cmd, &renderInfo);
 
-	// Triangle rendering
-	//vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _trianglePipeline);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _meshPipeline);
+		set_draw_viewport(cmd);
+		_recordingStats.binds = record_geometry_draws(cmd, _drawList.items(), viewProjection);
+		draw_instances(cmd, viewProjection);
+
+		vkCmdEndRendering(cmd);
+	}
 
+	_recordingStats.threads = std::max(recordingChunks, 1u);
+	_recordingStats.draws = (uint32_t)_geometryDraws.size();
+	_recordingStats.recordMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+}
+
+void
+VulkanEngine::set_draw_viewport(VkCommandBuffer cmd)
+{
 	//set dynamic viewport and scissor
 	VkViewport viewport = {};
 	viewport.x = 0;
@@ -304,61 +508,295 @@ VulkanEngine::draw_geometry(VkCommandBuffer cmd)
 	scissor.extent.height = _drawExtent.height;
 
 	vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
 
-	//launch a draw command to draw 3 vertices
-	//vkCmdDraw(cmd, 3, 1, 0, 0);
-
-	// Mesh rendering
+BindStats
+VulkanEngine::record_geometry_draws(VkCommandBuffer cmd, std::span<const DrawList::Item> items, const glm::mat4& viewProjection)
+{
+	// All indices live in the geometry pool, or in the culler's buffer for culled surfaces,
+	// so the index buffer only changes between those two and with the index type.
+	// Push constants only change with the mesh or the node drawing it.
 	GPUDrawPushConstants push_constants;
-	//push_constants.worldMatrix = glm::mat4{ 1.f };
+	BindState state(cmd);
+	const MeshAsset* boundMesh = nullptr;
+	const glm::mat4* boundWorldMatrix = nullptr;
+	for (const DrawList::Item& item : items)
+	{
+		const GeometryDraw& draw = _geometryDraws[item.index];
+		const MeshAsset* mesh = draw.mesh;
+		const bool pushChanged = mesh != boundMesh || draw.worldMatrix != boundWorldMatrix;
+		if (pushChanged)
+		{
+			push_constants.worldMatrix = viewProjection * *draw.worldMatrix;
+		}
 
-	// THIS VIEW AND PROJECTION DOES NOT WORK!!
-	//glm::mat4 view = glm::translate(glm::vec3{ 0,0,-5 });
-	//glm::mat4 view = glm::translate(_view) * glm::rotate();
-	glm::mat4 view = glm::rotate(glm::radians(_rotate.x), glm::vec3{ 1,0,0}) *
-					 glm::rotate(glm::radians(_rotate.y), glm::vec3{ 0,1,0}) *
-					 glm::rotate(glm::radians(_rotate.z), glm::vec3{ 0,0,1}) *
-					 glm::translate(_view);
-	// camera projection
-	//glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_drawExtent.width / (float)_drawExtent.height, 10000.f, 0.1f);
-	//glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)_drawExtent.width / (float)_drawExtent.height, 0.1f, 10000.f);
-	glm::mat4 projection = glm::perspective(glm::radians(_fovy), (float)_drawExtent.width / (float)_drawExtent.height, _near, _far);
+		const bool packed = mesh->meshBuffers.vertexFormat == VertexFormat::Packed;
+		state.bind_pipeline(packed ? _meshPackedPipeline : _meshPipeline);
 
-	// invert the Y direction on projection matrix so that we are more similar
-	// to opengl and gltf axis
-	projection[1][1] *= -1;
-	//push_constants.worldMatrix[1][1] *= -1;
+		if (pushChanged && packed)
+		{
+			GPUPackedDrawPushConstants packed_push_constants;
+			packed_push_constants.worldMatrix = push_constants.worldMatrix;
+			packed_push_constants.positionScale = mesh->meshBuffers.quantization.positionScale;
+			packed_push_constants.positionOffset = mesh->meshBuffers.quantization.positionOffset;
+			packed_push_constants.vertexBuffer = mesh->meshBuffers.vertexBufferAddress;
 
-	//push_constants.worldMatrix = projection * view;
-	push_constants.worldMatrix = projection * view;
+			vkCmdPushConstants(cmd, _meshPackedPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUPackedDrawPushConstants), &packed_push_constants);
+		}
+		else if (pushChanged)
+		{
+			push_constants.vertexBuffer = mesh->meshBuffers.vertexBufferAddress;
 
-	/*if (!loggedOnce)
+			vkCmdPushConstants(cmd, _meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &push_constants);
+		}
+		boundMesh = mesh;
+		boundWorldMatrix = draw.worldMatrix;
+
+		VkBuffer indexBuffer = draw.clusterDraw ? _clusterCuller.index_buffer() : _geometryPool.index_buffer();
+		VkIndexType indexType = draw.clusterDraw ? VK_INDEX_TYPE_UINT32 : mesh->meshBuffers.indexType;
+		state.bind_index_buffer(indexBuffer, indexType);
+
+		if (draw.clusterDraw)
+		{
+			_clusterCuller.draw_indirect(cmd, *draw.clusterDraw);
+		}
+		else
+		{
+			vkCmdDrawIndexed(cmd, draw.lod->count, 1, mesh->meshBuffers.firstIndex + draw.lod->startIndex, 0, 0);
+		}
+	}
+
+	return state.stats();
+}
+
+BindStats
+VulkanEngine::record_geometry_parallel(VkCommandBuffer cmd, VkRenderingInfo renderInfo, uint32_t chunkCount,
+	const glm::mat4& viewProjection)
+{
+	FrameData& frame = get_current_frame();
+
+	// Secondaries continue the dynamic render pass of the primary, they have to know its formats
+	VkCommandBufferInheritanceRenderingInfo inheritanceRendering = vkinit::command_buffer_inheritance_rendering_info(
+		&_drawImage.imageFormat, _depthImage.imageFormat);
+	VkCommandBufferInheritanceInfo inheritance = vkinit::command_buffer_inheritance_info(&inheritanceRendering);
+
+	// Chunks keep the sorted order, and with it the bind elision inside each of them.
+	// Every chunk has its own pool, so no two threads ever record from the same one.
+	const std::span<const DrawList::Item> items = _drawList.items();
+	const size_t drawCount = items.size();
+	std::vector<BindStats> chunkStats(chunkCount);
+	_workerPool.parallel_for(chunkCount, [&](size_t chunk) {
+		VkCommandBuffer secondary = frame._recordingCommandBuffers[chunk];
+
+		VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+		beginInfo.pInheritanceInfo = &inheritance;
+		VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+
+		// no state is inherited from the primary
+		set_draw_viewport(secondary);
+
+		const size_t first = drawCount * chunk / chunkCount;
+		const size_t last = drawCount * (chunk + 1) / chunkCount;
+		chunkStats[chunk] = record_geometry_draws(secondary, items.subspan(first, last - first), viewProjection);
+
+		// the primary can not record draws itself inside this render pass
+		if (chunk == chunkCount - 1)
+		{
+			draw_instances(secondary, viewProjection);
+		}
+
+		VK_CHECK(vkEndCommandBuffer(secondary));
+	});
+
+	renderInfo.flags |= VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+	vkCmdBeginRendering(cmd, &renderInfo);
+	vkCmdExecuteCommands(cmd, chunkCount, frame._recordingCommandBuffers.data());
+	vkCmdEndRendering(cmd);
+
+	BindStats stats;
+	for (const BindStats& chunk : chunkStats)
 	{
-		loggedOnce = true;
+		stats += chunk;
+	}
+	return stats;
+}
 
-		m_logger->warn("view: {}", view);
-		m_logger->warn("projection: {}", projection);
-		m_logger->warn("worldMatrix: {}", push_constants.worldMatrix);
-	}*/
+void
+VulkanEngine::draw_geometry_indirect(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& projection)
+{
+	const glm::mat4 viewProjection = projection * view;
 
-	/*push_constants.vertexBuffer = rectangle.vertexBufferAddress;
+	// The objects are only uploaded again when the scene changed since this frame's buffers were
+	// last filled, otherwise recording costs the same no matter how many objects there are
+	if (_indirectRenderer.begin_objects(_sceneVersion))
+	{
+		for (uint32_t node : _scene.mesh_nodes())
+		{
+			const MeshAsset* mesh = _readyMeshes[_scene.mesh(node)];
+			if (!mesh)
+			{
+				continue;
+			}
+
+			for (const GeoSurface& surface : mesh->surfaces)
+			{
+				_indirectRenderer.add(*mesh, surface, _scene.world_matrix(node));
+			}
+		}
+	}
 
-	vkCmdPushConstants(cmd, _meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &push_constants);
-	vkCmdBindIndexBuffer(cmd, rectangle.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	IndirectRenderer::LodSettings lodSettings;
+	lodSettings.lodScale = _drawExtent.height / (2.f * std::tan(glm::radians(_fovy) * 0.5f));
+	lodSettings.errorThreshold = _lodErrorThreshold;
+	lodSettings.forcedLod = _forcedLod;
+	_indirectRenderer.record_cull(cmd, view, projection, lodSettings, _occlusionCulling);
 
-	vkCmdDrawIndexed(cmd, 6, 1, 0, 0, 0);*/
+	// the levels were picked on the GPU, these are the counts of the last completed frame
+	IndirectRenderer::Stats indirectStats = _indirectRenderer.stats();
+	std::copy(std::begin(indirectStats.lodTriangles), std::end(indirectStats.lodTriangles), std::begin(_lodTriangles));
 
-	// Draw monkeyhead mesh
-	push_constants.vertexBuffer = testMeshes[2]->meshBuffers.vertexBufferAddress;
+	VkRenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(_depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
-	vkCmdPushConstants(cmd, _meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &push_constants);
-	vkCmdBindIndexBuffer(cmd, testMeshes[2]->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	if (_occlusionCulling)
+	{
+		// Depth prepass of what was visible last frame, reduced into the pyramid
+		// the late phase culls against. Its survivors add their depth to the prepass.
+		VkRenderingInfo depthInfo = vkinit::rendering_info(_drawExtent, nullptr, &depthAttachment);
+		vkCmdBeginRendering(cmd, &depthInfo);
+		set_draw_viewport(cmd);
+		_indirectRenderer.draw_depth(cmd, viewProjection, IndirectRenderer::Phase::Early);
+		vkCmdEndRendering(cmd);
+
+		_depthPyramid.build(cmd);
+		_indirectRenderer.record_late_cull(cmd);
+
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		vkCmdBeginRendering(cmd, &depthInfo);
+		set_draw_viewport(cmd);
+		_indirectRenderer.draw_depth(cmd, viewProjection, IndirectRenderer::Phase::Late);
+		vkCmdEndRendering(cmd);
+
+		vkutil::BarrierBuilder()
+			.image(_depthImage.image, vkutil::scope::DepthAttachment, vkutil::scope::DepthAttachment, VK_IMAGE_ASPECT_DEPTH_BIT)
+			.flush(cmd);
+	}
 
-	vkCmdDrawIndexed(cmd, testMeshes[2]->surfaces[0].count, 1, testMeshes[2]->surfaces[0].startIndex, 0, 0);
+	// with the prepass the depth is complete and only the nearest surfaces pass the equal test
+	VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(_drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	VkRenderingInfo renderInfo = vkinit::rendering_info(_drawExtent, &colorAttachment, &depthAttachment);
+
+	vkCmdBeginRendering(cmd, &renderInfo);
+
+	set_draw_viewport(cmd);
+	_indirectRenderer.draw(cmd, viewProjection, IndirectRenderer::Phase::Early);
+	if (_occlusionCulling)
+	{
+		_indirectRenderer.draw(cmd, viewProjection, IndirectRenderer::Phase::Late);
+	}
+	draw_instances(cmd, viewProjection);
 
 	vkCmdEndRendering(cmd);
 }
 
+void
+VulkanEngine::draw_instances(VkCommandBuffer cmd, const glm::mat4& viewProjection)
+{
+	GPUInstancedDrawPushConstants push_constants;
+	push_constants.viewProjection = viewProjection;
+	push_constants.instanceBuffer = get_current_frame()._instanceBufferAddress;
+
+	// every batch is one push and one draw per surface, no matter how many instances it has
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	for (const InstanceBatch& batch : _instanceBatches)
+	{
+		const MeshAsset* mesh = batch.asset;
+		if (!mesh)
+		{
+			continue;
+		}
+
+		VkPipeline pipeline = mesh->meshBuffers.vertexFormat == VertexFormat::Packed ? _meshInstancedPackedPipeline : _meshInstancedPipeline;
+		if (boundPipeline != pipeline)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
+
+		push_constants.positionScale = mesh->meshBuffers.quantization.positionScale;
+		push_constants.positionOffset = mesh->meshBuffers.quantization.positionOffset;
+		push_constants.vertexBuffer = mesh->meshBuffers.vertexBufferAddress;
+		vkCmdPushConstants(cmd, _meshInstancedPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUInstancedDrawPushConstants), &push_constants);
+
+		if (boundIndexType != mesh->meshBuffers.indexType)
+		{
+			vkCmdBindIndexBuffer(cmd, _geometryPool.index_buffer(), 0, mesh->meshBuffers.indexType);
+			boundIndexType = mesh->meshBuffers.indexType;
+		}
+
+		// instances do not pick their own level, they all share the draw
+		for (const GeoSurface& surface : mesh->surfaces)
+		{
+			vkCmdDrawIndexed(cmd, surface.count, batch.instanceCount, mesh->meshBuffers.firstIndex + surface.startIndex, 0, batch.firstInstance);
+		}
+	}
+}
+
+void
+VulkanEngine::draw_instanced(MeshHandle mesh, std::span<const GPUInstanceData> instances)
+{
+	const size_t available = MAX_INSTANCES_PER_FRAME - _pendingInstances.size();
+	const uint32_t instanceCount = (uint32_t)std::min(instances.size(), available);
+	if (instanceCount < instances.size() && !_loggedInstanceOverflow)
+	{
+		m_logger->warn("More than {} instances in one frame, the rest are not drawn", MAX_INSTANCES_PER_FRAME);
+		_loggedInstanceOverflow = true;
+	}
+	if (instanceCount == 0)
+	{
+		return;
+	}
+
+	InstanceBatch& batch = _instanceBatches.emplace_back();
+	batch.mesh = mesh;
+	batch.asset = nullptr;
+	batch.firstInstance = (uint32_t)_pendingInstances.size();
+	batch.instanceCount = instanceCount;
+
+	_pendingInstances.insert(_pendingInstances.end(), instances.begin(), instances.begin() + instanceCount);
+}
+
+uint32_t
+VulkanEngine::select_lod(const GeoSurface& surface, const glm::mat4& modelView, float lodScale) const
+{
+	if (_forcedLod >= 0)
+	{
+		return std::min((uint32_t)_forcedLod, surface.lodCount - 1);
+	}
+
+	// the view is rigid, so the axes of modelView carry the scale of the node
+	float scale = std::max({ glm::length(glm::vec3(modelView[0])), glm::length(glm::vec3(modelView[1])),
+		glm::length(glm::vec3(modelView[2])) });
+	float radius = surface.bounds.w * scale;
+	float distance = glm::length(glm::vec3(modelView * glm::vec4(glm::vec3(surface.bounds), 1.f)));
+	if (distance <= radius)
+	{
+		// the camera is inside the bounds
+		return 0;
+	}
+
+	// The error of a level is relative to the bounding radius, so on screen it scales with
+	// the projected radius of the bounding sphere
+	float projectedRadius = radius * lodScale / distance;
+	uint32_t lod = surface.lodCount - 1;
+	while (lod > 0 && surface.lods[lod].error * projectedRadius > _lodErrorThreshold)
+	{
+		lod--;
+	}
+	return lod;
+}
+
 
 void
 VulkanEngine::run()
@@ -427,6 +865,171 @@ VulkanEngine::run()
 		}
         ImGui::End();
 
+        if (ImGui::Begin("uploads"))
+        {
+			StagingRing::Stats stagingStats = _stagingRing.stats();
+
+			ImGui::Text("Staging ring: %.2f / %.2f MB (%.1f%%)", stagingStats.used / (1024.0 * 1024.0),
+				stagingStats.capacity / (1024.0 * 1024.0), 100.0 * stagingStats.used / stagingStats.capacity);
+			ImGui::Text("Peak: %.2f MB", stagingStats.peakUsed / (1024.0 * 1024.0));
+			ImGui::Text("Allocations: %llu", (unsigned long long)stagingStats.allocations);
+			ImGui::Text("Stalls: %llu", (unsigned long long)stagingStats.stalls);
+			ImGui::Text("Oversized fallbacks: %llu", (unsigned long long)stagingStats.fallbacks);
+
+			GeometryPool::Stats poolStats = _geometryPool.stats();
+			ImGui::Text("Vertex pool: %.2f / %.2f MB, %u meshes", poolStats.vertexUsed / (1024.0 * 1024.0),
+				poolStats.vertexCapacity / (1024.0 * 1024.0), poolStats.vertexRanges);
+			ImGui::Text("Index pool: %.2f / %.2f MB", poolStats.indexUsed / (1024.0 * 1024.0),
+				poolStats.indexCapacity / (1024.0 * 1024.0));
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("lod"))
+        {
+			ImGui::SliderFloat("Error threshold (px)", &_lodErrorThreshold, 0.1f, 16.f);
+			ImGui::SliderInt("Forced level (-1 = auto)", &_forcedLod, -1, MAX_MESH_LODS - 1);
+			for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++)
+			{
+				ImGui::Text("LOD %u: %u triangles", lod, _lodTriangles[lod]);
+			}
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("gpu driven"))
+        {
+			ImGui::Checkbox("GPU driven draws", &_gpuDriven);
+			ImGui::TextUnformatted("Meshlet culling only applies to CPU recorded draws");
+
+			IndirectRenderer::Stats indirectStats = _indirectRenderer.stats();
+			ImGui::Text("Objects: %u / %u visible", indirectStats.visibleObjects, indirectStats.objects);
+			ImGui::Checkbox("Occlusion culling", &_occlusionCulling);
+			ImGui::Text("Late phase: %u drawn, %u occluded", indirectStats.lateObjects, indirectStats.occludedObjects);
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("render graph"))
+        {
+			RenderGraph::Stats graphStats = _renderGraph.stats();
+			ImGui::Text("Passes: %u, %u culled", graphStats.passes, graphStats.culledPasses);
+			for (const std::string& pass : _renderGraph.culled_passes())
+			{
+				ImGui::BulletText("%s", pass.c_str());
+			}
+			ImGui::Text("Barrier batches: %u", graphStats.barrierBatches);
+			ImGui::Text("Image barriers: %u  Buffer barriers: %u", graphStats.imageBarriers, graphStats.bufferBarriers);
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("recording"))
+        {
+			ImGui::Checkbox("Record draws on worker threads", &_parallelRecording);
+			ImGui::TextUnformatted("Applies to the CPU recorded draws");
+			ImGui::Text("Draws: %u on %u threads", _recordingStats.draws, _recordingStats.threads);
+			ImGui::Text("Sorting: %.3f ms  Recording: %.3f ms", _recordingStats.sortMs, _recordingStats.recordMs);
+			const BindStats& binds = _recordingStats.binds;
+			ImGui::Text("Pipeline binds: %u, %u elided", binds.issued.pipelines, binds.elided.pipelines);
+			ImGui::Text("Index buffer binds: %u, %u elided", binds.issued.indexBuffers, binds.elided.indexBuffers);
+			ImGui::Text("Descriptor set binds: %u, %u elided", binds.issued.descriptorSets, binds.elided.descriptorSets);
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("instancing"))
+        {
+			bool fieldChanged = ImGui::SliderInt("Field size", &_instanceFieldSize, 0, 256);
+			fieldChanged |= ImGui::SliderFloat("Spacing", &_instanceFieldSpacing, 0.1f, 20.f);
+			ImGui::Text("Instances: %u", (uint32_t)_instanceField.size());
+
+			// Copies of the first mesh on a grid, tinted by position
+			if (fieldChanged)
+			{
+				_instanceField.clear();
+				for (int z = 0; z < _instanceFieldSize; z++)
+				{
+					for (int x = 0; x < _instanceFieldSize; x++)
+					{
+						glm::vec3 position = glm::vec3(x - _instanceFieldSize / 2, 0.f, z - _instanceFieldSize / 2) * _instanceFieldSpacing;
+						float u = _instanceFieldSize > 1 ? (float)x / (_instanceFieldSize - 1) : 1.f;
+						float v = _instanceFieldSize > 1 ? (float)z / (_instanceFieldSize - 1) : 1.f;
+
+						GPUInstanceData& instance = _instanceField.emplace_back();
+						instance.worldMatrix = glm::translate(position);
+						instance.color = glm::vec4(u, v, 1.f - u * v, 1.f);
+					}
+				}
+			}
+		}
+        ImGui::End();
+
+		if (!_instanceField.empty() && !testMeshes.empty())
+		{
+			draw_instanced(testMeshes[0], _instanceField);
+		}
+
+        if (ImGui::Begin("clusters"))
+        {
+			ImGui::Checkbox("Cull meshlets on the GPU", &_clusterCulling);
+
+			ClusterCuller::Stats clusterStats = _clusterCuller.stats();
+			ImGui::Text("Surfaces: %u", clusterStats.surfaces);
+			ImGui::Text("Meshlets: %u / %u visible", clusterStats.visibleMeshlets, clusterStats.meshlets);
+			ImGui::Text("Triangles: %llu / %llu visible", (unsigned long long)clusterStats.visibleTriangles,
+				(unsigned long long)clusterStats.triangles);
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("scene"))
+        {
+			SceneGraph::Stats sceneStats = _scene.stats();
+			ImGui::Text("Nodes: %u, %u with meshes", sceneStats.nodes, sceneStats.meshNodes);
+			ImGui::Text("Transforms updated last frame: %u", sceneStats.updatedNodes);
+
+			if (_scene.size() > 0)
+			{
+				ImGui::SliderInt("Node", &_selectedNode, 0, (int)_scene.size() - 1);
+				uint32_t node = (uint32_t)std::clamp(_selectedNode, 0, (int)_scene.size() - 1);
+				ImGui::Text("Name: %s", _scene.name(node).c_str());
+
+				glm::vec3 translation = _scene.translation(node);
+				if (ImGui::InputFloat3("Translation", &translation.x))
+				{
+					_scene.set_translation(node, translation);
+				}
+				glm::vec3 rotation = glm::degrees(glm::eulerAngles(_scene.rotation(node)));
+				if (ImGui::InputFloat3("Rotation", &rotation.x))
+				{
+					_scene.set_rotation(node, glm::quat(glm::radians(rotation)));
+				}
+				glm::vec3 scale = _scene.scale(node);
+				if (ImGui::InputFloat3("Scale", &scale.x))
+				{
+					_scene.set_scale(node, scale);
+				}
+			}
+		}
+        ImGui::End();
+
+        if (ImGui::Begin("residency"))
+        {
+			MeshResidency::Stats residencyStats = _meshResidency.stats();
+
+			ImGui::Text("Resident: %u / %u meshes, %u uploading", residencyStats.resident, residencyStats.registered,
+				residencyStats.uploading);
+			ImGui::Text("Memory: %.2f / %.2f MB", residencyStats.residentBytes / (1024.0 * 1024.0),
+				residencyStats.budgetBytes / (1024.0 * 1024.0));
+			ImGui::Text("Hits: %llu  Misses: %llu", (unsigned long long)residencyStats.hits,
+				(unsigned long long)residencyStats.misses);
+			ImGui::Text("Uploads: %llu  Failed: %llu", (unsigned long long)residencyStats.uploads,
+				(unsigned long long)residencyStats.failedUploads);
+			ImGui::Text("Evictions: %llu  Too large: %u", (unsigned long long)residencyStats.evictions,
+				residencyStats.tooLarge);
+
+			if (ImGui::SliderInt("Budget cap (MB, 0 = none)", &_residencyBudgetMB, 0, 256))
+			{
+				_meshResidency.set_budget_override((VkDeviceSize)_residencyBudgetMB * 1024 * 1024);
+			}
+		}
+        ImGui::End();
+
         //make imgui calculate internal draw structures
         ImGui::Render();
 
@@ -507,6 +1110,23 @@ VulkanEngine::init_vulkan()
 	VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.timelineSemaphore = true;
+	features12.drawIndirectCount = true;
+	features12.samplerFilterMinmax = true;
+	// bindless table
+	features12.runtimeDescriptorArray = true;
+	features12.descriptorBindingPartiallyBound = true;
+	features12.descriptorBindingUpdateUnusedWhilePending = true;
+	features12.descriptorBindingSampledImageUpdateAfterBind = true;
+	features12.descriptorBindingStorageImageUpdateAfterBind = true;
+
+	// GPU driven draws put many draws in one indirect call and find their object through the instance index
+	VkPhysicalDeviceFeatures features10{};
+	features10.multiDrawIndirect = true;
+	features10.drawIndirectFirstInstance = true;
+	// the bindless table is indexed with slots from push constants
+	features10.shaderSampledImageArrayDynamicIndexing = true;
+	features10.shaderStorageImageArrayDynamicIndexing = true;
 
 	//use vkbootstrap to select a gpu. 
 	//We want a gpu that can write to the SDL surface and supports vulkan 1.3 with the correct features
@@ -515,7 +1135,10 @@ VulkanEngine::init_vulkan()
 		.set_minimum_version(1, 3)
 		.set_required_features_13(features)
 		.set_required_features_12(features12)
+		.set_required_features(features10)
 		.set_surface(_surface)
+		// lets VMA report real heap budgets for mesh residency
+		.add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
 		.select();
 
     if (!physicalDevice_ret.has_value())
@@ -525,8 +1148,15 @@ VulkanEngine::init_vulkan()
         return false;
     }
 
+	// BC formats are optional, imported textures fall back to RGBA8 without them
+	vkb::PhysicalDevice physicalDevice = physicalDevice_ret.value();
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice.physical_device, &supportedFeatures);
+	_textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+	physicalDevice.features.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
 	//create the final vulkan device
-	vkb::DeviceBuilder deviceBuilder{ physicalDevice_ret.value() };
+	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 
 	vkb::Result<vkb::Device> vkbDevice_ret = deviceBuilder.build();
     if (!vkbDevice_ret.has_value())
@@ -539,6 +1169,7 @@ VulkanEngine::init_vulkan()
 	// Get the VkDevice handle used in the rest of a vulkan application
 	_device = vkbDevice_ret.value().device;
 	_chosenGPU = physicalDevice_ret.value().physical_device;
+	bool hasMemoryBudget = physicalDevice_ret.value().is_extension_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
     {
         // Output some info on what GPU was chosen
@@ -554,12 +1185,36 @@ VulkanEngine::init_vulkan()
 	_graphicsQueueFamily = vkbDevice_ret.value().get_queue_index(vkb::QueueType::graphics).value();
     m_logger->debug("Using GPU queue family: {}", _graphicsQueueFamily);
 
+    // Uploads run on a dedicated transfer queue when the GPU has one, otherwise on
+    // any other transfer capable family, and on the graphics queue as a last resort
+    if (auto dedicatedIndex = vkbDevice_ret.value().get_dedicated_queue_index(vkb::QueueType::transfer); dedicatedIndex)
+    {
+        _transferQueue = vkbDevice_ret.value().get_dedicated_queue(vkb::QueueType::transfer).value();
+        _transferQueueFamily = dedicatedIndex.value();
+    }
+    else if (auto separateIndex = vkbDevice_ret.value().get_queue_index(vkb::QueueType::transfer); separateIndex)
+    {
+        _transferQueue = vkbDevice_ret.value().get_queue(vkb::QueueType::transfer).value();
+        _transferQueueFamily = separateIndex.value();
+    }
+    else
+    {
+        _transferQueue = _graphicsQueue;
+        _transferQueueFamily = _graphicsQueueFamily;
+    }
+    m_logger->debug("Using transfer queue family: {}", _transferQueueFamily);
+
     // initialize the memory allocator
     VmaAllocatorCreateInfo allocatorInfo = {};
     allocatorInfo.physicalDevice = _chosenGPU;
     allocatorInfo.device = _device;
     allocatorInfo.instance = _instance;
     allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    if (hasMemoryBudget)
+    {
+        // without it VMA estimates the budget as a fraction of the heap size
+        allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     vmaCreateAllocator(&allocatorInfo, &_allocator);
 
     _mainDeletionQueue.push_function([&]() {
@@ -616,6 +1271,8 @@ VulkanEngine::init_swapchain()
 	_depthImage.imageExtent = drawImageExtent;
 	VkImageUsageFlags depthImageUsages{};
 	depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	// reduced into the depth pyramid
+	depthImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
 	VkImageCreateInfo dimg_info = vkinit::image_create_info(_depthImage.imageFormat, depthImageUsages, drawImageExtent);
 
@@ -654,6 +1311,20 @@ VulkanEngine::init_commands()
 		VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(_frames[i]._commandPool, 1);
 
 		VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo, &_frames[i]._mainCommandBuffer));
+
+		// The recording pools are reset as a whole every frame, their buffers are never reset one by one
+		const uint32_t recordingThreads = std::min<uint32_t>((uint32_t)_workerPool.size() + 1, MAX_RECORDING_THREADS);
+		VkCommandPoolCreateInfo recordingPoolInfo = vkinit::command_pool_create_info(_graphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		_frames[i]._recordingCommandPools.resize(recordingThreads);
+		_frames[i]._recordingCommandBuffers.resize(recordingThreads);
+		for (uint32_t thread = 0; thread < recordingThreads; thread++)
+		{
+			VK_CHECK(vkCreateCommandPool(_device, &recordingPoolInfo, nullptr, &_frames[i]._recordingCommandPools[thread]));
+
+			VkCommandBufferAllocateInfo secondaryAllocInfo = vkinit::command_buffer_allocate_info(
+				_frames[i]._recordingCommandPools[thread], 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			VK_CHECK(vkAllocateCommandBuffers(_device, &secondaryAllocInfo, &_frames[i]._recordingCommandBuffers[thread]));
+		}
 	}
 
     // Immediate GPU submit
@@ -667,6 +1338,42 @@ VulkanEngine::init_commands()
 	_mainDeletionQueue.push_function([this]() { 
 	    vkDestroyCommandPool(_device, _immCommandPool, nullptr);
 	});
+
+	// Async uploads on the transfer queue, they are submitted from worker threads
+	// so a queue shared with the render loop needs its lock
+	_uploader.init(_device, _transferQueue, _transferQueueFamily, _graphicsQueueFamily,
+		_transferQueue == _graphicsQueue ? &_graphicsQueueMutex : nullptr);
+
+	_mainDeletionQueue.push_function([this]() {
+		_uploader.cleanup();
+	});
+
+	// Staging memory shared by all uploads
+	_stagingRing.init(this, STAGING_RING_SIZE);
+
+	_mainDeletionQueue.push_function([this]() {
+		StagingRing::Stats stagingStats = _stagingRing.stats();
+		m_logger->info("Staging ring usage: peak {} of {} bytes, {} allocations, {} stalls, {} fallbacks",
+			stagingStats.peakUsed, stagingStats.capacity, stagingStats.allocations, stagingStats.stalls, stagingStats.fallbacks);
+		_stagingRing.cleanup();
+	});
+
+	// Vertex and index buffers shared by all meshes
+	_geometryPool.init(this, GEOMETRY_POOL_VERTEX_SIZE, GEOMETRY_POOL_INDEX_SIZE);
+
+	_mainDeletionQueue.push_function([this]() {
+		_geometryPool.cleanup();
+	});
+
+	_meshResidency.init(this);
+
+	_mainDeletionQueue.push_function([this]() {
+		MeshResidency::Stats residencyStats = _meshResidency.stats();
+		m_logger->info("Mesh residency: {} hits, {} misses, {} uploads, {} failed uploads, {} evictions",
+			residencyStats.hits, residencyStats.misses, residencyStats.uploads, residencyStats.failedUploads,
+			residencyStats.evictions);
+		_meshResidency.cleanup();
+	});
 }
 
 void
@@ -690,49 +1397,72 @@ VulkanEngine::init_sync_structures()
 	_mainDeletionQueue.push_function([this]() { vkDestroyFence(_device, _immFence, nullptr); });
 }
 
-void
+bool
 VulkanEngine::init_descriptors()
 {
-	//create a descriptor pool that will hold 10 sets with 1 image each
-	std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
+	// One table of every image and sampler, bound once per pipeline instead of a set per use
+	if (!_bindless.init(this))
 	{
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
-	};
+		return false;
+	}
 
-	globalDescriptorAllocator.init_pool(_device, 10, sizes);
+	_mainDeletionQueue.push_function([this]() {
+		_bindless.cleanup();
+	});
 
-	//make the descriptor set layout for our compute draw
+	// the background compute effects write the draw image
+	if (std::optional<uint32_t> slot = _bindless.add_storage_image(_drawImage.imageView); slot)
 	{
-		DescriptorLayoutBuilder builder;
-		builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-		_drawImageDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+		_drawImageSlot = *slot;
+	}
+	else
+	{
+		return false;
 	}
 
-    //allocate a descriptor set for our draw image
-	_drawImageDescriptors = globalDescriptorAllocator.allocate(_device,_drawImageDescriptorLayout);	
+	VkSamplerCreateInfo samplerInfo { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK(vkCreateSampler(_device, &samplerInfo, nullptr, &_defaultSamplerLinear));
 
-	VkDescriptorImageInfo imgInfo{};
-	imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-	imgInfo.imageView = _drawImage.imageView;
-	
-	VkWriteDescriptorSet drawImageWrite = {};
-	drawImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	drawImageWrite.pNext = nullptr;
-	
-	drawImageWrite.dstBinding = 0;
-	drawImageWrite.dstSet = _drawImageDescriptors;
-	drawImageWrite.descriptorCount = 1;
-	drawImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-	drawImageWrite.pImageInfo = &imgInfo;
+	_mainDeletionQueue.push_function([this]() {
+		vkDestroySampler(_device, _defaultSamplerLinear, nullptr);
+	});
 
-	vkUpdateDescriptorSets(_device, 1, &drawImageWrite, 0, nullptr);
+	if (std::optional<uint32_t> slot = _bindless.add_sampler(_defaultSamplerLinear); slot)
+	{
+		_defaultSamplerSlot = *slot;
+	}
+	else
+	{
+		return false;
+	}
 
-	//make sure both the descriptor allocator and the new layout get cleaned up properly
-	_mainDeletionQueue.push_function([&]() {
-		globalDescriptorAllocator.destroy_pool(_device);
+	// Per frame sets. Nothing allocates them yet, the first pool is only created when a
+	// frame asks for a set and starts small, the chain grows when a frame needs more
+	std::vector<DescriptorAllocator::PoolSizeRatio> frameSizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+	};
 
-		vkDestroyDescriptorSetLayout(_device, _drawImageDescriptorLayout, nullptr);
+	for (int i = 0; i < FRAME_OVERLAP; i++)
+	{
+		_frames[i]._frameDescriptors.init(16, frameSizes);
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		for (int i = 0; i < FRAME_OVERLAP; i++)
+		{
+			_frames[i]._frameDescriptors.destroy_pools(_device);
+		}
 	});
+
+	return true;
 }
 
 void
@@ -833,10 +1563,15 @@ VulkanEngine::init_default_data()
 
 	std::string assetBasicMeshPath = ASSETS_PATH;
     assetBasicMeshPath += "basicmesh.glb";
-	if (auto ret = loadGltfMeshes(this, assetBasicMeshPath); ret)
+	MeshLoadOptions meshOptions;
+	meshOptions.vertexFormat = VertexFormat::Packed;
+	// Meshes are only uploaded once they are drawn
+	if (auto ret = loadGltfMeshData(this, assetBasicMeshPath, meshOptions); ret)
 	{
-		// Success
-		testMeshes = ret.value();
+		for (MeshData& mesh : ret.value())
+		{
+			testMeshes.push_back(_meshResidency.register_mesh(std::move(mesh)));
+		}
 	}
 	else
 	{
@@ -844,6 +1579,54 @@ VulkanEngine::init_default_data()
 		return false;
 	}
 
+	if (auto ret = loadGltfScene(assetBasicMeshPath); ret)
+	{
+		_scene = std::move(ret.value());
+	}
+	else
+	{
+		m_logger->error("Failed to load the scene from: {}", assetBasicMeshPath);
+		return false;
+	}
+
+	// Not sampled by any pipeline yet, loaded into the bindless table so they are ready once materials are
+	if (auto ret = loadGltfTextures(this, assetBasicMeshPath); ret)
+	{
+		_textures = std::move(ret.value());
+	}
+	else
+	{
+		m_logger->error("Failed to load textures from: {}", assetBasicMeshPath);
+		return false;
+	}
+
+	for (const std::shared_ptr<TextureAsset>& texture : _textures)
+	{
+		if (texture)
+		{
+			texture->bindlessSlot = _bindless.add_sampled_image(texture->image.imageView);
+		}
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		for (const std::shared_ptr<TextureAsset>& texture : _textures)
+		{
+			if (!texture)
+			{
+				continue;
+			}
+
+			// the device is idle at shutdown, a texture unloaded while frames are
+			// in flight would have to outlive them like its slot does
+			if (texture->bindlessSlot)
+			{
+				_bindless.release(BindlessTable::Binding::SampledImages, *texture->bindlessSlot);
+			}
+			destroy_image(texture->image);
+		}
+		_textures.clear();
+	});
+
 	return true;
 }
 
@@ -922,6 +1705,46 @@ VulkanEngine::init_pipelines()
 		return false;
 	}
 
+	if(!init_packed_mesh_pipeline())
+	{
+		return false;
+	}
+
+	if(!init_instanced_mesh_pipelines())
+	{
+		return false;
+	}
+
+	// Meshlet culling compute pass and its per frame buffers
+	if (!_clusterCuller.init(this))
+	{
+		return false;
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		_clusterCuller.cleanup();
+	});
+
+	// Hi-Z reduction of the depth prepass, the culling pass reads it
+	if (!_depthPyramid.init(this))
+	{
+		return false;
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		_depthPyramid.cleanup();
+	});
+
+	// Object culling compute pass and the indirect mesh pipelines
+	if (!_indirectRenderer.init(this))
+	{
+		return false;
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		_indirectRenderer.cleanup();
+	});
+
 	return true;
 }
 
@@ -931,7 +1754,8 @@ VulkanEngine::init_background_pipelines()
 	VkPipelineLayoutCreateInfo computeLayout{};
 	computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	computeLayout.pNext = nullptr;
-	computeLayout.pSetLayouts = &_drawImageDescriptorLayout;
+	VkDescriptorSetLayout bindlessLayout = _bindless.layout();
+	computeLayout.pSetLayouts = &bindlessLayout;
 	computeLayout.setLayoutCount = 1;
 
     VkPushConstantRange pushConstant{};
@@ -1168,6 +1992,173 @@ bool VulkanEngine::init_mesh_pipeline()
 	return true;
 }
 
+bool VulkanEngine::init_packed_mesh_pipeline()
+{
+	std::string shaderTriangleFragPath = SHADERS_PATH;
+    shaderTriangleFragPath += "coloured_triangle.frag.spv";
+	VkShaderModule triangleFragShader;
+	if (!vkutil::load_shader_module(shaderTriangleFragPath.c_str(), _device, &triangleFragShader))
+	{
+		m_logger->error("Error when building the triangle frag shader: [{}]", shaderTriangleFragPath);
+        return false;
+	}
+
+	// Same as the mesh pipeline, only the vertex shader decodes PackedVertex instead
+	std::string shaderPackedVertexPath = SHADERS_PATH;
+    shaderPackedVertexPath += "coloured_triangle_mesh_packed.vert.spv";
+	VkShaderModule packedVertexShader;
+	if (!vkutil::load_shader_module(shaderPackedVertexPath.c_str(), _device, &packedVertexShader))
+	{
+		m_logger->error("Error when building the packed mesh vertex shader: [{}]", shaderPackedVertexPath);
+        return false;
+	}
+
+	VkPushConstantRange bufferRange{};
+	bufferRange.offset = 0;
+	bufferRange.size = sizeof(GPUPackedDrawPushConstants);
+	bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = vkinit::pipeline_layout_create_info();
+	pipeline_layout_info.pPushConstantRanges = &bufferRange;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr, &_meshPackedPipelineLayout));
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder._pipelineLayout = _meshPackedPipelineLayout;
+	pipelineBuilder.set_shaders(packedVertexShader, triangleFragShader);
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.enable_blending_additive();
+	pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	pipelineBuilder.set_color_attachment_format(_drawImage.imageFormat);
+	pipelineBuilder.set_depth_format(_depthImage.imageFormat);
+
+	_meshPackedPipeline = pipelineBuilder.build_pipeline(_device);
+
+	//clean structures
+	vkDestroyShaderModule(_device, triangleFragShader, nullptr);
+	vkDestroyShaderModule(_device, packedVertexShader, nullptr);
+
+	_mainDeletionQueue.push_function([&]() {
+		vkDestroyPipelineLayout(_device, _meshPackedPipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _meshPackedPipeline, nullptr);
+	});
+
+	if (_meshPackedPipeline == VK_NULL_HANDLE)
+	{
+		m_logger->error("Failed to init packed mesh graphics pipeline");
+		return false;
+	}
+
+	m_logger->info("Successfully built packed mesh graphics pipeline");
+	return true;
+}
+
+bool VulkanEngine::init_instanced_mesh_pipelines()
+{
+	std::string shaderTriangleFragPath = SHADERS_PATH;
+    shaderTriangleFragPath += "coloured_triangle.frag.spv";
+	VkShaderModule triangleFragShader;
+	if (!vkutil::load_shader_module(shaderTriangleFragPath.c_str(), _device, &triangleFragShader))
+	{
+		m_logger->error("Error when building the triangle frag shader: [{}]", shaderTriangleFragPath);
+        return false;
+	}
+
+	std::string shaderInstancedVertexPath = SHADERS_PATH;
+    shaderInstancedVertexPath += "mesh_instanced.vert.spv";
+	VkShaderModule instancedVertexShader;
+	if (!vkutil::load_shader_module(shaderInstancedVertexPath.c_str(), _device, &instancedVertexShader))
+	{
+		m_logger->error("Error when building the instanced mesh vertex shader: [{}]", shaderInstancedVertexPath);
+		vkDestroyShaderModule(_device, triangleFragShader, nullptr);
+        return false;
+	}
+
+	std::string shaderInstancedPackedVertexPath = SHADERS_PATH;
+    shaderInstancedPackedVertexPath += "mesh_instanced_packed.vert.spv";
+	VkShaderModule instancedPackedVertexShader;
+	if (!vkutil::load_shader_module(shaderInstancedPackedVertexPath.c_str(), _device, &instancedPackedVertexShader))
+	{
+		m_logger->error("Error when building the instanced packed mesh vertex shader: [{}]", shaderInstancedPackedVertexPath);
+		vkDestroyShaderModule(_device, triangleFragShader, nullptr);
+		vkDestroyShaderModule(_device, instancedVertexShader, nullptr);
+        return false;
+	}
+
+	VkPushConstantRange bufferRange{};
+	bufferRange.offset = 0;
+	bufferRange.size = sizeof(GPUInstancedDrawPushConstants);
+	bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = vkinit::pipeline_layout_create_info();
+	pipeline_layout_info.pPushConstantRanges = &bufferRange;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr, &_meshInstancedPipelineLayout));
+
+	// Same state as the mesh pipelines, the vertex shaders read the world matrix per instance
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder._pipelineLayout = _meshInstancedPipelineLayout;
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.enable_blending_additive();
+	pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	pipelineBuilder.set_color_attachment_format(_drawImage.imageFormat);
+	pipelineBuilder.set_depth_format(_depthImage.imageFormat);
+
+	pipelineBuilder.set_shaders(instancedVertexShader, triangleFragShader);
+	_meshInstancedPipeline = pipelineBuilder.build_pipeline(_device);
+
+	pipelineBuilder.set_shaders(instancedPackedVertexShader, triangleFragShader);
+	_meshInstancedPackedPipeline = pipelineBuilder.build_pipeline(_device);
+
+	//clean structures
+	vkDestroyShaderModule(_device, triangleFragShader, nullptr);
+	vkDestroyShaderModule(_device, instancedVertexShader, nullptr);
+	vkDestroyShaderModule(_device, instancedPackedVertexShader, nullptr);
+
+	_mainDeletionQueue.push_function([&]() {
+		vkDestroyPipelineLayout(_device, _meshInstancedPipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _meshInstancedPipeline, nullptr);
+		vkDestroyPipeline(_device, _meshInstancedPackedPipeline, nullptr);
+	});
+
+	if (_meshInstancedPipeline == VK_NULL_HANDLE || _meshInstancedPackedPipeline == VK_NULL_HANDLE)
+	{
+		m_logger->error("Failed to init instanced mesh graphics pipelines");
+		return false;
+	}
+
+	m_logger->info("Successfully built instanced mesh graphics pipelines");
+	return true;
+}
+
+void
+VulkanEngine::init_instance_buffers()
+{
+	for (int i = 0; i < FRAME_OVERLAP; i++)
+	{
+		_frames[i]._instanceBuffer = create_buffer(MAX_INSTANCES_PER_FRAME * sizeof(GPUInstanceData),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = _frames[i]._instanceBuffer.buffer };
+		_frames[i]._instanceBufferAddress = vkGetBufferDeviceAddress(_device, &deviceAdressInfo);
+	}
+
+	_mainDeletionQueue.push_function([this]() {
+		for (int i = 0; i < FRAME_OVERLAP; i++)
+		{
+			destroy_buffer(_frames[i]._instanceBuffer);
+		}
+	});
+}
+
 void
 VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
 {
@@ -1189,7 +2180,10 @@ VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& functi
 
 	// submit command buffer to the queue and execute it.
 	//  _immFence will now block until the graphic commands finish execution
-	VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, _immFence));
+	{
+		std::lock_guard<std::mutex> queueLock(_graphicsQueueMutex);
+		VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, _immFence));
+	}
 
 	VK_CHECK(vkWaitForFences(_device, 1, &_immFence, true, 9999999999));
 }
@@ -1222,53 +2216,49 @@ VulkanEngine::destroy_buffer(const AllocatedBuffer& buffer)
     vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
 }
 
-GPUMeshBuffers
-VulkanEngine::uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
+AllocatedImage
+VulkanEngine::create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
 {
-	const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-	const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
-
-	GPUMeshBuffers newSurface;
+	AllocatedImage newImage;
+	newImage.imageFormat = format;
+	newImage.imageExtent = size;
+	newImage.mipLevels = mipmapped ? vkutil::mip_level_count(VkExtent2D { size.width, size.height }) : 1;
 
-	//create vertex buffer
-	newSurface.vertexBuffer = create_buffer(vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+	VkImageCreateInfo img_info = vkinit::image_create_info(format, usage, size);
+	img_info.mipLevels = newImage.mipLevels;
 
-	//find the address of the vertex buffer
-	VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.vertexBuffer.buffer };
-	newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(_device, &deviceAdressInfo);
+	// always allocate images on dedicated GPU memory
+	VmaAllocationCreateInfo allocinfo = {};
+	allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocinfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	//create index buffer
-	newSurface.indexBuffer = create_buffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+	VK_CHECK(vmaCreateImage(_allocator, &img_info, &allocinfo, &newImage.image, &newImage.allocation, nullptr));
 
-	// Make transfer buffer to load memory into GPU
-	AllocatedBuffer staging = create_buffer(vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+	// if the format is a depth format, we will need to have it use the correct aspect flag
+	VkImageAspectFlags aspectFlag = format == VK_FORMAT_D32_SFLOAT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 
-	void* data = staging.allocation->GetMappedData();
+	VkImageViewCreateInfo view_info = vkinit::imageview_create_info(format, newImage.image, aspectFlag);
+	view_info.subresourceRange.levelCount = newImage.mipLevels;
 
-	// copy vertex buffer
-	memcpy(data, vertices.data(), vertexBufferSize);
-	// copy index buffer
-	memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
+	VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &newImage.imageView));
 
-	immediate_submit([&](VkCommandBuffer cmd) {
-		VkBufferCopy vertexCopy{ 0 };
-		vertexCopy.dstOffset = 0;
-		vertexCopy.srcOffset = 0;
-		vertexCopy.size = vertexBufferSize;
-
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+	return newImage;
+}
 
-		VkBufferCopy indexCopy{ 0 };
-		indexCopy.dstOffset = 0;
-		indexCopy.srcOffset = vertexBufferSize;
-		indexCopy.size = indexBufferSize;
+void
+VulkanEngine::destroy_image(const AllocatedImage& image)
+{
+	vkDestroyImageView(_device, image.imageView, nullptr);
+	vmaDestroyImage(_allocator, image.image, image.allocation);
+}
 
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-	});
+std::optional<GPUMeshBuffers>
+VulkanEngine::uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices)
+{
+	MeshUploadBatch batch(this);
 
-	destroy_buffer(staging);
+	std::optional<GPUMeshBuffers> newSurface = batch.add(indices, vertices);
+	batch.flush();
 
 	return newSurface;
 }
@@ -2,8 +2,18 @@
 
 #include <vk_types.h>
 #include <deletion_queue.h>
+#include <thread_pool.h>
+#include <vk_bindless.h>
+#include <vk_cluster_cull.h>
+#include <vk_depth_pyramid.h>
 #include <vk_descriptors.h>
+#include <vk_draw_list.h>
+#include <vk_geometry_pool.h>
+#include <vk_indirect.h>
 #include <vk_loader.h>
+#include <vk_mesh_residency.h>
+#include <vk_render_graph.h>
+#include <vk_upload.h>
 
 struct FrameData
 {
@@ -13,6 +23,17 @@ struct FrameData
     VkSemaphore _swapchainSemaphore;
 	VkFence _renderFence;
 	DeletionQueue _deletionQueue;
+	// Descriptor sets that only live for this frame, all freed at once after its fence
+	DescriptorAllocator _frameDescriptors;
+
+	// One pool and secondary command buffer per chunk of draws recorded in parallel,
+	// each pool is only used by the thread recording its chunk
+	std::vector<VkCommandPool> _recordingCommandPools;
+	std::vector<VkCommandBuffer> _recordingCommandBuffers;
+
+	// Instances of this frame's instanced draws, persistently mapped
+	AllocatedBuffer _instanceBuffer;
+	VkDeviceAddress _instanceBufferAddress;
 };
 
 struct ComputePushConstants
@@ -21,6 +42,8 @@ struct ComputePushConstants
 	glm::vec4 data2;
 	glm::vec4 data3;
 	glm::vec4 data4;
+	// bindless slot of the image to write, set by draw_background()
+	uint32_t drawImage;
 };
 
 struct ComputeEffect
@@ -37,6 +60,48 @@ struct ComputeEffect
 // while the GPU is rendering the current frame
 constexpr unsigned int FRAME_OVERLAP = 2;
 
+// Size of the persistently mapped staging ring used for uploads
+constexpr VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+
+// Sizes of the shared vertex and index buffers every mesh is suballocated from
+constexpr VkDeviceSize GEOMETRY_POOL_VERTEX_SIZE = 256 * 1024 * 1024;
+constexpr VkDeviceSize GEOMETRY_POOL_INDEX_SIZE = 64 * 1024 * 1024;
+
+// Most threads recording draws of one frame in parallel
+constexpr uint32_t MAX_RECORDING_THREADS = 16;
+// Fewest draws worth handing to another recording thread
+constexpr uint32_t PARALLEL_RECORDING_MIN_DRAWS = 256;
+
+// Instances one frame can draw with draw_instanced(), the rest are dropped
+constexpr uint32_t MAX_INSTANCES_PER_FRAME = 64 * 1024;
+
+// Instances of one mesh submitted with draw_instanced(), drawn with one draw per surface
+struct InstanceBatch
+{
+	MeshHandle mesh;
+	// null while the mesh is not resident
+	const MeshAsset* asset;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// Passes of the CPU path's draw list, the most significant field of its sort keys
+enum class DrawPass : uint32_t
+{
+	Opaque,
+};
+
+// A surface drawn this frame at the level picked for it
+struct GeometryDraw
+{
+	const MeshAsset* mesh;
+	const GeoLod* lod;
+	// world matrix of the scene node drawing the surface
+	const glm::mat4* worldMatrix;
+	// set when the meshlets of the surface were culled, it is drawn from the culler's index buffer
+	std::optional<uint32_t> clusterDraw;
+};
+
 class VulkanEngine
 {
 public:
@@ -50,6 +115,9 @@ public:
 
 	bool loggedOnce {true};
 
+	// Worker threads for CPU side work such as asset decoding
+	ThreadPool _workerPool;
+
     // SDL objects for window creation
 	struct SDL_Window* _window{ nullptr };
 
@@ -59,6 +127,7 @@ public:
 	VkPhysicalDevice _chosenGPU;// GPU chosen as the default device
 	VkDevice _device; // Vulkan device for commands
 	VkSurfaceKHR _surface;// Vulkan window surface
+	bool _textureCompressionBC {false}; // device can sample VK_FORMAT_BC* images
 
     // Swapchain objects for displaying the final image in the window
     // NOTE: Swapchain needs to be recreated if window size changes
@@ -76,20 +145,36 @@ public:
 
 	VkQueue _graphicsQueue;
 	uint32_t _graphicsQueueFamily;
+	// Uploads can submit to the graphics queue from worker threads
+	std::mutex _graphicsQueueMutex;
+
+	// Transfer queue used for async uploads, may be the graphics queue
+	VkQueue _transferQueue;
+	uint32_t _transferQueueFamily;
+	AsyncUploader _uploader;
+	StagingRing _stagingRing;
 
 	// Vulkan Memory Allocator objects
 	VmaAllocator _allocator;
 
+	// Vertex and index memory of all meshes
+	GeometryPool _geometryPool;
+	// Which meshes have their geometry in the pool
+	MeshResidency _meshResidency;
+	// cap on the residency budget set from the UI, 0 for none
+	int _residencyBudgetMB {0};
+
 	// Vulkan image objects
 	AllocatedImage _drawImage;
 	AllocatedImage _depthImage;
 	VkExtent2D _drawExtent;
 
-	// Shader descriptor objects
-	DescriptorAllocator globalDescriptorAllocator;
-
-	VkDescriptorSet _drawImageDescriptors;
-	VkDescriptorSetLayout _drawImageDescriptorLayout;
+	// Shader descriptor objects, every image and sampler is in the bindless table
+	BindlessTable _bindless;
+	uint32_t _drawImageSlot;
+	// linear filtering and repeat, for the loaded textures
+	VkSampler _defaultSamplerLinear;
+	uint32_t _defaultSamplerSlot;
 
 	// Pipeline objects
 	VkPipelineLayout _gradientPipelineLayout;
@@ -111,8 +196,25 @@ public:
 	VkPipelineLayout _meshPipelineLayout;
 	VkPipeline _meshPipeline;
 
+	// Mesh Pipeline for meshes uploaded with VertexFormat::Packed
+	VkPipelineLayout _meshPackedPipelineLayout;
+	VkPipeline _meshPackedPipeline;
+
+	// Both vertex formats share the layout of GPUInstancedDrawPushConstants
+	VkPipelineLayout _meshInstancedPipelineLayout;
+	VkPipeline _meshInstancedPipeline;
+	VkPipeline _meshInstancedPackedPipeline;
+
 	//GPUMeshBuffers rectangle;
-	std::vector<std::shared_ptr<MeshAsset>> testMeshes;
+	std::vector<MeshHandle> testMeshes;
+	// Node hierarchy of the loaded glTF file, its mesh indices refer to testMeshes
+	SceneGraph _scene;
+	// Node whose transform the scene window edits
+	int _selectedNode {0};
+	// Meshes that can be drawn this frame by mesh index, null while not resident
+	std::vector<const MeshAsset*> _readyMeshes;
+	// Images of the loaded glTF files, null where decoding failed
+	std::vector<std::shared_ptr<TextureAsset>> _textures;
 
 	// Camera stuff
 	glm::vec3 _view { 0,0,-5 };
@@ -121,6 +223,54 @@ public:
 	float _near{0.1f};
 	float _far{10000.f};
 
+	// Level of detail: each surface draws its coarsest level whose error stays under
+	// this many pixels on screen, or the forced level when that is not -1
+	float _lodErrorThreshold {1.f};
+	int _forcedLod {-1};
+	// Triangles drawn at each level last frame
+	uint32_t _lodTriangles[MAX_MESH_LODS] {};
+
+	// Per meshlet frustum and backface culling of full detail surfaces
+	ClusterCuller _clusterCuller;
+	bool _clusterCulling {true};
+	// Surfaces drawn this frame, kept to reuse the allocation
+	std::vector<GeometryDraw> _geometryDraws;
+	// _geometryDraws in the order they are recorded, sorted every frame
+	DrawList _drawList;
+
+	// Passes of the frame and the barriers between them, rebuilt every frame
+	RenderGraph _renderGraph;
+
+	// Record the draws of the CPU path on the worker threads into secondary command buffers
+	bool _parallelRecording {true};
+	struct RecordingStats
+	{
+		uint32_t threads;
+		uint32_t draws;
+		float sortMs;
+		float recordMs;
+		BindStats binds;
+	} _recordingStats {};
+
+	// GPU driven path: culling, level selection and draw commands all come from a compute pass
+	IndirectRenderer _indirectRenderer;
+	bool _gpuDriven {true};
+	// Hi-Z of the depth prepass, the late culling phase of the GPU driven path tests against it
+	DepthPyramid _depthPyramid;
+	bool _occlusionCulling {true};
+	// Changes whenever the transforms or the drawable meshes of the scene change,
+	// the indirect renderer only uploads its objects again then
+	uint64_t _sceneVersion {1};
+
+	// Instanced draws submitted for the next frame, copied into its instance buffer by draw()
+	std::vector<GPUInstanceData> _pendingInstances;
+	std::vector<InstanceBatch> _instanceBatches;
+	bool _loggedInstanceOverflow {false};
+	// Grid of copies of the first mesh drawn with draw_instanced(), 0 to disable
+	int _instanceFieldSize {0};
+	float _instanceFieldSpacing {3.f};
+	std::vector<GPUInstanceData> _instanceField;
+
 
     // Acts like singleton but allows up to control creation and deletion
 	static VulkanEngine& Get();
@@ -136,20 +286,44 @@ public:
 	void draw_background(VkCommandBuffer cmd);
 	void draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView);
 	void draw_geometry(VkCommandBuffer cmd);
+	void set_draw_viewport(VkCommandBuffer cmd);
+	// Records the _geometryDraws of the items in their order
+	BindStats record_geometry_draws(VkCommandBuffer cmd, std::span<const DrawList::Item> items, const glm::mat4& viewProjection);
+	// Records _drawList split into chunkCount secondary command buffers and executes them in one render pass
+	BindStats record_geometry_parallel(VkCommandBuffer cmd, VkRenderingInfo renderInfo, uint32_t chunkCount,
+		const glm::mat4& viewProjection);
+	// GPU driven version of draw_geometry
+	void draw_geometry_indirect(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& projection);
+	// Records the instanced draws submitted for this frame, inside the render pass
+	void draw_instances(VkCommandBuffer cmd, const glm::mat4& viewProjection);
+	// lodScale is the number of pixels an object one unit across covers at a distance of one unit
+	uint32_t select_lod(const GeoSurface& surface, const glm::mat4& modelView, float lodScale) const;
 
 	//run main loop
 	void run();
 
+	// Draws every instance of the mesh in the next frame with one draw per surface,
+	// the instances are copied so the span only has to stay valid during the call
+	void draw_instanced(MeshHandle mesh, std::span<const GPUInstanceData> instances);
+
 	void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
 
-	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	// Single mesh upload, use MeshUploadBatch when uploading many meshes at once
+	std::optional<GPUMeshBuffers> uploadMesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices);
+
+	AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+	void destroy_buffer(const AllocatedBuffer& buffer);
+
+	// Device local image with a view covering every mip level, a full chain when mipmapped
+	AllocatedImage create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
+	void destroy_image(const AllocatedImage& image);
 
 private:
     bool init_vulkan();
 	bool init_swapchain();
 	void init_commands();
 	void init_sync_structures();
-	void init_descriptors();
+	bool init_descriptors();
 	void init_imgui();
 	bool init_default_data();
 
@@ -160,7 +334,7 @@ private:
 	bool init_background_pipelines();
 	//bool init_triangle_pipeline();
 	bool init_mesh_pipeline();
-
-	AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
-	void destroy_buffer(const AllocatedBuffer& buffer);
+	bool init_packed_mesh_pipeline();
+	bool init_instanced_mesh_pipelines();
+	void init_instance_buffers();
 };
@@ -0,0 +1,134 @@
+#include <vk_geometry_pool.h>
+
+#include <vk_engine.h>
+
+#include <algorithm>
+
+namespace
+{
+
+// Vertices are read through buffer device addresses as std430 structs, which need 16 byte alignment.
+// Index ranges are aligned for 32 bit indices, that also covers 16 bit ones.
+constexpr VkDeviceSize VERTEX_RANGE_ALIGNMENT = 16;
+constexpr VkDeviceSize INDEX_RANGE_ALIGNMENT = 4;
+
+bool
+allocate_range(VmaVirtualBlock block, VkDeviceSize size, VkDeviceSize alignment, GeometryRange& range)
+{
+	VmaVirtualAllocationCreateInfo allocInfo {};
+	// empty meshes still get a range so every mesh can be freed the same way
+	allocInfo.size = std::max<VkDeviceSize>(size, 1);
+	allocInfo.alignment = alignment;
+
+	VkDeviceSize offset;
+	VmaVirtualAllocation allocation;
+	if (vmaVirtualAllocate(block, &allocInfo, &allocation, &offset) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	range.allocation = allocation;
+	range.offset = offset;
+	range.size = size;
+	return true;
+}
+
+} // namespace
+
+void
+GeometryPool::init(VulkanEngine* engine, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+{
+	_engine = engine;
+
+	_vertexBuffer = _engine->create_buffer(vertexCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = _vertexBuffer.buffer };
+	_vertexBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+
+	// storage usage so compute passes can read the indices too
+	_indexBuffer = _engine->create_buffer(indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	deviceAdressInfo.buffer = _indexBuffer.buffer;
+	_indexBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+
+	_vertexCapacity = vertexCapacity;
+	_indexCapacity = indexCapacity;
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(_engine->_allocator, &memoryProperties);
+	_memoryHeap = memoryProperties->memoryTypes[_vertexBuffer.info.memoryType].heapIndex;
+
+	VmaVirtualBlockCreateInfo blockInfo {};
+	blockInfo.size = vertexCapacity;
+	VK_CHECK(vmaCreateVirtualBlock(&blockInfo, &_vertexBlock));
+
+	blockInfo.size = indexCapacity;
+	VK_CHECK(vmaCreateVirtualBlock(&blockInfo, &_indexBlock));
+}
+
+void
+GeometryPool::cleanup()
+{
+	// meshes still holding ranges at shutdown do not matter, the buffers go away anyway
+	vmaClearVirtualBlock(_vertexBlock);
+	vmaClearVirtualBlock(_indexBlock);
+	vmaDestroyVirtualBlock(_vertexBlock);
+	vmaDestroyVirtualBlock(_indexBlock);
+
+	_engine->destroy_buffer(_vertexBuffer);
+	_engine->destroy_buffer(_indexBuffer);
+}
+
+bool
+GeometryPool::allocate_vertices(VkDeviceSize size, GeometryRange& range)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return allocate_range(_vertexBlock, size, VERTEX_RANGE_ALIGNMENT, range);
+}
+
+bool
+GeometryPool::allocate_indices(VkDeviceSize size, GeometryRange& range)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return allocate_range(_indexBlock, size, INDEX_RANGE_ALIGNMENT, range);
+}
+
+void
+GeometryPool::free(GPUMeshBuffers& meshBuffers)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	free_range(_vertexBlock, meshBuffers.vertexRange);
+	free_range(_indexBlock, meshBuffers.indexRange);
+}
+
+void
+GeometryPool::free_range(VmaVirtualBlock block, GeometryRange& range)
+{
+	if (range.allocation != VK_NULL_HANDLE)
+	{
+		vmaVirtualFree(block, range.allocation);
+	}
+	range = GeometryRange {};
+}
+
+GeometryPool::Stats
+GeometryPool::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	VmaStatistics vertexStats;
+	vmaGetVirtualBlockStatistics(_vertexBlock, &vertexStats);
+	VmaStatistics indexStats;
+	vmaGetVirtualBlockStatistics(_indexBlock, &indexStats);
+
+	Stats stats;
+	stats.vertexCapacity = vertexStats.blockBytes;
+	stats.vertexUsed = vertexStats.allocationBytes;
+	stats.vertexRanges = vertexStats.allocationCount;
+	stats.indexCapacity = indexStats.blockBytes;
+	stats.indexUsed = indexStats.allocationBytes;
+	stats.indexRanges = indexStats.allocationCount;
+	return stats;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <mutex>
+
+//forward declaration
+class VulkanEngine;
+
+// One device local vertex buffer and one index buffer shared by every mesh.
+// Meshes get ranges of them from VMA virtual blocks, so a mesh costs no
+// allocations of its own and the index buffer only has to be bound once.
+class GeometryPool
+{
+public:
+    struct Stats
+    {
+        VkDeviceSize vertexCapacity;
+        VkDeviceSize vertexUsed;
+        uint32_t vertexRanges;
+
+        VkDeviceSize indexCapacity;
+        VkDeviceSize indexUsed;
+        uint32_t indexRanges;
+    };
+
+    void init(VulkanEngine* engine, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity);
+    void cleanup();
+
+    // Both return false when the pool has no room left for the range
+    bool allocate_vertices(VkDeviceSize size, GeometryRange& range);
+    bool allocate_indices(VkDeviceSize size, GeometryRange& range);
+
+    // Returns the ranges of a mesh to the pool, the GPU must be done with them
+    void free(GPUMeshBuffers& meshBuffers);
+
+    VkBuffer vertex_buffer() const { return _vertexBuffer.buffer; }
+    VkDeviceAddress vertex_buffer_address() const { return _vertexBufferAddress; }
+    VkBuffer index_buffer() const { return _indexBuffer.buffer; }
+    VkDeviceAddress index_buffer_address() const { return _indexBufferAddress; }
+
+    VkDeviceSize capacity() const { return _vertexCapacity + _indexCapacity; }
+    // Memory heap both buffers were allocated from
+    uint32_t memory_heap() const { return _memoryHeap; }
+
+    Stats stats();
+
+private:
+    void free_range(VmaVirtualBlock block, GeometryRange& range);
+
+    VulkanEngine* _engine;
+
+    AllocatedBuffer _vertexBuffer;
+    VkDeviceAddress _vertexBufferAddress;
+    VmaVirtualBlock _vertexBlock;
+
+    AllocatedBuffer _indexBuffer;
+    VkDeviceAddress _indexBufferAddress;
+    VmaVirtualBlock _indexBlock;
+
+    VkDeviceSize _vertexCapacity {0};
+    VkDeviceSize _indexCapacity {0};
+    uint32_t _memoryHeap {0};
+
+    // meshes are loaded and freed from any thread
+    std::mutex _mutex;
+};
@@ -1,33 +1,35 @@
 #include <vk_images.h>
 
+#include <vk_barriers.h>
 #include <vk_initializers.h>
 
+#include <algorithm>
+#include <cmath>
+
 void
 vkutil::transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout)
 {
-    VkImageMemoryBarrier2 imageBarrier {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
-    imageBarrier.pNext = nullptr;
-
-    imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT; // Will stall the GPU for all commands while this completes, should improve later
-    imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;        // https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples
-    imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
-
-    imageBarrier.oldLayout = currentLayout;
-    imageBarrier.newLayout = newLayout;
-
-    VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-    imageBarrier.subresourceRange = vkinit::image_subresource_range(aspectMask);
-    imageBarrier.image = image;
-
-    VkDependencyInfo depInfo {};
-    depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-    depInfo.pNext = nullptr;
-
-    depInfo.imageMemoryBarrierCount = 1;
-    depInfo.pImageMemoryBarriers = &imageBarrier;
-
-    vkCmdPipelineBarrier2(cmd, &depInfo);
+    // Knows nothing about the surrounding work so it waits for and blocks everything,
+    // a BarrierBuilder with the scopes of the actual uses is much cheaper
+    BarrierScope src {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT, currentLayout};
+    BarrierScope dst {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT, newLayout};
+
+    VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    switch (newLayout)
+    {
+    case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+    case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+        aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        break;
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+        aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        break;
+    default:
+        break;
+    }
+
+    BarrierBuilder().image(image, src, dst, aspectMask).flush(cmd);
 }
 
 void
@@ -65,3 +67,62 @@ vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage destina
 	vkCmdBlitImage2(cmd, &blitInfo);
 }
 
+
+uint32_t
+vkutil::mip_level_count(VkExtent2D imageSize)
+{
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(imageSize.width, imageSize.height)))) + 1;
+}
+
+void
+vkutil::generate_mipmaps(VkCommandBuffer cmd, VkImage image, VkExtent2D imageSize, uint32_t mipLevels)
+{
+    BarrierBuilder barriers;
+
+    for (uint32_t mip = 0; mip < mipLevels; mip++)
+    {
+        // the level was just written by the copy or the previous blit, the next blit reads it
+        barriers.image(image, scope::TransferDst, scope::TransferSrc, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1).flush(cmd);
+
+        if (mip + 1 == mipLevels)
+        {
+            break;
+        }
+
+        VkExtent2D halfSize { std::max(imageSize.width / 2, 1u), std::max(imageSize.height / 2, 1u) };
+
+        VkImageBlit2 blitRegion {.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2};
+
+        blitRegion.srcOffsets[1].x = imageSize.width;
+        blitRegion.srcOffsets[1].y = imageSize.height;
+        blitRegion.srcOffsets[1].z = 1;
+
+        blitRegion.dstOffsets[1].x = halfSize.width;
+        blitRegion.dstOffsets[1].y = halfSize.height;
+        blitRegion.dstOffsets[1].z = 1;
+
+        blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blitRegion.srcSubresource.layerCount = 1;
+        blitRegion.srcSubresource.mipLevel = mip;
+
+        blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blitRegion.dstSubresource.layerCount = 1;
+        blitRegion.dstSubresource.mipLevel = mip + 1;
+
+        VkBlitImageInfo2 blitInfo {.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2};
+        blitInfo.srcImage = image;
+        blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        blitInfo.dstImage = image;
+        blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        blitInfo.filter = VK_FILTER_LINEAR;
+        blitInfo.regionCount = 1;
+        blitInfo.pRegions = &blitRegion;
+
+        vkCmdBlitImage2(cmd, &blitInfo);
+
+        imageSize = halfSize;
+    }
+
+    // every level is done, hand the whole chain to the shaders
+    barriers.image(image, scope::TransferSrc, scope::ShaderSampled, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels).flush(cmd);
+}
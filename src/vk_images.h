@@ -9,4 +9,11 @@ void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentL
 
 void copy_image_to_image(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);	
 
+// Number of levels in a full mip chain down to 1x1
+uint32_t mip_level_count(VkExtent2D imageSize);
+
+// Fills every level below 0 by blitting each level into the next one, all in one command buffer.
+// Every level has to be in TRANSFER_DST_OPTIMAL, the whole image ends up in SHADER_READ_ONLY_OPTIMAL.
+void generate_mipmaps(VkCommandBuffer cmd, VkImage image, VkExtent2D imageSize, uint32_t mipLevels);
+
 } // namespace vkutils
@@ -0,0 +1,438 @@
+#include <vk_indirect.h>
+
+#include <vk_barriers.h>
+#include <vk_engine.h>
+#include <vk_initializers.h>
+#include <vk_pipelines.h>
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+
+glm::vec4
+normalize_plane(const glm::vec4& plane)
+{
+	return plane / glm::length(glm::vec3(plane));
+}
+
+} // namespace
+
+bool
+IndirectRenderer::init(VulkanEngine* engine)
+{
+	_engine = engine;
+
+	// Culling pass, buffers are read through their device addresses and
+	// the depth pyramid of the occlusion test through the bindless table
+	VkPushConstantRange cullPushConstant {};
+	cullPushConstant.offset = 0;
+	cullPushConstant.size = sizeof(CullPushConstants);
+	cullPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayout bindlessLayout = _engine->_bindless.layout();
+
+	VkPipelineLayoutCreateInfo cullLayoutInfo = vkinit::pipeline_layout_create_info();
+	cullLayoutInfo.pSetLayouts = &bindlessLayout;
+	cullLayoutInfo.setLayoutCount = 1;
+	cullLayoutInfo.pPushConstantRanges = &cullPushConstant;
+	cullLayoutInfo.pushConstantRangeCount = 1;
+	VK_CHECK(vkCreatePipelineLayout(_engine->_device, &cullLayoutInfo, nullptr, &_cullPipelineLayout));
+
+	std::string shaderPath = SHADERS_PATH;
+	shaderPath += "indirect_cull.comp.spv";
+	VkShaderModule cullShader;
+	if (!vkutil::load_shader_module(shaderPath.c_str(), _engine->_device, &cullShader))
+	{
+		_engine->m_logger->error("Error when building the compute shader: [{}]", shaderPath);
+		vkDestroyPipelineLayout(_engine->_device, _cullPipelineLayout, nullptr);
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.layout = _cullPipelineLayout;
+	pipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+	VK_CHECK(vkCreateComputePipelines(_engine->_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_cullPipeline));
+
+	vkDestroyShaderModule(_engine->_device, cullShader, nullptr);
+
+	// Mesh and depth passes, one pipeline per vertex format sharing a layout
+	VkPushConstantRange drawPushConstant {};
+	drawPushConstant.offset = 0;
+	drawPushConstant.size = sizeof(DrawPushConstants);
+	drawPushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo drawLayoutInfo = vkinit::pipeline_layout_create_info();
+	drawLayoutInfo.pPushConstantRanges = &drawPushConstant;
+	drawLayoutInfo.pushConstantRangeCount = 1;
+	VK_CHECK(vkCreatePipelineLayout(_engine->_device, &drawLayoutInfo, nullptr, &_drawPipelineLayout));
+
+	if (!init_draw_pipeline("mesh_indirect.vert.spv", false, &_drawPipelines[(uint32_t)VertexFormat::Standard])
+		|| !init_draw_pipeline("mesh_indirect_packed.vert.spv", false, &_drawPipelines[(uint32_t)VertexFormat::Packed])
+		|| !init_draw_pipeline("mesh_indirect.vert.spv", true, &_depthPipelines[(uint32_t)VertexFormat::Standard])
+		|| !init_draw_pipeline("mesh_indirect_packed.vert.spv", true, &_depthPipelines[(uint32_t)VertexFormat::Packed]))
+	{
+		for (VkPipeline pipeline : _drawPipelines)
+		{
+			vkDestroyPipeline(_engine->_device, pipeline, nullptr);
+		}
+		for (VkPipeline pipeline : _depthPipelines)
+		{
+			vkDestroyPipeline(_engine->_device, pipeline, nullptr);
+		}
+		vkDestroyPipelineLayout(_engine->_device, _drawPipelineLayout, nullptr);
+		vkDestroyPipeline(_engine->_device, _cullPipeline, nullptr);
+		vkDestroyPipelineLayout(_engine->_device, _cullPipelineLayout, nullptr);
+		return false;
+	}
+
+	_frames.resize(FRAME_OVERLAP);
+	for (FrameResources& frame : _frames)
+	{
+		frame.objectBuffer = _engine->create_buffer(INDIRECT_MAX_OBJECTS * sizeof(IndirectObject),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = frame.objectBuffer.buffer };
+		frame.objectBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+
+		frame.drawBuffer = _engine->create_buffer(COMMANDS_OFFSET + PHASE_COUNT * INDIRECT_MAX_OBJECTS * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		deviceAdressInfo.buffer = frame.drawBuffer.buffer;
+		frame.drawBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &deviceAdressInfo);
+	}
+
+	// nothing was visible before the first frame, its late phase draws everything that is
+	_visibilityBuffer = _engine->create_buffer(INDIRECT_MAX_OBJECTS * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	VkBufferDeviceAddressInfo visibilityAddressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = _visibilityBuffer.buffer };
+	_visibilityBufferAddress = vkGetBufferDeviceAddress(_engine->_device, &visibilityAddressInfo);
+
+	_engine->immediate_submit([&](VkCommandBuffer cmd) {
+		vkCmdFillBuffer(cmd, _visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+	});
+
+	return true;
+}
+
+bool
+IndirectRenderer::init_draw_pipeline(const char* vertexShaderName, bool depthOnly, VkPipeline* pipeline)
+{
+	std::string fragShaderPath = SHADERS_PATH;
+	fragShaderPath += "coloured_triangle.frag.spv";
+	VkShaderModule fragShader;
+	if (!vkutil::load_shader_module(fragShaderPath.c_str(), _engine->_device, &fragShader))
+	{
+		_engine->m_logger->error("Error when building the triangle frag shader: [{}]", fragShaderPath);
+		return false;
+	}
+
+	std::string vertexShaderPath = SHADERS_PATH;
+	vertexShaderPath += vertexShaderName;
+	VkShaderModule vertexShader;
+	if (!vkutil::load_shader_module(vertexShaderPath.c_str(), _engine->_device, &vertexShader))
+	{
+		_engine->m_logger->error("Error when building the indirect mesh vertex shader: [{}]", vertexShaderPath);
+		vkDestroyShaderModule(_engine->_device, fragShader, nullptr);
+		return false;
+	}
+
+	// same state as the mesh pipelines of the CPU path. The depth pipelines run the same
+	// vertex shader, whose invariant position makes the color pass hit the same depths.
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder._pipelineLayout = _drawPipelineLayout;
+	if (depthOnly)
+	{
+		pipelineBuilder.set_vertex_shader(vertexShader);
+	}
+	else
+	{
+		pipelineBuilder.set_shaders(vertexShader, fragShader);
+		pipelineBuilder.enable_blending_additive();
+		pipelineBuilder.set_color_attachment_format(_engine->_drawImage.imageFormat);
+	}
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	pipelineBuilder.set_depth_format(_engine->_depthImage.imageFormat);
+
+	*pipeline = pipelineBuilder.build_pipeline(_engine->_device);
+
+	vkDestroyShaderModule(_engine->_device, fragShader, nullptr);
+	vkDestroyShaderModule(_engine->_device, vertexShader, nullptr);
+
+	if (*pipeline == VK_NULL_HANDLE)
+	{
+		_engine->m_logger->error("Failed to init indirect mesh graphics pipeline [{}]", vertexShaderName);
+		return false;
+	}
+	return true;
+}
+
+void
+IndirectRenderer::cleanup()
+{
+	for (FrameResources& frame : _frames)
+	{
+		_engine->destroy_buffer(frame.objectBuffer);
+		_engine->destroy_buffer(frame.drawBuffer);
+	}
+	_frames.clear();
+	_engine->destroy_buffer(_visibilityBuffer);
+
+	for (VkPipeline pipeline : _drawPipelines)
+	{
+		vkDestroyPipeline(_engine->_device, pipeline, nullptr);
+	}
+	for (VkPipeline pipeline : _depthPipelines)
+	{
+		vkDestroyPipeline(_engine->_device, pipeline, nullptr);
+	}
+	vkDestroyPipelineLayout(_engine->_device, _drawPipelineLayout, nullptr);
+	vkDestroyPipeline(_engine->_device, _cullPipeline, nullptr);
+	vkDestroyPipelineLayout(_engine->_device, _cullPipelineLayout, nullptr);
+}
+
+uint32_t
+IndirectRenderer::bucket_of(const GPUMeshBuffers& meshBuffers)
+{
+	uint32_t shortIndices = meshBuffers.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+	return (uint32_t)meshBuffers.vertexFormat * 2 + shortIndices;
+}
+
+void
+IndirectRenderer::begin_frame(uint32_t frameIndex)
+{
+	_frameIndex = frameIndex % _frames.size();
+	FrameResources& frame = _frames[_frameIndex];
+
+	CullData* cullData = static_cast<CullData*>(frame.drawBuffer.info.pMappedData);
+
+	// the fence of this frame was waited on, so what the GPU counted for it is done
+	if (frame.culled)
+	{
+		VK_CHECK(vmaInvalidateAllocation(_engine->_allocator, frame.drawBuffer.allocation, 0, COMMANDS_OFFSET));
+
+		Stats stats {};
+		stats.objects = frame.objectCount;
+		for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+		{
+			stats.visibleObjects += cullData->drawCounts[bucket];
+			stats.lateObjects += cullData->drawCounts[BUCKET_COUNT + bucket];
+		}
+		stats.visibleObjects += stats.lateObjects;
+		stats.occludedObjects = cullData->occludedObjects;
+		for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++)
+		{
+			stats.lodTriangles[lod] = cullData->lodTriangles[lod];
+		}
+		_stats = stats;
+	}
+	else
+	{
+		_stats = {};
+	}
+
+	// the culling pass counts from zero, the write reaches the GPU with the flush in record_cull()
+	std::fill(std::begin(cullData->drawCounts), std::end(cullData->drawCounts), 0);
+	std::fill(std::begin(cullData->lodTriangles), std::end(cullData->lodTriangles), 0);
+	cullData->occludedObjects = 0;
+	frame.culled = false;
+}
+
+bool
+IndirectRenderer::begin_objects(uint64_t version)
+{
+	FrameResources& frame = _frames[_frameIndex];
+	if (frame.objectsVersion == version)
+	{
+		return false;
+	}
+
+	frame.objectsVersion = version;
+	frame.objectCount = 0;
+	std::fill(std::begin(frame.bucketCounts), std::end(frame.bucketCounts), 0);
+	return true;
+}
+
+void
+IndirectRenderer::add(const MeshAsset& mesh, const GeoSurface& surface, const glm::mat4& worldMatrix)
+{
+	FrameResources& frame = _frames[_frameIndex];
+	if (frame.objectCount == INDIRECT_MAX_OBJECTS)
+	{
+		if (!_loggedOverflow)
+		{
+			_engine->m_logger->warn("More than {} objects for the GPU driven path, the rest are not drawn", INDIRECT_MAX_OBJECTS);
+			_loggedOverflow = true;
+		}
+		return;
+	}
+
+	const GPUMeshBuffers& meshBuffers = mesh.meshBuffers;
+
+	IndirectObject& object = static_cast<IndirectObject*>(frame.objectBuffer.info.pMappedData)[frame.objectCount++];
+	object = {};
+	object.worldMatrix = worldMatrix;
+	object.bounds = surface.bounds;
+	object.positionScale = meshBuffers.quantization.positionScale;
+	object.positionOffset = meshBuffers.quantization.positionOffset;
+	object.vertexBuffer = meshBuffers.vertexBufferAddress;
+	object.firstIndex = meshBuffers.firstIndex;
+	object.bucket = bucket_of(meshBuffers);
+	object.lodCount = surface.lodCount;
+	for (uint32_t lod = 0; lod < surface.lodCount; lod++)
+	{
+		object.lodErrors[lod] = surface.lods[lod].error;
+		object.lods[lod][0] = surface.lods[lod].startIndex;
+		object.lods[lod][1] = surface.lods[lod].count;
+	}
+
+	frame.bucketCounts[object.bucket]++;
+}
+
+void
+IndirectRenderer::record_cull(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& projection,
+	const LodSettings& lodSettings, bool occlusion)
+{
+	FrameResources& frame = _frames[_frameIndex];
+
+	// Frustum planes from the rows of the view projection matrix (Gribb & Hartmann)
+	glm::mat4 rows = glm::transpose(projection * view);
+	CullData* cullData = static_cast<CullData*>(frame.drawBuffer.info.pMappedData);
+	cullData->planes[0] = normalize_plane(rows[3] + rows[0]);
+	cullData->planes[1] = normalize_plane(rows[3] - rows[0]);
+	cullData->planes[2] = normalize_plane(rows[3] + rows[1]);
+	cullData->planes[3] = normalize_plane(rows[3] - rows[1]);
+	// glm's default clip space has a depth range of -w..w
+	cullData->planes[4] = normalize_plane(rows[3] + rows[2]);
+	cullData->planes[5] = normalize_plane(rows[3] - rows[2]);
+	cullData->view = view;
+	cullData->lodScale = lodSettings.lodScale;
+	cullData->lodErrorThreshold = lodSettings.errorThreshold;
+	cullData->forcedLod = lodSettings.forcedLod;
+	cullData->objectCount = frame.objectCount;
+	cullData->projection = projection;
+	cullData->pyramidWidth = (float)_engine->_depthPyramid.extent().width;
+	cullData->pyramidHeight = (float)_engine->_depthPyramid.extent().height;
+	cullData->pyramidLevels = _engine->_depthPyramid.mip_levels();
+
+	// each bucket gets the command range its objects could fill
+	uint32_t base = 0;
+	for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+	{
+		cullData->bucketBase[bucket] = base;
+		base += frame.bucketCounts[bucket];
+	}
+
+	// host writes are visible to the queue submit that follows, but may need a flush to get there
+	VK_CHECK(vmaFlushAllocation(_engine->_allocator, frame.drawBuffer.allocation, 0, COMMANDS_OFFSET));
+	VK_CHECK(vmaFlushAllocation(_engine->_allocator, frame.objectBuffer.allocation, 0, frame.objectCount * sizeof(IndirectObject)));
+	frame.culled = true;
+	_occlusion = occlusion;
+
+	if (frame.objectCount == 0)
+	{
+		return;
+	}
+
+	// the visibility was written by the late phase of the last frame
+	if (occlusion)
+	{
+		vkutil::BarrierBuilder().buffer(_visibilityBuffer.buffer, vkutil::scope::ComputeWrite, vkutil::scope::ComputeRead).flush(cmd);
+	}
+
+	dispatch_cull(cmd, Phase::Early);
+}
+
+void
+IndirectRenderer::record_late_cull(VkCommandBuffer cmd)
+{
+	if (_frames[_frameIndex].objectCount == 0)
+	{
+		return;
+	}
+
+	dispatch_cull(cmd, Phase::Late);
+}
+
+void
+IndirectRenderer::dispatch_cull(VkCommandBuffer cmd, Phase phase)
+{
+	const FrameResources& frame = _frames[_frameIndex];
+
+	CullPushConstants pushConstants;
+	pushConstants.objectBuffer = frame.objectBufferAddress;
+	pushConstants.cullData = frame.drawBufferAddress;
+	pushConstants.commandBuffer = frame.drawBufferAddress + COMMANDS_OFFSET;
+	pushConstants.visibilityBuffer = _visibilityBufferAddress;
+	pushConstants.phase = phase;
+	pushConstants.occlusion = _occlusion ? 1 : 0;
+	// only sampled by the late phase
+	pushConstants.pyramidImage = _engine->_depthPyramid.image_slot();
+	pushConstants.pyramidSampler = _engine->_depthPyramid.sampler_slot();
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+	_engine->_bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout);
+	vkCmdPushConstants(cmd, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+	vkCmdDispatch(cmd, (frame.objectCount + 63) / 64, 1, 1);
+
+	// commands and counts are read by the indirect draws, the counts by the CPU once the frame is done
+	vkutil::BarrierScope consumers {vkutil::scope::IndirectCommands.stages | vkutil::scope::HostRead.stages,
+		vkutil::scope::IndirectCommands.access | vkutil::scope::HostRead.access};
+	vkutil::BarrierBuilder().memory(vkutil::scope::ComputeWrite, consumers).flush(cmd);
+}
+
+void
+IndirectRenderer::draw(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase)
+{
+	record_draws(cmd, viewProjection, phase, _drawPipelines);
+}
+
+void
+IndirectRenderer::draw_depth(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase)
+{
+	record_draws(cmd, viewProjection, phase, _depthPipelines);
+}
+
+void
+IndirectRenderer::record_draws(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase, const VkPipeline* pipelines)
+{
+	const FrameResources& frame = _frames[_frameIndex];
+
+	DrawPushConstants pushConstants;
+	pushConstants.viewProjection = viewProjection;
+	pushConstants.objectBuffer = frame.objectBufferAddress;
+
+	const uint32_t phaseIndex = (uint32_t)phase;
+	const CullData* cullData = static_cast<const CullData*>(frame.drawBuffer.info.pMappedData);
+	for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++)
+	{
+		// empty buckets are known on the CPU, culled ones only on the GPU
+		if (frame.bucketCounts[bucket] == 0)
+		{
+			continue;
+		}
+
+		VkPipeline pipeline = pipelines[bucket / 2];
+		VkIndexType indexType = bucket % 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdPushConstants(cmd, _drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+		vkCmdBindIndexBuffer(cmd, _engine->_geometryPool.index_buffer(), 0, indexType);
+
+		VkDeviceSize commandOffset = COMMANDS_OFFSET
+			+ (phaseIndex * INDIRECT_MAX_OBJECTS + cullData->bucketBase[bucket]) * sizeof(VkDrawIndexedIndirectCommand);
+		VkDeviceSize countOffset = offsetof(CullData, drawCounts) + (phaseIndex * BUCKET_COUNT + bucket) * sizeof(uint32_t);
+		vkCmdDrawIndexedIndirectCount(cmd, frame.drawBuffer.buffer, commandOffset, frame.drawBuffer.buffer, countOffset,
+			frame.bucketCounts[bucket], sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+//forward declaration
+class VulkanEngine;
+
+// Surfaces the GPU driven path can draw, the rest are dropped
+constexpr uint32_t INDIRECT_MAX_OBJECTS = 64 * 1024;
+
+// GPU driven drawing: object transforms, bounds and index ranges live in a buffer,
+// a compute pass frustum culls them, picks their level of detail and writes the
+// indexed indirect commands, and the mesh pass draws everything with one
+// vkCmdDrawIndexedIndirectCount per bucket. Objects are bucketed by vertex format
+// and index type, which each need their own pipeline or index buffer binding, so
+// the recorded commands do not depend on the number of objects. Usage per frame:
+//   begin_frame(), then add() for each surface when begin_objects() asks for them,
+//   record_cull() before rendering starts and draw() inside the render pass.
+// With occlusion culling the objects are drawn in two phases: record_cull() only lets
+// through what passed the occlusion test last frame, those are drawn into the depth
+// image with draw_depth(), the depth pyramid is built from it, and record_late_cull()
+// tests every object against the pyramid and adds the visible ones the early phase missed.
+class IndirectRenderer
+{
+public:
+    enum class Phase : uint32_t
+    {
+        Early,
+        Late,
+    };
+
+    struct Stats
+    {
+        uint32_t objects;
+        uint32_t visibleObjects;
+        // of visibleObjects, drawn by the late phase
+        uint32_t lateObjects;
+        // inside the frustum but hidden behind the depth pyramid
+        uint32_t occludedObjects;
+        uint32_t lodTriangles[MAX_MESH_LODS];
+    };
+
+    struct LodSettings
+    {
+        // pixels an object one unit across covers at a distance of one unit
+        float lodScale;
+        float errorThreshold;
+        // -1 to pick levels by screen size
+        int forcedLod;
+    };
+
+    bool init(VulkanEngine* engine);
+    void cleanup();
+
+    // Starts a new frame once its fence has been waited on, which makes
+    // the results of the last frame that used the same resources readable
+    void begin_frame(uint32_t frameIndex);
+
+    // Objects stay in the buffers of each frame until the caller's version of them changes.
+    // Returns true when the objects of this frame are older than version, they have to be
+    // added again with add().
+    bool begin_objects(uint64_t version);
+    void add(const MeshAsset& mesh, const GeoSurface& surface, const glm::mat4& worldMatrix);
+
+    // Records the early culling pass, must come before the render pass that draws the objects.
+    // Without occlusion everything in the frustum is drawn by the early phase.
+    void record_cull(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& projection,
+        const LodSettings& lodSettings, bool occlusion);
+    // Records the late culling pass against the depth pyramid of the early phase's depth
+    void record_late_cull(VkCommandBuffer cmd);
+
+    // Record the indirect draws of a phase, viewport and scissor have to be set already.
+    // draw_depth() renders into a depth attachment only.
+    void draw(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase);
+    void draw_depth(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase);
+
+    // Results of the last completed frame
+    Stats stats() const { return _stats; }
+
+private:
+    // Vertex format times index type
+    static constexpr uint32_t BUCKET_COUNT = 4;
+
+    // must match indirect_object.glsl
+    struct IndirectObject
+    {
+        glm::mat4 worldMatrix;
+        glm::vec4 bounds;
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+        glm::vec4 lodErrors;
+        VkDeviceAddress vertexBuffer;
+        uint32_t firstIndex;
+        uint32_t bucket;
+        uint32_t lodCount;
+        uint32_t padding0;
+        uint32_t lods[MAX_MESH_LODS][2];
+        uint32_t padding1[2];
+    };
+
+    static constexpr uint32_t PHASE_COUNT = 2;
+
+    // must match indirect_cull.comp
+    struct CullData
+    {
+        glm::vec4 planes[6];
+        glm::mat4 view;
+        float lodScale;
+        float lodErrorThreshold;
+        int32_t forcedLod;
+        uint32_t objectCount;
+        glm::mat4 projection;
+        float pyramidWidth;
+        float pyramidHeight;
+        uint32_t pyramidLevels;
+        uint32_t padding0;
+        uint32_t bucketBase[BUCKET_COUNT];
+        // written by the culling passes, the early buckets then the late ones
+        uint32_t drawCounts[PHASE_COUNT * BUCKET_COUNT];
+        uint32_t lodTriangles[MAX_MESH_LODS];
+        uint32_t occludedObjects;
+    };
+
+    // Commands start after the CullData, aligned for the buffer reference.
+    // The late phase's commands follow room for every object of the early one.
+    static constexpr VkDeviceSize COMMANDS_OFFSET = (sizeof(CullData) + 15) & ~VkDeviceSize(15);
+
+    struct CullPushConstants
+    {
+        VkDeviceAddress objectBuffer;
+        VkDeviceAddress cullData;
+        VkDeviceAddress commandBuffer;
+        VkDeviceAddress visibilityBuffer;
+        Phase phase;
+        uint32_t occlusion;
+        uint32_t pyramidImage;
+        uint32_t pyramidSampler;
+    };
+
+    struct DrawPushConstants
+    {
+        glm::mat4 viewProjection;
+        VkDeviceAddress objectBuffer;
+    };
+
+    struct FrameResources
+    {
+        AllocatedBuffer objectBuffer;
+        VkDeviceAddress objectBufferAddress;
+
+        // CullData followed by the commands, host visible so the counts can be read back
+        AllocatedBuffer drawBuffer;
+        VkDeviceAddress drawBufferAddress;
+
+        // version of the objects in objectBuffer, 0 before the first fill
+        uint64_t objectsVersion {0};
+        uint32_t objectCount {0};
+        uint32_t bucketCounts[BUCKET_COUNT] {};
+        bool culled {false};
+    };
+
+    static uint32_t bucket_of(const GPUMeshBuffers& meshBuffers);
+    bool init_draw_pipeline(const char* vertexShaderName, bool depthOnly, VkPipeline* pipeline);
+    void dispatch_cull(VkCommandBuffer cmd, Phase phase);
+    void record_draws(VkCommandBuffer cmd, const glm::mat4& viewProjection, Phase phase, const VkPipeline* pipelines);
+
+    VulkanEngine* _engine;
+
+    VkPipelineLayout _cullPipelineLayout;
+    VkPipeline _cullPipeline;
+
+    VkPipelineLayout _drawPipelineLayout;
+    // by vertex format
+    VkPipeline _drawPipelines[2] {};
+    VkPipeline _depthPipelines[2] {};
+
+    // Result of the last late phase for every object, shared by the frames in flight.
+    // Objects are added in the same order every time, so indices stay meaningful.
+    AllocatedBuffer _visibilityBuffer;
+    VkDeviceAddress _visibilityBufferAddress;
+    bool _occlusion {false};
+
+    // one per frame in flight
+    std::vector<FrameResources> _frames;
+    uint32_t _frameIndex {0};
+    bool _loggedOverflow {false};
+
+    Stats _stats {};
+};
@@ -17,7 +17,7 @@ vkinit::command_pool_create_info(uint32_t queueFamilyIndex,
 
 VkCommandBufferAllocateInfo
 vkinit::command_buffer_allocate_info(
-    VkCommandPool pool, uint32_t count)
+    VkCommandPool pool, uint32_t count, VkCommandBufferLevel level)
 {
     VkCommandBufferAllocateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -25,7 +25,7 @@ vkinit::command_buffer_allocate_info(
 
     info.commandPool = pool;
     info.commandBufferCount = count;
-    info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // Secondary is used for sub commands and multithreaded command creation
+    info.level = level; // Secondary is used for sub commands and multithreaded command creation
     return info;
 }
 
@@ -41,6 +41,36 @@ VkCommandBufferBeginInfo vkinit::command_buffer_begin_info(VkCommandBufferUsageF
 }
 
 
+VkCommandBufferInheritanceRenderingInfo
+vkinit::command_buffer_inheritance_rendering_info(const VkFormat* colorFormat, VkFormat depthFormat)
+{
+    VkCommandBufferInheritanceRenderingInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    info.pNext = nullptr;
+
+    info.colorAttachmentCount = 1;
+    info.pColorAttachmentFormats = colorFormat;
+    info.depthAttachmentFormat = depthFormat;
+    info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    return info;
+}
+
+VkCommandBufferInheritanceInfo
+vkinit::command_buffer_inheritance_info(VkCommandBufferInheritanceRenderingInfo* renderingInfo)
+{
+    VkCommandBufferInheritanceInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    info.pNext = renderingInfo;
+
+    // dynamic rendering has no render pass or framebuffer to inherit
+    info.renderPass = VK_NULL_HANDLE;
+    info.subpass = 0;
+    info.framebuffer = VK_NULL_HANDLE;
+    return info;
+}
+
+
 VkFenceCreateInfo vkinit::fence_create_info(VkFenceCreateFlags flags)
 {
     VkFenceCreateInfo info = {};
@@ -204,7 +234,7 @@ VkRenderingInfo vkinit::rendering_info(VkExtent2D renderExtent, VkRenderingAttac
 
     renderInfo.renderArea = VkRect2D { VkOffset2D { 0, 0 }, renderExtent };
     renderInfo.layerCount = 1;
-    renderInfo.colorAttachmentCount = 1;
+    renderInfo.colorAttachmentCount = colorAttachment ? 1 : 0;
     renderInfo.pColorAttachments = colorAttachment;
     renderInfo.pDepthAttachment = depthAttachment;
     renderInfo.pStencilAttachment = nullptr;
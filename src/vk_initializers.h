@@ -9,8 +9,12 @@ VkCommandPoolCreateInfo command_pool_create_info(uint32_t queueFamilyIndex,
     VkCommandPoolCreateFlags flags = 0);
 
 VkCommandBufferAllocateInfo command_buffer_allocate_info(
-    VkCommandPool pool, uint32_t count = 1);
+    VkCommandPool pool, uint32_t count = 1, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 VkCommandBufferBeginInfo command_buffer_begin_info(VkCommandBufferUsageFlags flags = 0);
+// For secondary command buffers recorded inside a dynamic render pass with one color attachment
+VkCommandBufferInheritanceRenderingInfo command_buffer_inheritance_rendering_info(const VkFormat* colorFormat,
+    VkFormat depthFormat);
+VkCommandBufferInheritanceInfo command_buffer_inheritance_info(VkCommandBufferInheritanceRenderingInfo* renderingInfo);
 
 VkFenceCreateInfo fence_create_info(VkFenceCreateFlags flags = 0);
 VkSemaphoreCreateInfo semaphore_create_info(VkSemaphoreCreateFlags flags = 0);
@@ -1,15 +1,32 @@
 #include <vk_loader.h>
 
+#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <queue>
 
 #include "vk_engine.h"
+#include "vk_mesh_cache.h"
+#include "vk_mesh_lod.h"
+#include "vk_meshlet.h"
+#include "vk_mesh_optimizer.h"
+#include "vk_texture_cache.h"
+#include "vk_texture_compress.h"
+#include "vk_upload.h"
+#include "vk_vertex_convert.h"
+#include "vk_vertex_format.h"
 #include "vk_initializers.h"
 #include "vk_types.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/quaternion.hpp>
 
 #include <fastgltf/glm_element_traits.hpp>
@@ -18,11 +35,22 @@
 
 #include <spdlog/logger.h>
 
-std::optional<std::vector<std::shared_ptr<MeshAsset>>>
-loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath)
+namespace
+{
+
+using LoadClock = std::chrono::steady_clock;
+
+double
+elapsedMs(LoadClock::time_point start, LoadClock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Parses a binary glTF file along with its external buffers
+std::optional<fastgltf::Asset>
+parseGltf(const std::filesystem::path& filePath)
 {
     std::shared_ptr<spdlog::logger> logger = spdlog::get("vulkan-test");
-    logger->info("Loading GLTF: {}", filePath.string());
 
     auto retFromPath = fastgltf::GltfDataBuffer::FromPath(filePath);
     if (!retFromPath)
@@ -34,116 +62,823 @@ loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath)
 
     constexpr auto gltfOptions = fastgltf::Options::LoadExternalBuffers;
 
-    fastgltf::Asset gltf;
     fastgltf::Parser parser {};
 
     auto load = parser.loadGltfBinary(retFromPath.get(), filePath.parent_path(), gltfOptions);
-    if (load)
+    if (!load)
     {
-        // Success
-        gltf = std::move(load.get());
+        logger->error("Failed to load glTF: {}", fastgltf::to_underlying(load.error()));
+        return {};
     }
-    else
+
+    return std::move(load.get());
+}
+
+// A single glTF primitive to decode, along with where its data lands in the
+// arrays of the mesh that owns it
+struct PrimitiveJob
+{
+    size_t meshIndex;
+    size_t primitiveIndex;
+    size_t firstIndex;
+    size_t firstVertex;
+};
+
+// Per thread scratch arrays the accessors are bulk copied into before interleaving
+struct DecodeScratch
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec4> colors;
+};
+
+// Copies an attribute into scratch, returns null when the primitive does not have it
+template <typename T>
+const T*
+copyAttribute(const fastgltf::Asset& gltf, const fastgltf::Primitive& p, std::string_view name,
+    size_t vertexCount, std::vector<T>& scratch)
+{
+    auto attribute = p.findAttribute(name);
+    if (attribute == p.attributes.end())
+    {
+        return nullptr;
+    }
+
+    const fastgltf::Accessor& accessor = gltf.accessors[attribute->accessorIndex];
+    if (accessor.count != vertexCount)
+    {
+        return nullptr;
+    }
+
+    scratch.resize(vertexCount);
+    fastgltf::copyFromAccessor<T>(gltf, accessor, scratch.data());
+    return scratch.data();
+}
+
+// Only writes to the index and vertex ranges owned by the primitive, so
+// primitives of the same mesh can be decoded at the same time
+void
+decodePrimitive(const fastgltf::Asset& gltf, const fastgltf::Primitive& p, MeshData& mesh,
+    size_t firstIndex, size_t firstVertex)
+{
+    thread_local DecodeScratch scratch;
+
+    // load indexes, straight into place and then offset to the vertices of this primitive
+    const fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
+    uint32_t* indices = mesh.indices.data() + firstIndex;
+    fastgltf::copyFromAccessor<std::uint32_t>(gltf, indexaccessor, indices);
+    rebase_indices(indices, indexaccessor.count, (uint32_t)firstVertex);
+
+    // load vertex attributes
+    const fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
+
+    VertexStreams streams;
+    streams.count = posAccessor.count;
+    streams.positions = copyAttribute(gltf, p, "POSITION", streams.count, scratch.positions);
+    streams.normals = copyAttribute(gltf, p, "NORMAL", streams.count, scratch.normals);
+    streams.uvs = copyAttribute(gltf, p, "TEXCOORD_0", streams.count, scratch.uvs);
+    streams.colors = copyAttribute(gltf, p, "COLOR_0", streams.count, scratch.colors);
+
+    // display the vertex normals
+    constexpr bool OverrideColors = true;
+
+    interleave_vertices(streams, OverrideColors, mesh.vertices.data() + firstVertex);
+}
+
+// Parses and decodes every mesh of a glTF file, runs the post processing passes and bakes
+// the result to the mesh cache
+std::optional<std::vector<MeshData>>
+decodeGltfMeshes(VulkanEngine* engine, const std::filesystem::path& filePath, const std::filesystem::path& cachePath,
+    const MeshLoadOptions& options)
+{
+    std::shared_ptr<spdlog::logger> logger = spdlog::get("vulkan-test");
+
+    LoadClock::time_point loadStart = LoadClock::now();
+
+    std::optional<fastgltf::Asset> parsed = parseGltf(filePath);
+    if (!parsed)
     {
-        logger->error("Failed to load glTF: {}", fastgltf::to_underlying(load.error()));
         return {};
     }
+    fastgltf::Asset& gltf = *parsed;
 
-    // Read all the meshes from the file
-    std::vector<std::shared_ptr<MeshAsset>> meshes;
+    LoadClock::time_point parseEnd = LoadClock::now();
 
-    // use the same vectors for all meshes so that the memory doesnt reallocate as
-    // often
-    std::vector<uint32_t> indices;
-    std::vector<Vertex> vertices;
-    for (fastgltf::Mesh& mesh : gltf.meshes) {
-        MeshAsset newmesh;
+    // Work out where every primitive lands inside its mesh before decoding anything.
+    // Each primitive then owns a fixed range of the index and vertex arrays, which
+    // keeps the output identical no matter what order the primitives finish in.
+    std::vector<MeshData> meshData(gltf.meshes.size());
+    std::vector<PrimitiveJob> jobs;
+    for (size_t meshIndex = 0; meshIndex < gltf.meshes.size(); meshIndex++) {
+        fastgltf::Mesh& mesh = gltf.meshes[meshIndex];
+        MeshData& data = meshData[meshIndex];
 
-        newmesh.name = mesh.name;
+        data.name = mesh.name;
 
-        // clear the mesh arrays each mesh, we dont want to merge them by error
-        indices.clear();
-        vertices.clear();
+        size_t indexCount = 0;
+        size_t vertexCount = 0;
+        for (size_t primitiveIndex = 0; primitiveIndex < mesh.primitives.size(); primitiveIndex++) {
+            fastgltf::Primitive& p = mesh.primitives[primitiveIndex];
 
-        for (auto&& p : mesh.primitives) {
-            GeoSurface newSurface;
-            newSurface.startIndex = (uint32_t)indices.size();
+            auto positions = p.findAttribute("POSITION");
+            if (!p.indicesAccessor.has_value() || positions == p.attributes.end())
+            {
+                logger->error("Mesh [{}] primitive {} is missing indices or positions", data.name, primitiveIndex);
+                return {};
+            }
+
+            GeoSurface newSurface {};
+            newSurface.startIndex = (uint32_t)indexCount;
             newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+            data.surfaces.push_back(newSurface);
+
+            jobs.push_back(PrimitiveJob { meshIndex, primitiveIndex, indexCount, vertexCount });
+
+            indexCount += newSurface.count;
+            vertexCount += gltf.accessors[positions->accessorIndex].count;
+        }
+
+        data.indices.resize(indexCount);
+        data.vertices.resize(vertexCount);
+    }
+
+    auto decodeJob = [&](size_t jobIndex) {
+        const PrimitiveJob& job = jobs[jobIndex];
+        const fastgltf::Mesh& mesh = gltf.meshes[job.meshIndex];
+        decodePrimitive(gltf, mesh.primitives[job.primitiveIndex], meshData[job.meshIndex],
+            job.firstIndex, job.firstVertex);
+    };
+
+    size_t decodeThreads = 1;
+    if (options.parallelDecode)
+    {
+        decodeThreads = std::min(jobs.size(), engine->_workerPool.size() + 1);
+        engine->_workerPool.parallel_for(jobs.size(), decodeJob);
+    }
+    else
+    {
+        for (size_t jobIndex = 0; jobIndex < jobs.size(); jobIndex++)
+        {
+            decodeJob(jobIndex);
+        }
+    }
+
+    LoadClock::time_point decodeEnd = LoadClock::now();
+
+    // Per mesh post processing, everything here needs the whole mesh decoded first
+    std::vector<MeshOptimizeStats> optimizeStats(meshData.size());
+    std::vector<MeshLodStats> lodStats(meshData.size());
+    auto processJob = [&](size_t meshIndex) {
+        MeshData& data = meshData[meshIndex];
+        if (options.optimizeMeshes)
+        {
+            optimizeStats[meshIndex] = optimize_mesh(data);
+        }
+        // simplifies against the float positions, so it runs before packing
+        lodStats[meshIndex] = build_mesh_lods(data, options.generateLods, options.lodMaxError);
+        // needs the float positions for the bounds as well, and the lods so surfaces keep their meshlet range
+        if (options.buildMeshlets)
+        {
+            build_meshlets(data);
+        }
+        if (options.vertexFormat == VertexFormat::Packed)
+        {
+            data.quantization = pack_vertices(data.vertices, data.packedVertices);
+        }
+        data.vertexFormat = options.vertexFormat;
+    };
+
+    if (options.parallelDecode)
+    {
+        engine->_workerPool.parallel_for(meshData.size(), processJob);
+    }
+    else
+    {
+        for (size_t meshIndex = 0; meshIndex < meshData.size(); meshIndex++)
+        {
+            processJob(meshIndex);
+        }
+    }
+
+    LoadClock::time_point processEnd = LoadClock::now();
+
+    if (options.useCache)
+    {
+        if (MeshCache::write(cachePath, filePath, meshData, options))
+        {
+            logger->debug("Wrote mesh cache [{}]", cachePath.string());
+        }
+        else
+        {
+            logger->warn("Failed to write mesh cache [{}]", cachePath.string());
+        }
+    }
+
+    LoadClock::time_point bakeEnd = LoadClock::now();
+
+    size_t totalVertices = 0;
+    size_t totalIndices = 0;
+    for (const MeshData& data : meshData)
+    {
+        totalVertices += data.vertices.size();
+        totalIndices += data.indices.size();
+    }
+
+    logger->info("Decoded {} meshes ({} primitives, {} vertices, {} indices) from [{}] in {:.2f} ms",
+        meshData.size(), jobs.size(), totalVertices, totalIndices, filePath.filename().string(),
+        elapsedMs(loadStart, bakeEnd));
+    logger->info("    parse {:.2f} ms | decode {:.2f} ms ({} threads, {}) | process {:.2f} ms | bake {:.2f} ms",
+        elapsedMs(loadStart, parseEnd), elapsedMs(parseEnd, decodeEnd), decodeThreads, vertex_convert_isa(),
+        elapsedMs(decodeEnd, processEnd), elapsedMs(processEnd, bakeEnd));
+
+    if (options.optimizeMeshes)
+    {
+        MeshOptimizeStats total;
+        for (const MeshOptimizeStats& stats : optimizeStats)
+        {
+            total.before += stats.before;
+            total.after += stats.after;
+        }
+        logger->info("    vertex cache ({} entries): ACMR {:.3f} -> {:.3f} | ATVR {:.3f} -> {:.3f}",
+            VERTEX_CACHE_SIZE, total.before.acmr(), total.after.acmr(), total.before.atvr(), total.after.atvr());
+    }
+
+    if (options.generateLods)
+    {
+        MeshLodStats total;
+        for (const MeshLodStats& stats : lodStats)
+        {
+            total += stats;
+        }
+        for (uint32_t lod = 0; lod < MAX_MESH_LODS && total.surfaces[lod] > 0; lod++)
+        {
+            logger->info("    LOD {}: {} triangles in {} surfaces", lod, total.triangles[lod], total.surfaces[lod]);
+        }
+    }
+
+    if (options.buildMeshlets)
+    {
+        size_t totalMeshlets = 0;
+        for (const MeshData& data : meshData)
+        {
+            totalMeshlets += data.meshlets.size();
+        }
+        logger->info("    meshlets: {} (up to {} vertices, {} triangles)", totalMeshlets, MESHLET_MAX_VERTICES,
+            MESHLET_MAX_TRIANGLES);
+    }
 
-            size_t initial_vtx = vertices.size();
+    return meshData;
+}
+
+} // namespace
+
+std::optional<std::vector<MeshData>>
+loadGltfMeshData(VulkanEngine* engine, std::filesystem::path filePath, const MeshLoadOptions& options)
+{
+    std::shared_ptr<spdlog::logger> logger = spdlog::get("vulkan-test");
+    logger->info("Loading GLTF mesh data: {}", filePath.string());
+
+    std::filesystem::path cachePath;
+    if (options.useCache)
+    {
+        cachePath = MeshCache::cache_path(options.cacheDirectory, filePath);
+
+        MeshCache cache;
+        if (cache.open(cachePath, filePath, options))
+        {
+            LoadClock::time_point loadStart = LoadClock::now();
 
-            // load indexes
+            // The mapping goes away with the cache, so the arrays are copied out
+            std::vector<MeshData> meshData(cache.mesh_count());
+            for (size_t i = 0; i < cache.mesh_count(); i++)
             {
-                fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
-                indices.reserve(indices.size() + indexaccessor.count);
+                CachedMesh cached = cache.mesh(i);
+                MeshData& data = meshData[i];
 
-                fastgltf::iterateAccessor<std::uint32_t>(gltf, indexaccessor,
-                    [&](std::uint32_t idx) {
-                        indices.push_back(idx + initial_vtx);
-                    });
+                data.name = std::string(cached.name);
+                data.surfaces.assign(cached.surfaces.begin(), cached.surfaces.end());
+                data.indices.assign(cached.indices.begin(), cached.indices.end());
+                data.meshlets.assign(cached.meshlets.begin(), cached.meshlets.end());
+                data.vertexFormat = options.vertexFormat;
+                data.quantization = cached.quantization;
+                if (options.vertexFormat == VertexFormat::Packed)
+                {
+                    data.packedVertices.resize(cached.vertexCount);
+                    memcpy(data.packedVertices.data(), cached.vertexData.data(), cached.vertexData.size());
+                }
+                else
+                {
+                    data.vertices.resize(cached.vertexCount);
+                    memcpy(data.vertices.data(), cached.vertexData.data(), cached.vertexData.size());
+                }
             }
 
-            // load vertex positions
+            logger->info("Loaded {} meshes from cache [{}] in {:.2f} ms", meshData.size(), cachePath.string(),
+                elapsedMs(loadStart, LoadClock::now()));
+
+            return meshData;
+        }
+
+        logger->debug("No valid mesh cache at [{}], loading from source", cachePath.string());
+    }
+
+    std::optional<std::vector<MeshData>> meshData = decodeGltfMeshes(engine, filePath, cachePath, options);
+    if (meshData && options.vertexFormat == VertexFormat::Packed)
+    {
+        // only the packed copy is uploaded, do not keep both around
+        for (MeshData& data : *meshData)
+        {
+            data.vertices = {};
+        }
+    }
+
+    return meshData;
+}
+
+namespace
+{
+
+// Images are decoded to 8 bit RGBA whatever their channel count
+constexpr int TEXTURE_CHANNELS = 4;
+
+// Staged textures go to the GPU once this much is pending, so earlier textures are
+// uploaded while the workers are still decoding later ones
+constexpr VkDeviceSize TEXTURE_BATCH_BYTES = 16 * 1024 * 1024;
+
+struct DecodedImage
+{
+    // RGBA8 pixels, for textures uploaded without compression
+    stbi_uc* pixels {nullptr};
+    int width {0};
+    int height {0};
+
+    // Block compressed mip chain instead of pixels, mapped from the cache or fresh from the encoder
+    std::unique_ptr<TextureCache> cached;
+    std::optional<CompressedTexture> compressed;
+    bool cacheWriteFailed {false};
+
+    // set when there is neither, stb keeps its failure reason per thread
+    const char* failure {nullptr};
+    double decodeMs {0.0};
+    double compressMs {0.0};
+};
+
+// How every image of one load is imported, shared by the workers
+struct TextureImportSettings
+{
+    // None when uploading RGBA8, never None otherwise
+    TextureCompression compression;
+    bool mipmapped;
+    bool useCache;
+    std::filesystem::path cacheDirectory;
+};
+
+std::span<const std::byte>
+bufferBytes(const fastgltf::Buffer& buffer)
+{
+    return std::visit(fastgltf::visitor {
+        [](const fastgltf::sources::Array& array) { return std::span<const std::byte>(array.bytes.data(), array.bytes.size()); },
+        [](const fastgltf::sources::Vector& vector) { return std::span<const std::byte>(vector.bytes.data(), vector.bytes.size()); },
+        [](const auto&) { return std::span<const std::byte>(); },
+    }, buffer.data);
+}
+
+bool
+readFile(const std::filesystem::path& path, std::vector<std::byte>& bytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    bytes.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), (std::streamsize)bytes.size());
+    return file.good();
+}
+
+// Encoded bytes of an image from wherever the glTF keeps it, files are read into fileBytes.
+// Empty with failure set when the image can not be read.
+std::span<const std::byte>
+imageBytes(const fastgltf::Asset& gltf, const fastgltf::Image& image, const std::filesystem::path& directory,
+    std::vector<std::byte>& fileBytes, const char*& failure)
+{
+    return std::visit(fastgltf::visitor {
+        [&](const fastgltf::sources::URI& uri) {
+            // only whole files next to the glTF
+            if (uri.fileByteOffset != 0 || !uri.uri.isLocalPath())
+            {
+                failure = "not a local file";
+                return std::span<const std::byte>();
+            }
+            if (!readFile(directory / uri.uri.fspath(), fileBytes))
             {
-                fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-                vertices.resize(vertices.size() + posAccessor.count);
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-                    [&](glm::vec3 v, size_t index) {
-                        Vertex newvtx;
-                        newvtx.position = v;
-                        newvtx.normal = { 1, 0, 0 };
-                        newvtx.color = glm::vec4 { 1.f };
-                        newvtx.uv_x = 0;
-                        newvtx.uv_y = 0;
-                        vertices[initial_vtx + index] = newvtx;
-                    });
+                failure = "can't read file";
+                return std::span<const std::byte>();
             }
+            return std::span<const std::byte>(fileBytes);
+        },
+        [&](const fastgltf::sources::Array& array) {
+            return std::span<const std::byte>(array.bytes.data(), array.bytes.size());
+        },
+        [&](const fastgltf::sources::Vector& vector) {
+            return std::span<const std::byte>(vector.bytes.data(), vector.bytes.size());
+        },
+        [&](const fastgltf::sources::BufferView& view) {
+            const fastgltf::BufferView& bufferView = gltf.bufferViews[view.bufferViewIndex];
+            std::span<const std::byte> bytes = bufferBytes(gltf.buffers[bufferView.bufferIndex]);
+            if (bufferView.byteOffset + bufferView.byteLength > bytes.size())
+            {
+                failure = "buffer view out of range";
+                return std::span<const std::byte>();
+            }
+            return bytes.subspan(bufferView.byteOffset, bufferView.byteLength);
+        },
+        [&](const auto&) {
+            failure = "unsupported image source";
+            return std::span<const std::byte>();
+        },
+    }, image.data);
+}
+
+// Decodes an image to RGBA8, or to a block compressed mip chain when settings ask for one.
+// Compressed chains come from the cache when an image with the same contents was imported before.
+DecodedImage
+decodeImage(const fastgltf::Asset& gltf, const fastgltf::Image& image, const std::filesystem::path& directory,
+    bool srgb, const TextureImportSettings& settings)
+{
+    LoadClock::time_point decodeStart = LoadClock::now();
+
+    DecodedImage decoded;
+    std::vector<std::byte> fileBytes;
+    std::span<const std::byte> bytes = imageBytes(gltf, image, directory, fileBytes, decoded.failure);
+    if (bytes.empty())
+    {
+        decoded.failure = decoded.failure ? decoded.failure : "empty image";
+        decoded.decodeMs = elapsedMs(decodeStart, LoadClock::now());
+        return decoded;
+    }
+
+    TextureCacheKey key {};
+    std::filesystem::path cachePath;
+    if (settings.compression != TextureCompression::None && settings.useCache)
+    {
+        key = TextureCacheKey { TextureCache::content_hash(bytes), settings.compression, srgb, settings.mipmapped };
+        cachePath = TextureCache::cache_path(settings.cacheDirectory, key);
+
+        std::unique_ptr<TextureCache> cache = std::make_unique<TextureCache>();
+        if (cache->open(cachePath, key))
+        {
+            decoded.width = (int)cache->extent().width;
+            decoded.height = (int)cache->extent().height;
+            decoded.cached = std::move(cache);
+            decoded.decodeMs = elapsedMs(decodeStart, LoadClock::now());
+            return decoded;
+        }
+    }
+
+    int channels;
+    decoded.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()), (int)bytes.size(),
+        &decoded.width, &decoded.height, &channels, TEXTURE_CHANNELS);
+    LoadClock::time_point decodeEnd = LoadClock::now();
+    decoded.decodeMs = elapsedMs(decodeStart, decodeEnd);
+    if (!decoded.pixels)
+    {
+        decoded.failure = stbi_failure_reason();
+        return decoded;
+    }
+
+    if (settings.compression == TextureCompression::None)
+    {
+        return decoded;
+    }
 
-            // load vertex normals
-            auto normals = p.findAttribute("NORMAL");
-            if (normals != p.attributes.end()) {
+    const VkExtent2D extent { (uint32_t)decoded.width, (uint32_t)decoded.height };
+    const size_t texelCount = (size_t)decoded.width * decoded.height;
+    TextureCompression compression = resolve_compression(settings.compression, decoded.pixels, texelCount);
+    decoded.compressed = compress_texture(decoded.pixels, extent, compression, srgb, settings.mipmapped);
+    stbi_image_free(decoded.pixels);
+    decoded.pixels = nullptr;
 
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[normals->accessorIndex],
-                    [&](glm::vec3 v, size_t index) {
-                        vertices[initial_vtx + index].normal = v;
-                    });
+    if (settings.useCache)
+    {
+        decoded.cacheWriteFailed = !TextureCache::write(cachePath, key, extent, *decoded.compressed);
+    }
+    decoded.compressMs = elapsedMs(decodeEnd, LoadClock::now());
+    return decoded;
+}
+
+} // namespace
+
+std::optional<std::vector<std::shared_ptr<TextureAsset>>>
+loadGltfTextures(VulkanEngine* engine, std::filesystem::path filePath, const TextureLoadOptions& options)
+{
+    std::shared_ptr<spdlog::logger> logger = spdlog::get("vulkan-test");
+
+    LoadClock::time_point loadStart = LoadClock::now();
+
+    std::optional<fastgltf::Asset> parsed = parseGltf(filePath);
+    if (!parsed)
+    {
+        return {};
+    }
+    const fastgltf::Asset& gltf = *parsed;
+
+    LoadClock::time_point parseEnd = LoadClock::now();
+
+    // Color textures are sampled as sRGB, the rest (normals, metallic roughness, occlusion) is linear data
+    std::vector<bool> srgb(gltf.images.size(), false);
+    auto markSrgb = [&](const auto& textureInfo) {
+        if (textureInfo && textureInfo->textureIndex < gltf.textures.size())
+        {
+            const fastgltf::Texture& texture = gltf.textures[textureInfo->textureIndex];
+            if (texture.imageIndex && *texture.imageIndex < srgb.size())
+            {
+                srgb[*texture.imageIndex] = true;
             }
+        }
+    };
+    for (const fastgltf::Material& material : gltf.materials)
+    {
+        markSrgb(material.pbrData.baseColorTexture);
+        markSrgb(material.emissiveTexture);
+    }
+
+    const std::filesystem::path directory = filePath.parent_path();
 
-            // load UVs
-            auto uv = p.findAttribute("TEXCOORD_0");
-            if (uv != p.attributes.end()) {
+    TextureImportSettings settings;
+    settings.compression = options.compression;
+    settings.mipmapped = options.generateMipmaps;
+    settings.useCache = options.useCache;
+    settings.cacheDirectory = directory / options.cacheDirectory;
+    if (settings.compression != TextureCompression::None && !engine->_textureCompressionBC)
+    {
+        logger->info("Device can't sample BC formats, uploading the textures of [{}] as RGBA8",
+            filePath.filename().string());
+        settings.compression = TextureCompression::None;
+    }
 
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[uv->accessorIndex],
-                    [&](glm::vec2 v, size_t index) {
-                        vertices[initial_vtx + index].uv_x = v.x;
-                        vertices[initial_vtx + index].uv_y = v.y;
-                    });
+    // Workers hand the images over as they finish, in whatever order that is
+    std::vector<DecodedImage> decoded(gltf.images.size());
+    std::queue<size_t> decodedQueue;
+    std::mutex decodedMutex;
+    std::condition_variable decodedCondition;
+
+    if (options.parallelDecode)
+    {
+        for (size_t imageIndex = 0; imageIndex < gltf.images.size(); imageIndex++)
+        {
+            engine->_workerPool.submit([&, imageIndex]() {
+                DecodedImage image = decodeImage(gltf, gltf.images[imageIndex], directory, srgb[imageIndex], settings);
+
+                // notified under the lock, the waiting thread may return as soon as it sees the last image
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                decoded[imageIndex] = std::move(image);
+                decodedQueue.push(imageIndex);
+                decodedCondition.notify_one();
+            });
+        }
+    }
+
+    // Stage every image as soon as it is decoded and upload in batches, the GPU copies
+    // and mip blits of one batch run while the workers decode the next
+    TextureUploadBatch uploadBatch(engine);
+    std::vector<std::shared_ptr<TextureAsset>> textures(gltf.images.size());
+    size_t loadedCount = 0;
+    size_t loadedBytes = 0;
+    size_t compressedCount = 0;
+    size_t cacheHits = 0;
+    // what the compressed textures would have taken as RGBA8 with a full mip chain
+    size_t uncompressedBytes = 0;
+    double decodeMs = 0.0;
+    double compressMs = 0.0;
+    double uploadMs = 0.0;
+
+    auto flushBatch = [&]() {
+        LoadClock::time_point uploadStart = LoadClock::now();
+        uploadBatch.flush();
+        uploadMs += elapsedMs(uploadStart, LoadClock::now());
+    };
+
+    for (size_t received = 0; received < gltf.images.size(); received++)
+    {
+        size_t imageIndex = received;
+        if (options.parallelDecode)
+        {
+            std::unique_lock<std::mutex> lock(decodedMutex);
+            decodedCondition.wait(lock, [&]() { return !decodedQueue.empty(); });
+            imageIndex = decodedQueue.front();
+            decodedQueue.pop();
+        }
+        else
+        {
+            decoded[imageIndex] = decodeImage(gltf, gltf.images[imageIndex], directory, srgb[imageIndex], settings);
+        }
+
+        DecodedImage& image = decoded[imageIndex];
+        decodeMs += image.decodeMs;
+        compressMs += image.compressMs;
+        if (image.cacheWriteFailed)
+        {
+            logger->warn("Failed to write texture cache for image {} of [{}]", imageIndex, filePath.filename().string());
+        }
+
+        if (image.cached || image.compressed)
+        {
+            std::span<const std::byte> data;
+            std::span<const TextureMipLevel> mips;
+            TextureCompression compression;
+            if (image.cached)
+            {
+                data = image.cached->data();
+                mips = image.cached->mips();
+                compression = image.cached->compression();
+            }
+            else
+            {
+                data = image.compressed->data;
+                mips = image.compressed->mips;
+                compression = image.compressed->compression;
             }
+            const VkExtent2D extent { (uint32_t)image.width, (uint32_t)image.height };
 
-            // load vertex colors
-            auto colors = p.findAttribute("COLOR_0");
-            if (colors != p.attributes.end()) {
+            std::shared_ptr<TextureAsset> texture = std::make_shared<TextureAsset>();
+            texture->name = gltf.images[imageIndex].name;
+            texture->image = uploadBatch.add_compressed(data, mips, extent, bc_format(compression, srgb[imageIndex]));
+            textures[imageIndex] = texture;
 
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[colors->accessorIndex],
-                    [&](glm::vec4 v, size_t index) {
-                        vertices[initial_vtx + index].color = v;
-                    });
+            loadedCount++;
+            loadedBytes += data.size();
+            compressedCount++;
+            cacheHits += image.cached ? 1 : 0;
+            for (const TextureMipLevel& mip : mips)
+            {
+                uncompressedBytes += (size_t)mip.width * mip.height * TEXTURE_CHANNELS;
             }
-            newmesh.surfaces.push_back(newSurface);
+
+            // the blocks live in staging memory now
+            image.cached.reset();
+            image.compressed.reset();
+
+            if (uploadBatch.pending_bytes() >= TEXTURE_BATCH_BYTES)
+            {
+                flushBatch();
+            }
+            continue;
+        }
+
+        if (!image.pixels)
+        {
+            logger->warn("Failed to decode image {} [{}] of [{}]: {}", imageIndex, gltf.images[imageIndex].name,
+                filePath.filename().string(), image.failure ? image.failure : "unknown error");
+            continue;
         }
 
-        // display the vertex normals
-        constexpr bool OverrideColors = true;
-        if (OverrideColors) {
-            for (Vertex& vtx : vertices) {
-                vtx.color = glm::vec4(vtx.normal, 1.f);
+        const size_t byteCount = (size_t)image.width * image.height * TEXTURE_CHANNELS;
+        const VkFormat format = srgb[imageIndex] ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+
+        std::shared_ptr<TextureAsset> texture = std::make_shared<TextureAsset>();
+        texture->name = gltf.images[imageIndex].name;
+        texture->image = uploadBatch.add(std::as_bytes(std::span(image.pixels, byteCount)),
+            VkExtent2D { (uint32_t)image.width, (uint32_t)image.height }, format, options.generateMipmaps);
+        textures[imageIndex] = texture;
+
+        // the pixels live in staging memory now
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+
+        loadedCount++;
+        loadedBytes += byteCount;
+
+        if (uploadBatch.pending_bytes() >= TEXTURE_BATCH_BYTES)
+        {
+            flushBatch();
+        }
+    }
+    flushBatch();
+
+    LoadClock::time_point loadEnd = LoadClock::now();
+
+    logger->info("Loaded {} of {} textures ({:.2f} MB) from [{}] in {:.2f} ms", loadedCount, gltf.images.size(),
+        loadedBytes / (1024.0 * 1024.0), filePath.filename().string(), elapsedMs(loadStart, loadEnd));
+    logger->info("    parse {:.2f} ms | decode {:.2f} ms of work ({} threads) | upload and mips {:.2f} ms",
+        elapsedMs(loadStart, parseEnd), decodeMs, options.parallelDecode ? engine->_workerPool.size() : 1, uploadMs);
+    if (compressedCount > 0)
+    {
+        logger->info("    {} block compressed ({} from cache) | {:.2f} MB instead of {:.2f} MB | compress {:.2f} ms of work",
+            compressedCount, cacheHits, loadedBytes / (1024.0 * 1024.0), uncompressedBytes / (1024.0 * 1024.0), compressMs);
+    }
+
+    return textures;
+}
+
+std::optional<SceneGraph>
+loadGltfScene(std::filesystem::path filePath)
+{
+    std::shared_ptr<spdlog::logger> logger = spdlog::get("vulkan-test");
+
+    LoadClock::time_point loadStart = LoadClock::now();
+
+    std::optional<fastgltf::Asset> parsed = parseGltf(filePath);
+    if (!parsed)
+    {
+        return {};
+    }
+    const fastgltf::Asset& gltf = *parsed;
+
+    std::vector<size_t> roots;
+    if (!gltf.scenes.empty())
+    {
+        const fastgltf::Scene& scene = gltf.scenes[gltf.defaultScene.value_or(0)];
+        roots.assign(scene.nodeIndices.begin(), scene.nodeIndices.end());
+    }
+    else
+    {
+        std::vector<bool> isChild(gltf.nodes.size(), false);
+        for (const fastgltf::Node& node : gltf.nodes)
+        {
+            for (size_t child : node.children)
+            {
+                if (child < isChild.size())
+                {
+                    isChild[child] = true;
+                }
             }
         }
-        newmesh.meshBuffers = engine->uploadMesh(indices, vertices);
+        for (size_t nodeIndex = 0; nodeIndex < gltf.nodes.size(); nodeIndex++)
+        {
+            if (!isChild[nodeIndex])
+            {
+                roots.push_back(nodeIndex);
+            }
+        }
+    }
 
-        meshes.emplace_back(std::make_shared<MeshAsset>(std::move(newmesh)));
+    // Depth first with an explicit stack, so deep hierarchies can not overflow the call stack.
+    // Children are pushed in reverse to keep their glTF order. A broken file could reference
+    // a node twice, each node is only added the first time.
+    struct PendingNode
+    {
+        size_t gltfNode;
+        uint32_t parent;
+    };
+    std::vector<PendingNode> stack;
+    for (auto root = roots.rbegin(); root != roots.rend(); root++)
+    {
+        stack.push_back(PendingNode { *root, SCENE_NO_PARENT });
+    }
+
+    SceneGraph scene;
+    std::vector<bool> visited(gltf.nodes.size(), false);
+    while (!stack.empty())
+    {
+        PendingNode pending = stack.back();
+        stack.pop_back();
+        if (pending.gltfNode >= gltf.nodes.size() || visited[pending.gltfNode])
+        {
+            logger->warn("Skipping invalid or repeated node {} in [{}]", pending.gltfNode, filePath.filename().string());
+            continue;
+        }
+        visited[pending.gltfNode] = true;
+
+        const fastgltf::Node& node = gltf.nodes[pending.gltfNode];
+
+        glm::vec3 translation {0.f};
+        glm::quat rotation {1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale {1.f};
+        std::visit(fastgltf::visitor {
+            [&](const fastgltf::TRS& trs) {
+                translation = glm::vec3(trs.translation[0], trs.translation[1], trs.translation[2]);
+                // glTF stores x, y, z, w
+                rotation = glm::quat(trs.rotation[3], trs.rotation[0], trs.rotation[1], trs.rotation[2]);
+                scale = glm::vec3(trs.scale[0], trs.scale[1], trs.scale[2]);
+            },
+            [&](const fastgltf::math::fmat4x4& matrix) {
+                glm::vec3 skew;
+                glm::vec4 perspective;
+                glm::decompose(glm::make_mat4(matrix.data()), scale, rotation, translation, skew, perspective);
+            },
+        }, node.transform);
+
+        int32_t mesh = SCENE_NO_MESH;
+        if (node.meshIndex && *node.meshIndex < gltf.meshes.size())
+        {
+            mesh = (int32_t)*node.meshIndex;
+        }
+
+        uint32_t sceneNode = scene.add_node(node.name, pending.parent, translation, rotation, scale, mesh);
+        for (auto child = node.children.rbegin(); child != node.children.rend(); child++)
+        {
+            stack.push_back(PendingNode { *child, sceneNode });
+        }
     }
 
-    return meshes;
+    scene.update_transforms();
+
+    logger->info("Loaded scene of [{}] with {} nodes ({} with meshes) in {:.2f} ms", filePath.filename().string(),
+        scene.size(), scene.mesh_nodes().size(), elapsedMs(loadStart, LoadClock::now()));
+
+    return scene;
 }
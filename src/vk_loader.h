@@ -1,12 +1,51 @@
 #pragma once
 
 #include <vk_types.h>
+#include <vk_scene.h>
 #include <unordered_map>
 #include <filesystem>
 
+// Detail levels a surface can have, including the full detail one
+constexpr uint32_t MAX_MESH_LODS = 4;
+
+// Index range of one simplified version of a surface
+struct GeoLod {
+    uint32_t startIndex;
+    uint32_t count;
+    // Geometric error of the simplification, relative to the surface bounding radius
+    float error;
+};
+
 struct GeoSurface {
     uint32_t startIndex;
     uint32_t count;
+
+    // Bounding sphere, xyz is the center and w the radius
+    glm::vec4 bounds;
+
+    // lods[0] is the surface itself, every further level has fewer triangles
+    uint32_t lodCount;
+    GeoLod lods[MAX_MESH_LODS];
+
+    // Meshlets covering lods[0], in the meshlets array of the mesh
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+};
+
+// CPU side copy of a mesh as decoded from the source file
+struct MeshData {
+    std::string name;
+
+    std::vector<GeoSurface> surfaces;
+    std::vector<uint32_t> indices;
+    std::vector<Vertex> vertices;
+
+    // Compressed copy of vertices, used when loading with VertexFormat::Packed
+    VertexFormat vertexFormat {VertexFormat::Standard};
+    std::vector<PackedVertex> packedVertices;
+    VertexQuantization quantization;
+
+    std::vector<Meshlet> meshlets;
 };
 
 struct MeshAsset {
@@ -16,8 +55,70 @@ struct MeshAsset {
     GPUMeshBuffers meshBuffers;
 };
 
+// A glTF image on the GPU, sampled read only
+struct TextureAsset {
+    std::string name;
+
+    AllocatedImage image;
+    // slot in the engine's bindless table, nothing when it was full
+    std::optional<uint32_t> bindlessSlot;
+};
+
+struct TextureLoadOptions {
+    // Decode images on the engine worker pool, uploads start as soon as the first one is done
+    bool parallelDecode {true};
+
+    // Build a full mip chain, on the CPU for compressed textures and blitted on the GPU otherwise
+    bool generateMipmaps {true};
+
+    // Block compress the images on import and upload them as VK_FORMAT_BC* images.
+    // Falls back to RGBA8 when the device can not sample BC formats.
+    TextureCompression compression {TextureCompression::Auto};
+
+    // Keep the compressed mip chains in cacheDirectory next to the source asset, keyed
+    // by a hash of the image contents, so importing the same image again skips the encoder
+    bool useCache {true};
+    std::filesystem::path cacheDirectory {"texture_cache"};
+};
+
+struct MeshLoadOptions {
+    // Decode meshes (and each of their primitives) on the engine worker pool
+    bool parallelDecode {true};
+
+    // Reorder triangles and vertices for the vertex cache, overdraw and vertex fetch
+    bool optimizeMeshes {true};
+
+    // Build simplified index ranges of every surface for drawing at a distance.
+    // Levels stop once the error would exceed lodMaxError times the surface radius.
+    bool generateLods {true};
+    float lodMaxError {0.1f};
+
+    // Split every surface into meshlets for GPU cluster culling
+    bool buildMeshlets {true};
+
+    // Layout of the uploaded vertex buffers. Packed vertices are a third of the size.
+    VertexFormat vertexFormat {VertexFormat::Standard};
+
+    // Bake the decoded meshes to disk and map that file on later loads instead
+    // of parsing the glTF again
+    bool useCache {true};
+    std::filesystem::path cacheDirectory {"cache"};
+};
+
 //forward declaration
 class VulkanEngine;
 
 // Functions
-std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath);
+// Loads the CPU side mesh data only, for uploading later (see MeshResidency).
+// Packed meshes only keep their packedVertices.
+std::optional<std::vector<MeshData>> loadGltfMeshData(VulkanEngine* engine, std::filesystem::path filePath,
+    const MeshLoadOptions& options = {});
+
+// Decodes every image of a glTF file and uploads it. Entries are in glTF image order,
+// images that failed to decode are left null.
+std::optional<std::vector<std::shared_ptr<TextureAsset>>> loadGltfTextures(VulkanEngine* engine,
+    std::filesystem::path filePath, const TextureLoadOptions& options = {});
+
+// Flattens the node hierarchy of the default scene (or of every root node when the file has
+// no scenes). Mesh indices of the nodes match the order of loadGltfMeshData.
+std::optional<SceneGraph> loadGltfScene(std::filesystem::path filePath);
@@ -0,0 +1,511 @@
+#include <vk_mesh_cache.h>
+
+#include <vk_vertex_format.h>
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+constexpr uint32_t MESH_CACHE_MAGIC = 0x434D4B56; // "VKMC"
+// Bump whenever the file layout or the baked vertex data changes
+constexpr uint32_t MESH_CACHE_VERSION = 5;
+// Every array starts on this boundary so it can be used straight from the mapping
+constexpr uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexFormat;
+    uint32_t vertexSize;
+    uint32_t surfaceSize;
+    uint32_t bakeFlags;
+    // Error limit of the baked levels of detail, 0 when there are none
+    float lodMaxError;
+    uint32_t padding;
+    uint64_t meshCount;
+    uint64_t fileSize;
+
+    // Identifies the source asset this cache was baked from
+    uint64_t sourcePathHash;
+    uint64_t sourceSize;
+    int64_t sourceWriteTime;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t nameOffset;
+    uint64_t nameLength;
+    uint64_t surfaceOffset;
+    uint64_t surfaceCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t meshletOffset;
+    uint64_t meshletCount;
+    VertexQuantization quantization;
+};
+
+// Load options that change the baked data, a cache only matches loads with the same flags
+enum BakeFlags : uint32_t
+{
+    BAKE_OPTIMIZED = 1 << 0,
+    BAKE_LODS = 1 << 1,
+    BAKE_MESHLETS = 1 << 2,
+};
+
+uint32_t
+bake_flags(const MeshLoadOptions& options)
+{
+    uint32_t flags = 0;
+    if (options.optimizeMeshes)
+    {
+        flags |= BAKE_OPTIMIZED;
+    }
+    if (options.generateLods)
+    {
+        flags |= BAKE_LODS;
+    }
+    if (options.buildMeshlets)
+    {
+        flags |= BAKE_MESHLETS;
+    }
+    return flags;
+}
+
+float
+baked_lod_error(const MeshLoadOptions& options)
+{
+    return options.generateLods ? options.lodMaxError : 0.f;
+}
+
+// The draw path indexes lods[] with lodCount and the GPU reads the index ranges of the meshlets,
+// so a damaged file must not get past open()
+bool
+surfaces_valid(const GeoSurface* surfaces, uint64_t surfaceCount, uint64_t indexCount, uint64_t meshletCount)
+{
+    for (uint64_t i = 0; i < surfaceCount; i++)
+    {
+        const GeoSurface& surface = surfaces[i];
+        if (surface.lodCount == 0 || surface.lodCount > MAX_MESH_LODS
+            || surface.firstMeshlet > meshletCount || surface.meshletCount > meshletCount - surface.firstMeshlet)
+        {
+            return false;
+        }
+        for (uint32_t lod = 0; lod < surface.lodCount; lod++)
+        {
+            const GeoLod& level = surface.lods[lod];
+            if (level.startIndex > indexCount || level.count > indexCount - level.startIndex)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool
+meshlets_valid(const Meshlet* meshlets, uint64_t meshletCount, uint64_t indexCount)
+{
+    return std::all_of(meshlets, meshlets + meshletCount, [&](const Meshlet& meshlet) {
+        return meshlet.firstIndex <= indexCount && meshlet.indexCount <= indexCount - meshlet.firstIndex;
+    });
+}
+
+struct SourceKey
+{
+    uint64_t pathHash;
+    uint64_t size;
+    int64_t writeTime;
+};
+
+uint64_t
+fnv1a(std::string_view data)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : data)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t
+path_hash(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    std::filesystem::path fullPath = std::filesystem::weakly_canonical(path, ec);
+    if (ec)
+    {
+        fullPath = std::filesystem::absolute(path);
+    }
+    return fnv1a(fullPath.generic_string());
+}
+
+std::optional<SourceKey>
+source_key(const std::filesystem::path& sourcePath)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(sourcePath, ec);
+    if (ec)
+    {
+        return {};
+    }
+
+    auto writeTime = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec)
+    {
+        return {};
+    }
+
+    return SourceKey { path_hash(sourcePath), size, (int64_t)writeTime.time_since_epoch().count() };
+}
+
+uint64_t
+align_up(uint64_t value)
+{
+    return (value + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Checks an array lies fully inside the file, without overflowing on garbage input
+bool
+range_in_file(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+    if (offset > fileSize || offset % MESH_CACHE_ALIGNMENT != 0)
+    {
+        return false;
+    }
+    return count <= (fileSize - offset) / elementSize;
+}
+
+} // namespace
+
+/*******************************************************
+ * MappedFile
+ ******************************************************/
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool
+MappedFile::open(const std::filesystem::path& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    _fileHandle = file;
+    _mappingHandle = mapping;
+    _data = static_cast<const std::byte*>(view);
+    _size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _data = static_cast<const std::byte*>(view);
+    _size = (size_t)fileStat.st_size;
+#endif
+
+    return true;
+}
+
+void
+MappedFile::close()
+{
+    if (_data == nullptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mappingHandle);
+    CloseHandle(_fileHandle);
+    _mappingHandle = nullptr;
+    _fileHandle = nullptr;
+#else
+    munmap(const_cast<std::byte*>(_data), _size);
+#endif
+
+    _data = nullptr;
+    _size = 0;
+}
+
+/*******************************************************
+ * MeshCache
+ ******************************************************/
+std::filesystem::path
+MeshCache::cache_path(const std::filesystem::path& cacheDirectory, const std::filesystem::path& sourcePath)
+{
+    std::string fileName = fmt::format("{}-{:016x}.meshcache", sourcePath.stem().string(), path_hash(sourcePath));
+    return cacheDirectory / fileName;
+}
+
+bool
+MeshCache::open(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath,
+    const MeshLoadOptions& options)
+{
+    close();
+
+    std::optional<SourceKey> key = source_key(sourcePath);
+    if (!key || !_file.open(cachePath))
+    {
+        return false;
+    }
+
+    const uint64_t fileSize = _file.size();
+    if (fileSize < sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(_file.data());
+    bool valid = header->magic == MESH_CACHE_MAGIC
+        && header->version == MESH_CACHE_VERSION
+        && header->vertexFormat == (uint32_t)options.vertexFormat
+        && header->vertexSize == vertex_stride(options.vertexFormat)
+        && header->bakeFlags == bake_flags(options)
+        && header->lodMaxError == baked_lod_error(options)
+        && header->surfaceSize == sizeof(GeoSurface)
+        && header->fileSize == fileSize
+        && header->sourcePathHash == key->pathHash
+        && header->sourceSize == key->size
+        && header->sourceWriteTime == key->writeTime
+        && header->meshCount <= (fileSize - sizeof(MeshCacheHeader)) / sizeof(MeshCacheEntry);
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+
+    const MeshCacheEntry* entries = reinterpret_cast<const MeshCacheEntry*>(_file.data() + sizeof(MeshCacheHeader));
+    for (uint64_t i = 0; i < header->meshCount; i++)
+    {
+        const MeshCacheEntry& entry = entries[i];
+        valid = entry.nameOffset <= fileSize && entry.nameLength <= fileSize - entry.nameOffset
+            && range_in_file(entry.surfaceOffset, entry.surfaceCount, sizeof(GeoSurface), fileSize)
+            && range_in_file(entry.indexOffset, entry.indexCount, sizeof(uint32_t), fileSize)
+            && range_in_file(entry.vertexOffset, entry.vertexCount, header->vertexSize, fileSize)
+            && range_in_file(entry.meshletOffset, entry.meshletCount, sizeof(Meshlet), fileSize)
+            && surfaces_valid(reinterpret_cast<const GeoSurface*>(_file.data() + entry.surfaceOffset),
+                entry.surfaceCount, entry.indexCount, entry.meshletCount)
+            && meshlets_valid(reinterpret_cast<const Meshlet*>(_file.data() + entry.meshletOffset),
+                entry.meshletCount, entry.indexCount);
+        if (!valid)
+        {
+            close();
+            return false;
+        }
+    }
+
+    _meshCount = header->meshCount;
+    _vertexSize = header->vertexSize;
+    return true;
+}
+
+void
+MeshCache::close()
+{
+    _file.close();
+    _meshCount = 0;
+    _vertexSize = 0;
+}
+
+CachedMesh
+MeshCache::mesh(size_t index) const
+{
+    const std::byte* base = _file.data();
+    const MeshCacheEntry& entry = reinterpret_cast<const MeshCacheEntry*>(base + sizeof(MeshCacheHeader))[index];
+
+    CachedMesh mesh;
+    mesh.name = std::string_view(reinterpret_cast<const char*>(base + entry.nameOffset), entry.nameLength);
+    mesh.surfaces = { reinterpret_cast<const GeoSurface*>(base + entry.surfaceOffset), entry.surfaceCount };
+    mesh.indices = { reinterpret_cast<const uint32_t*>(base + entry.indexOffset), entry.indexCount };
+    mesh.vertexData = { base + entry.vertexOffset, entry.vertexCount * _vertexSize };
+    mesh.vertexCount = entry.vertexCount;
+    mesh.quantization = entry.quantization;
+    mesh.meshlets = { reinterpret_cast<const Meshlet*>(base + entry.meshletOffset), entry.meshletCount };
+    return mesh;
+}
+
+bool
+MeshCache::write(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath,
+    std::span<const MeshData> meshes, const MeshLoadOptions& options)
+{
+    const VertexFormat vertexFormat = options.vertexFormat;
+    const size_t vertexSize = vertex_stride(vertexFormat);
+    auto vertexData = [vertexFormat](const MeshData& mesh) {
+        return vertexFormat == VertexFormat::Packed
+            ? std::as_bytes(std::span(mesh.packedVertices))
+            : std::as_bytes(std::span(mesh.vertices));
+    };
+
+    std::optional<SourceKey> key = source_key(sourcePath);
+    if (!key)
+    {
+        return false;
+    }
+
+    // Lay the file out up front: header, mesh table, then the arrays of each mesh
+    std::vector<MeshCacheEntry> entries(meshes.size());
+    uint64_t offset = sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry) * meshes.size();
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const MeshData& mesh = meshes[i];
+        MeshCacheEntry& entry = entries[i];
+
+        entry.nameOffset = offset;
+        entry.nameLength = mesh.name.size();
+        offset = align_up(offset + entry.nameLength);
+
+        entry.surfaceOffset = offset;
+        entry.surfaceCount = mesh.surfaces.size();
+        offset = align_up(offset + entry.surfaceCount * sizeof(GeoSurface));
+
+        entry.indexOffset = offset;
+        entry.indexCount = mesh.indices.size();
+        offset = align_up(offset + entry.indexCount * sizeof(uint32_t));
+
+        entry.vertexOffset = offset;
+        entry.vertexCount = vertexData(mesh).size() / vertexSize;
+        entry.quantization = mesh.quantization;
+        offset = align_up(offset + entry.vertexCount * vertexSize);
+
+        entry.meshletOffset = offset;
+        entry.meshletCount = mesh.meshlets.size();
+        offset = align_up(offset + entry.meshletCount * sizeof(Meshlet));
+    }
+
+    MeshCacheHeader header {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexFormat = (uint32_t)vertexFormat;
+    header.vertexSize = (uint32_t)vertexSize;
+    header.bakeFlags = bake_flags(options);
+    header.lodMaxError = baked_lod_error(options);
+    header.surfaceSize = sizeof(GeoSurface);
+    header.meshCount = meshes.size();
+    header.fileSize = offset;
+    header.sourcePathHash = key->pathHash;
+    header.sourceSize = key->size;
+    header.sourceWriteTime = key->writeTime;
+
+    std::error_code ec;
+    std::filesystem::create_directories(cachePath.parent_path(), ec);
+
+    // Write next to the final file and swap it in, so a crash never leaves a half written cache
+    std::filesystem::path tempPath = cachePath;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        uint64_t written = 0;
+        auto writeBytes = [&](const void* data, uint64_t size) {
+            file.write(static_cast<const char*>(data), (std::streamsize)size);
+            written += size;
+        };
+        auto pad = [&]() {
+            static constexpr char zeros[MESH_CACHE_ALIGNMENT] = {};
+            writeBytes(zeros, align_up(written) - written);
+        };
+
+        writeBytes(&header, sizeof(header));
+        writeBytes(entries.data(), sizeof(MeshCacheEntry) * entries.size());
+        for (const MeshData& mesh : meshes)
+        {
+            writeBytes(mesh.name.data(), mesh.name.size());
+            pad();
+            writeBytes(mesh.surfaces.data(), mesh.surfaces.size() * sizeof(GeoSurface));
+            pad();
+            writeBytes(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+            pad();
+            writeBytes(vertexData(mesh).data(), vertexData(mesh).size());
+            pad();
+            writeBytes(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+            pad();
+        }
+
+        if (!file.good() || written != header.fileSize)
+        {
+            file.close();
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+#include <filesystem>
+#include <string_view>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& path);
+    void close();
+
+    const std::byte* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const std::byte* _data {nullptr};
+    size_t _size {0};
+
+#ifdef _WIN32
+    void* _fileHandle {nullptr};
+    void* _mappingHandle {nullptr};
+#endif
+};
+
+// View of one mesh inside a mapped cache file, valid while the cache stays open
+struct CachedMesh
+{
+    std::string_view name;
+
+    std::span<const GeoSurface> surfaces;
+    std::span<const uint32_t> indices;
+
+    // Vertex or PackedVertex array, depending on the format the cache was baked with
+    std::span<const std::byte> vertexData;
+    size_t vertexCount;
+    VertexQuantization quantization;
+
+    std::span<const Meshlet> meshlets;
+};
+
+// Baked copy of the converted mesh data of one source asset.
+// Warm loads map the file and hand the arrays straight to the upload path,
+// so no parsing or per vertex work happens at all.
+class MeshCache
+{
+public:
+    // Cache file for a source asset, named after the asset and a hash of its full path
+    static std::filesystem::path cache_path(const std::filesystem::path& cacheDirectory,
+        const std::filesystem::path& sourcePath);
+
+    // Maps the cache file. Fails if it is missing, corrupt, older than the source asset
+    // or baked with load options that produce different data
+    bool open(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath,
+        const MeshLoadOptions& options);
+    void close();
+
+    size_t mesh_count() const { return _meshCount; }
+    CachedMesh mesh(size_t index) const;
+
+    // Bakes either the vertices or the packedVertices of each mesh, depending on options.vertexFormat
+    static bool write(const std::filesystem::path& cachePath, const std::filesystem::path& sourcePath,
+        std::span<const MeshData> meshes, const MeshLoadOptions& options);
+
+private:
+    MappedFile _file;
+    size_t _meshCount {0};
+    size_t _vertexSize {0};
+};
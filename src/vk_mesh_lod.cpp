@@ -0,0 +1,523 @@
+#include <vk_mesh_lod.h>
+
+#include <vk_mesh_optimizer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+
+namespace
+{
+
+constexpr uint32_t INVALID_INDEX = ~0u;
+// A level has to drop at least this share of the triangles of the level before it
+constexpr float MIN_LOD_REDUCTION = 0.15f;
+constexpr int MAX_COLLAPSE_PASSES = 64;
+
+// Sum of area weighted plane equations, evaluates to the weighted mean squared distance
+// of a point to those planes
+struct Quadric
+{
+    float a00 {0}, a11 {0}, a22 {0};
+    float a01 {0}, a02 {0}, a12 {0};
+    float b0 {0}, b1 {0}, b2 {0};
+    float c {0};
+    float w {0};
+
+    void add_plane(glm::vec3 n, float d, float weight)
+    {
+        a00 += weight * n.x * n.x;
+        a11 += weight * n.y * n.y;
+        a22 += weight * n.z * n.z;
+        a01 += weight * n.x * n.y;
+        a02 += weight * n.x * n.z;
+        a12 += weight * n.y * n.z;
+        b0 += weight * n.x * d;
+        b1 += weight * n.y * d;
+        b2 += weight * n.z * d;
+        c += weight * d * d;
+        w += weight;
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        a00 += other.a00;
+        a11 += other.a11;
+        a22 += other.a22;
+        a01 += other.a01;
+        a02 += other.a02;
+        a12 += other.a12;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        w += other.w;
+        return *this;
+    }
+
+    float error(glm::vec3 p) const
+    {
+        float rx = a00 * p.x + a01 * p.y + a02 * p.z;
+        float ry = a01 * p.x + a11 * p.y + a12 * p.z;
+        float rz = a02 * p.x + a12 * p.y + a22 * p.z;
+        float r = rx * p.x + ry * p.y + rz * p.z + 2.f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return w > 0.f ? std::fabs(r) / w : 0.f;
+    }
+};
+
+struct PositionHash
+{
+    size_t operator()(const glm::vec3& p) const
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+// Compressed row lists: the items of row i are items[offsets[i]] up to items[offsets[i + 1]]
+struct RowList
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> items;
+
+    std::span<const uint32_t> of(uint32_t row) const
+    {
+        return std::span(items).subspan(offsets[row], offsets[row + 1] - offsets[row]);
+    }
+};
+
+// Triangles around every position
+void
+build_adjacency(std::span<const uint32_t> indices, std::span<const uint32_t> positionOf, size_t positionCount,
+    RowList& adjacency)
+{
+    adjacency.offsets.assign(positionCount + 1, 0);
+    adjacency.items.resize(indices.size());
+
+    for (uint32_t index : indices)
+    {
+        adjacency.offsets[positionOf[index] + 1]++;
+    }
+    std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+    std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        adjacency.items[cursor[positionOf[indices[i]]]++] = (uint32_t)(i / 3);
+    }
+}
+
+// Checks that moving position from onto position to does not turn any of the remaining
+// triangles around it over. Positions collapsed earlier in the same pass are taken into account.
+bool
+collapse_keeps_orientation(uint32_t from, uint32_t to, std::span<const uint32_t> indices,
+    std::span<const uint32_t> positionOf, std::span<const uint32_t> remap, std::span<const glm::vec3> positions,
+    const RowList& adjacency, size_t& collapsedTriangles)
+{
+    collapsedTriangles = 0;
+    for (uint32_t triangle : adjacency.of(from))
+    {
+        uint32_t corners[3];
+        for (int k = 0; k < 3; k++)
+        {
+            corners[k] = remap[positionOf[indices[triangle * 3 + k]]];
+        }
+
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+        {
+            // already gone through an earlier collapse
+            continue;
+        }
+        if (corners[0] == to || corners[1] == to || corners[2] == to)
+        {
+            collapsedTriangles++;
+            continue;
+        }
+
+        glm::vec3 before[3];
+        glm::vec3 after[3];
+        for (int k = 0; k < 3; k++)
+        {
+            before[k] = positions[corners[k]];
+            after[k] = corners[k] == from ? positions[to] : before[k];
+        }
+
+        glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0.f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Vertex at position target whose normal and uv are closest to those of vertex
+uint32_t
+closest_wedge(uint32_t vertex, uint32_t target, std::span<const Vertex> vertices, const RowList& wedges)
+{
+    const Vertex& source = vertices[vertex];
+
+    uint32_t best = INVALID_INDEX;
+    float bestDistance = FLT_MAX;
+    for (uint32_t wedge : wedges.of(target))
+    {
+        const Vertex& candidate = vertices[wedge];
+        glm::vec3 normalDelta = candidate.normal - source.normal;
+        float uvDeltaX = candidate.uv_x - source.uv_x;
+        float uvDeltaY = candidate.uv_y - source.uv_y;
+
+        float distance = glm::dot(normalDelta, normalDelta) + uvDeltaX * uvDeltaX + uvDeltaY * uvDeltaY;
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = wedge;
+        }
+    }
+    return best;
+}
+
+bool
+indices_in_range(std::span<const uint32_t> indices, size_t vertexCount)
+{
+    return std::all_of(indices.begin(), indices.end(), [&](uint32_t index) { return index < vertexCount; });
+}
+
+} // namespace
+
+glm::vec4
+compute_bounds(std::span<const uint32_t> indices, std::span<const Vertex> vertices)
+{
+    if (indices.empty())
+    {
+        return glm::vec4(0.f);
+    }
+
+    glm::vec3 minPosition(FLT_MAX);
+    glm::vec3 maxPosition(-FLT_MAX);
+    for (uint32_t index : indices)
+    {
+        minPosition = glm::min(minPosition, vertices[index].position);
+        maxPosition = glm::max(maxPosition, vertices[index].position);
+    }
+
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float radiusSquared = 0.f;
+    for (uint32_t index : indices)
+    {
+        glm::vec3 offset = vertices[index].position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+
+    return glm::vec4(center, std::sqrt(radiusSquared));
+}
+
+std::vector<uint32_t>
+simplify_mesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices, size_t targetIndexCount,
+    float targetError, float* resultError)
+{
+    std::vector<uint32_t> result(indices.begin(), indices.end());
+    if (resultError)
+    {
+        *resultError = 0.f;
+    }
+    if (result.size() <= targetIndexCount)
+    {
+        return result;
+    }
+
+    // Positions scaled to the unit cube keep the quadrics well conditioned
+    glm::vec3 minPosition(FLT_MAX);
+    glm::vec3 maxPosition(-FLT_MAX);
+    for (uint32_t index : result)
+    {
+        minPosition = glm::min(minPosition, vertices[index].position);
+        maxPosition = glm::max(maxPosition, vertices[index].position);
+    }
+    glm::vec3 size = maxPosition - minPosition;
+    float extent = std::max(size.x, std::max(size.y, size.z));
+    float scale = extent > 0.f ? 1.f / extent : 1.f;
+
+    // Vertices split for their normals or uvs share a position, collapses move whole positions
+    std::vector<uint32_t> positionOf(vertices.size(), INVALID_INDEX);
+    std::vector<glm::vec3> positions;
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> positionIds;
+    for (uint32_t index : result)
+    {
+        if (positionOf[index] != INVALID_INDEX)
+        {
+            continue;
+        }
+
+        // adding zero turns -0 into 0 so both hash the same
+        glm::vec3 position = vertices[index].position + glm::vec3(0.f);
+        auto [it, inserted] = positionIds.try_emplace(position, (uint32_t)positions.size());
+        if (inserted)
+        {
+            positions.push_back((position - minPosition) * scale);
+        }
+        positionOf[index] = it->second;
+    }
+    const size_t positionCount = positions.size();
+
+    RowList wedges;
+    wedges.offsets.assign(positionCount + 1, 0);
+    for (uint32_t position : positionOf)
+    {
+        if (position != INVALID_INDEX)
+        {
+            wedges.offsets[position + 1]++;
+        }
+    }
+    std::partial_sum(wedges.offsets.begin(), wedges.offsets.end(), wedges.offsets.begin());
+    wedges.items.resize(wedges.offsets.back());
+    {
+        std::vector<uint32_t> cursor(wedges.offsets.begin(), wedges.offsets.end() - 1);
+        for (uint32_t vertex = 0; vertex < (uint32_t)vertices.size(); vertex++)
+        {
+            if (positionOf[vertex] != INVALID_INDEX)
+            {
+                wedges.items[cursor[positionOf[vertex]]++] = vertex;
+            }
+        }
+    }
+
+    // Edges used by one triangle are on a border and edges used by more than two are not
+    // manifold, positions on either stay where they are
+    std::vector<uint8_t> locked(positionCount, 0);
+    {
+        std::unordered_map<uint64_t, uint32_t> edgeUses;
+        edgeUses.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = positionOf[result[i + k]];
+                uint32_t b = positionOf[result[i + (k + 1) % 3]];
+                if (a != b)
+                {
+                    edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+                }
+            }
+        }
+        for (const auto& [edge, uses] : edgeUses)
+        {
+            if (uses != 2)
+            {
+                locked[edge >> 32] = 1;
+                locked[edge & 0xFFFFFFFF] = 1;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        uint32_t corners[3] = { positionOf[result[i]], positionOf[result[i + 1]], positionOf[result[i + 2]] };
+        glm::vec3 p0 = positions[corners[0]];
+        glm::vec3 normal = glm::cross(positions[corners[1]] - p0, positions[corners[2]] - p0);
+        float length = glm::length(normal);
+        if (length == 0.f)
+        {
+            continue;
+        }
+        normal /= length;
+
+        for (uint32_t corner : corners)
+        {
+            quadrics[corner].add_plane(normal, -glm::dot(normal, p0), length * 0.5f);
+        }
+    }
+
+    const float maxErrorSquared = (targetError * scale) * (targetError * scale);
+    float resultErrorSquared = 0.f;
+
+    RowList adjacency;
+    std::vector<uint32_t> collapseTarget(positionCount);
+    std::vector<float> collapseError(positionCount);
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> remap(positionCount);
+    std::vector<uint8_t> touched(positionCount);
+    std::vector<uint32_t> vertexRemap(vertices.size());
+
+    // Every pass does the cheapest collapses that do not share positions, then rebuilds the triangles
+    for (int pass = 0; pass < MAX_COLLAPSE_PASSES && result.size() > targetIndexCount; pass++)
+    {
+        build_adjacency(result, positionOf, positionCount, adjacency);
+
+        // cheapest neighbour every free position could collapse onto
+        std::fill(collapseTarget.begin(), collapseTarget.end(), INVALID_INDEX);
+        std::fill(collapseError.begin(), collapseError.end(), FLT_MAX);
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t from = positionOf[result[i + k]];
+                if (locked[from])
+                {
+                    continue;
+                }
+
+                for (int other = 1; other < 3; other++)
+                {
+                    uint32_t to = positionOf[result[i + (k + other) % 3]];
+                    float error = quadrics[from].error(positions[to]);
+                    if (to != from && error < collapseError[from])
+                    {
+                        collapseError[from] = error;
+                        collapseTarget[from] = to;
+                    }
+                }
+            }
+        }
+
+        order.clear();
+        for (uint32_t position = 0; position < (uint32_t)positionCount; position++)
+        {
+            if (collapseTarget[position] != INVALID_INDEX && collapseError[position] <= maxErrorSquared)
+            {
+                order.push_back(position);
+            }
+        }
+        std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return collapseError[a] < collapseError[b]; });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), 0);
+
+        size_t trianglesToRemove = std::max<size_t>((result.size() - targetIndexCount) / 3, 1);
+        size_t trianglesRemoved = 0;
+        size_t collapses = 0;
+        for (uint32_t from : order)
+        {
+            uint32_t to = collapseTarget[from];
+            if (trianglesRemoved >= trianglesToRemove)
+            {
+                break;
+            }
+            if (touched[from] || touched[to])
+            {
+                continue;
+            }
+
+            size_t collapsedTriangles;
+            if (!collapse_keeps_orientation(from, to, result, positionOf, remap, positions, adjacency,
+                    collapsedTriangles))
+            {
+                continue;
+            }
+
+            remap[from] = to;
+            touched[from] = 1;
+            touched[to] = 1;
+            quadrics[to] += quadrics[from];
+
+            trianglesRemoved += collapsedTriangles;
+            resultErrorSquared = std::max(resultErrorSquared, collapseError[from]);
+            collapses++;
+        }
+
+        if (collapses == 0)
+        {
+            break;
+        }
+
+        // the vertices of every collapsed position move to the best matching vertex of its target
+        std::iota(vertexRemap.begin(), vertexRemap.end(), 0);
+        for (uint32_t position = 0; position < (uint32_t)positionCount; position++)
+        {
+            if (remap[position] == position)
+            {
+                continue;
+            }
+            for (uint32_t vertex : wedges.of(position))
+            {
+                vertexRemap[vertex] = closest_wedge(vertex, remap[position], vertices, wedges);
+            }
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t a = vertexRemap[result[i]];
+            uint32_t b = vertexRemap[result[i + 1]];
+            uint32_t c = vertexRemap[result[i + 2]];
+            if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[c] == positionOf[a])
+            {
+                continue;
+            }
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (resultError)
+    {
+        *resultError = std::sqrt(resultErrorSquared) / scale;
+    }
+    return result;
+}
+
+MeshLodStats
+build_mesh_lods(MeshData& mesh, bool generateLods, float maxError)
+{
+    MeshLodStats stats;
+    bool validIndices = indices_in_range(mesh.indices, mesh.vertices.size());
+
+    for (GeoSurface& surface : mesh.surfaces)
+    {
+        // copied, the levels are appended to the same index array
+        std::vector<uint32_t> source(mesh.indices.begin() + surface.startIndex,
+            mesh.indices.begin() + surface.startIndex + surface.count);
+
+        surface.bounds = validIndices ? compute_bounds(source, mesh.vertices) : glm::vec4(0.f);
+        surface.lodCount = 1;
+        surface.lods[0] = GeoLod { surface.startIndex, surface.count, 0.f };
+        stats.triangles[0] += surface.count / 3;
+        stats.surfaces[0]++;
+
+        float radius = surface.bounds.w;
+        if (!generateLods || !validIndices || radius <= 0.f)
+        {
+            continue;
+        }
+
+        for (uint32_t lod = 1; lod < MAX_MESH_LODS; lod++)
+        {
+            const GeoLod& previous = surface.lods[lod - 1];
+            size_t targetIndexCount = (surface.count >> lod) / 3 * 3;
+
+            float error;
+            std::vector<uint32_t> lodIndices = simplify_mesh(source, mesh.vertices, targetIndexCount,
+                maxError * radius, &error);
+            if (lodIndices.empty() || lodIndices.size() > previous.count * (1.f - MIN_LOD_REDUCTION))
+            {
+                break;
+            }
+
+            optimize_vertex_cache(lodIndices, mesh.vertices.size());
+
+            GeoLod& level = surface.lods[lod];
+            level.startIndex = (uint32_t)mesh.indices.size();
+            level.count = (uint32_t)lodIndices.size();
+            // selection assumes coarser levels never have a smaller error
+            level.error = std::max(error / radius, previous.error);
+            mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+
+            surface.lodCount++;
+            stats.triangles[lod] += level.count / 3;
+            stats.surfaces[lod]++;
+        }
+    }
+
+    return stats;
+}
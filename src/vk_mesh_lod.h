@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+// Triangles in each level of detail over a set of surfaces, for tuning the error limits
+struct MeshLodStats
+{
+    size_t triangles[MAX_MESH_LODS] {};
+    size_t surfaces[MAX_MESH_LODS] {};
+
+    MeshLodStats& operator+=(const MeshLodStats& other)
+    {
+        for (uint32_t lod = 0; lod < MAX_MESH_LODS; lod++)
+        {
+            triangles[lod] += other.triangles[lod];
+            surfaces[lod] += other.surfaces[lod];
+        }
+        return *this;
+    }
+};
+
+// Bounding sphere of the vertices referenced by indices, xyz is the center and w the radius
+glm::vec4 compute_bounds(std::span<const uint32_t> indices, std::span<const Vertex> vertices);
+
+// Quadric error metric edge collapse (Garland & Heckbert 1997). Vertices only move onto
+// other existing vertices, so the result indexes the same vertex buffer. Collapses work
+// on positions, vertices split for normals or uvs follow along to the closest matching
+// vertex of the target position. Mesh borders are kept in place.
+// Stops at targetIndexCount or before an error (in mesh units) above targetError.
+// resultError receives the largest error of the collapses that were done.
+std::vector<uint32_t> simplify_mesh(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+    size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+// Fills in the bounds and lods[0] of every surface. With generateLods, simplified levels
+// halving the triangle count are appended to the index buffer until the error relative
+// to the surface radius would exceed maxError or the triangle count stops dropping.
+MeshLodStats build_mesh_lods(MeshData& mesh, bool generateLods, float maxError);
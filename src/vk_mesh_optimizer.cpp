@@ -0,0 +1,373 @@
+#include <vk_mesh_optimizer.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+namespace
+{
+
+constexpr uint32_t INVALID_VERTEX = ~0u;
+
+// FIFO vertex cache simulated with timestamps: a vertex is cached while fewer than
+// cacheSize misses happened since it was last loaded
+class CacheSimulator
+{
+public:
+    CacheSimulator(size_t vertexCount, uint32_t cacheSize)
+        : _cacheTime(vertexCount, 0), _cacheSize(cacheSize), _timestamp(cacheSize + 1)
+    {
+    }
+
+    // Returns true on a miss
+    bool access(uint32_t vertex)
+    {
+        if (_timestamp - _cacheTime[vertex] > _cacheSize)
+        {
+            _cacheTime[vertex] = _timestamp++;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t age(uint32_t vertex) const { return _timestamp - _cacheTime[vertex]; }
+
+    // Evicts everything
+    void flush() { _timestamp += _cacheSize + 1; }
+
+private:
+    std::vector<uint32_t> _cacheTime;
+    uint32_t _cacheSize;
+    uint32_t _timestamp;
+};
+
+// Triangles using each vertex, in compressed row form
+struct TriangleAdjacency
+{
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    std::span<const uint32_t> of(uint32_t vertex) const
+    {
+        return std::span(triangles).subspan(offsets[vertex], counts[vertex]);
+    }
+};
+
+TriangleAdjacency
+build_adjacency(std::span<const uint32_t> indices, size_t triangleCount, size_t vertexCount)
+{
+    TriangleAdjacency adjacency;
+    adjacency.counts.assign(vertexCount, 0);
+    adjacency.offsets.resize(vertexCount);
+    adjacency.triangles.resize(triangleCount * 3);
+
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacency.counts[indices[i]]++;
+    }
+
+    uint32_t offset = 0;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacency.offsets[v] = offset;
+        offset += adjacency.counts[v];
+    }
+
+    // filled through a running cursor per vertex, reusing offsets and restoring it afterwards
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        adjacency.triangles[adjacency.offsets[indices[i]]++] = (uint32_t)(i / 3);
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacency.offsets[v] -= adjacency.counts[v];
+    }
+
+    return adjacency;
+}
+
+bool
+indices_in_range(std::span<const uint32_t> indices, size_t vertexCount)
+{
+    return std::all_of(indices.begin(), indices.end(), [vertexCount](uint32_t i) { return i < vertexCount; });
+}
+
+} // namespace
+
+VertexCacheStats
+analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    for (uint32_t vertex : indices.first(stats.triangles * 3))
+    {
+        if (!referenced[vertex])
+        {
+            referenced[vertex] = true;
+            stats.vertices++;
+        }
+        if (cache.access(vertex))
+        {
+            stats.misses++;
+        }
+    }
+
+    return stats;
+}
+
+void
+optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount, uint32_t cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    TriangleAdjacency adjacency = build_adjacency(indices, triangleCount, vertexCount);
+    std::vector<uint32_t> liveTriangles = adjacency.counts;
+    std::vector<bool> emitted(triangleCount, false);
+
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    size_t cursor = 0;
+    uint32_t fanning = indices[0];
+    while (fanning != INVALID_VERTEX)
+    {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t triangle : adjacency.of(fanning))
+        {
+            if (emitted[triangle])
+            {
+                continue;
+            }
+
+            for (size_t k = 0; k < 3; k++)
+            {
+                uint32_t vertex = indices[triangle * 3 + k];
+                output.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                cache.access(vertex);
+            }
+            emitted[triangle] = true;
+        }
+
+        // next fanning vertex: the oldest candidate that will still be cached once all of
+        // its triangles are emitted, otherwise any candidate with triangles left
+        fanning = INVALID_VERTEX;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+            {
+                continue;
+            }
+
+            int64_t priority = 0;
+            if (cache.age(vertex) + 2 * liveTriangles[vertex] <= cacheSize)
+            {
+                priority = cache.age(vertex);
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = vertex;
+            }
+        }
+
+        // dead end, back track through recently emitted vertices before scanning the mesh
+        while (fanning == INVALID_VERTEX && !deadEnd.empty())
+        {
+            uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[vertex] > 0)
+            {
+                fanning = vertex;
+            }
+        }
+        while (fanning == INVALID_VERTEX && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                fanning = (uint32_t)cursor;
+            }
+            cursor++;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void
+optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold, uint32_t cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    CacheSimulator cache(vertices.size(), cacheSize);
+    auto triangle_misses = [&](size_t triangle) {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++)
+        {
+            misses += cache.access(indices[triangle * 3 + k]) ? 1 : 0;
+        }
+        return misses;
+    };
+
+    // Hard boundaries are where the cache order already starts over (every vertex misses)
+    std::vector<uint32_t> misses(triangleCount);
+    std::vector<size_t> hardClusters;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        misses[t] = triangle_misses(t);
+        if (t == 0 || misses[t] == 3)
+        {
+            hardClusters.push_back(t);
+        }
+    }
+    hardClusters.push_back(triangleCount);
+
+    // Soft boundaries split hard clusters further, wherever the triangles so far already
+    // reach close to the ACMR of the whole hard cluster
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+    {
+        const size_t begin = hardClusters[c];
+        const size_t end = hardClusters[c + 1];
+
+        uint32_t clusterMisses = std::accumulate(misses.begin() + begin, misses.begin() + end, 0u);
+        float targetAcmr = threshold * clusterMisses / (end - begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        size_t start = begin;
+        uint32_t runMisses = 0;
+        for (size_t t = begin; t < end; t++)
+        {
+            runMisses += triangle_misses(t);
+            if (t + 1 < end && (float)runMisses / (t + 1 - start) <= targetAcmr)
+            {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                runMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Sort key: how much a cluster faces away from the middle of the mesh. Outward facing
+    // clusters are the most likely to occlude the rest, so they draw first.
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.f));
+    std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.f));
+    glm::vec3 meshCentroid(0.f);
+    float meshArea = 0.f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.f;
+
+            clusterCentroids[c] += centroid * area;
+            clusterNormals[c] += normal;
+            clusterArea += area;
+            meshCentroid += centroid * area;
+            meshArea += area;
+        }
+        clusterCentroids[c] = clusterArea > 0.f ? clusterCentroids[c] / clusterArea : clusterCentroids[c];
+    }
+    meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : meshCentroid;
+
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float normalLength = glm::length(clusterNormals[c]);
+        sortKeys[c] = normalLength > 0.f
+            ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / normalLength)
+            : 0.f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for (size_t c : order)
+    {
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void
+optimize_vertex_fetch(std::span<uint32_t> indices, std::vector<Vertex>& vertices)
+{
+    std::vector<uint32_t> remap(vertices.size(), INVALID_VERTEX);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == INVALID_VERTEX)
+        {
+            remap[index] = (uint32_t)reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices = std::move(reordered);
+}
+
+MeshOptimizeStats
+optimize_mesh(MeshData& mesh)
+{
+    MeshOptimizeStats stats;
+    if (!indices_in_range(mesh.indices, mesh.vertices.size()))
+    {
+        return stats;
+    }
+
+    for (const GeoSurface& surface : mesh.surfaces)
+    {
+        std::span<uint32_t> indices = std::span(mesh.indices).subspan(surface.startIndex, surface.count);
+        stats.before += analyze_vertex_cache(indices, mesh.vertices.size());
+
+        optimize_vertex_cache(indices, mesh.vertices.size());
+        optimize_overdraw(indices, mesh.vertices);
+    }
+
+    optimize_vertex_fetch(mesh.indices, mesh.vertices);
+
+    for (const GeoSurface& surface : mesh.surfaces)
+    {
+        std::span<const uint32_t> indices = std::span(mesh.indices).subspan(surface.startIndex, surface.count);
+        stats.after += analyze_vertex_cache(indices, mesh.vertices.size());
+    }
+
+    return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+// Size of the simulated post transform vertex cache (FIFO)
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Result of running an index buffer through the simulated vertex cache
+struct VertexCacheStats
+{
+    size_t triangles {0};
+    size_t vertices {0}; // unique vertices referenced
+    size_t misses {0};
+
+    // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    float acmr() const { return triangles > 0 ? (float)misses / triangles : 0.f; }
+    // Average transform to vertex ratio, transformed vertices per unique vertex (1 is ideal)
+    float atvr() const { return vertices > 0 ? (float)misses / vertices : 0.f; }
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        misses += other.misses;
+        return *this;
+    }
+};
+
+struct MeshOptimizeStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+VertexCacheStats analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertexCount,
+    uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for the post transform vertex cache (Tipsify, Sander et al. 2007)
+void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders clusters of cache optimized triangles so outward facing ones draw first,
+// only splitting the cache order where that costs less than threshold times the ACMR
+void optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold = 1.05f,
+    uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders vertices by first use in the index buffer and rewrites the indices to match.
+// Vertices that are never referenced are dropped.
+void optimize_vertex_fetch(std::span<uint32_t> indices, std::vector<Vertex>& vertices);
+
+// Runs the cache and overdraw passes on every surface, then the fetch pass on the whole mesh
+MeshOptimizeStats optimize_mesh(MeshData& mesh);
@@ -0,0 +1,193 @@
+#include <vk_mesh_residency.h>
+
+#include <vk_engine.h>
+#include <vk_upload.h>
+
+#include <algorithm>
+
+void
+MeshResidency::init(VulkanEngine* engine)
+{
+	_engine = engine;
+}
+
+void
+MeshResidency::cleanup()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_uploadsDone.wait(lock, [this]() { return _uploadsInFlight == 0; });
+
+	for (MeshHandle handle : _lru)
+	{
+		// an upload submitted after the engine went idle may still be copying
+		_engine->_uploader.wait(_entries[handle].asset.meshBuffers.uploadTicket);
+		_engine->_geometryPool.free(_entries[handle].asset.meshBuffers);
+		_entries[handle].state = State::NonResident;
+	}
+	_lru.clear();
+	_residentBytes = 0;
+}
+
+MeshHandle
+MeshResidency::register_mesh(MeshData&& mesh)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Entry& entry = _entries.emplace_back();
+	entry.asset.name = mesh.name;
+	entry.asset.surfaces = mesh.surfaces;
+	entry.data = std::make_shared<const MeshData>(std::move(mesh));
+	_stats.registered++;
+
+	return (MeshHandle)(_entries.size() - 1);
+}
+
+const MeshAsset*
+MeshResidency::request(MeshHandle handle, VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Entry& entry = _entries[handle];
+	entry.lastUsedFrame = frameNumber;
+
+	if (entry.state == State::Resident && _engine->_uploader.acquire(cmd, entry.asset.meshBuffers.uploadTicket))
+	{
+		_lru.splice(_lru.begin(), _lru, entry.lruPosition);
+		_stats.hits++;
+		return &entry.asset;
+	}
+
+	_stats.misses++;
+	if (entry.state == State::NonResident)
+	{
+		entry.state = State::Uploading;
+		_uploadsInFlight++;
+		_engine->_workerPool.submit([this, handle, data = entry.data]() { upload(handle, data); });
+	}
+	return nullptr;
+}
+
+void
+MeshResidency::upload(MeshHandle handle, std::shared_ptr<const MeshData> data)
+{
+	// one batch per mesh so every mesh gets a ticket of its own
+	MeshUploadBatch batch(_engine);
+	std::optional<GPUMeshBuffers> meshBuffers = batch.add(*data);
+	UploadTicket ticket;
+	if (meshBuffers)
+	{
+		ticket = batch.submit();
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Entry& entry = _entries[handle];
+	if (meshBuffers)
+	{
+		entry.asset.meshBuffers = *meshBuffers;
+		entry.asset.meshBuffers.uploadTicket = ticket;
+		entry.residentBytes = meshBuffers->vertexRange.size + meshBuffers->indexRange.size;
+		entry.state = State::Resident;
+		entry.lruPosition = _lru.insert(_lru.begin(), handle);
+
+		_residentBytes += entry.residentBytes;
+		_stats.uploads++;
+	}
+	else if (_lru.empty() && _uploadsInFlight == 1)
+	{
+		// Nothing else holds pool memory, so evicting cannot make room for this one
+		entry.state = State::TooLarge;
+		_stats.failedUploads++;
+		_stats.tooLarge++;
+		_engine->m_logger->warn("Mesh {} does not fit in the geometry pool, it will not be drawn", entry.asset.name);
+	}
+	else
+	{
+		// the next request retries once update() made room
+		entry.state = State::NonResident;
+		_poolExhausted = true;
+		_stats.failedUploads++;
+	}
+
+	_uploadsInFlight--;
+	_uploadsDone.notify_all();
+}
+
+VkDeviceSize
+MeshResidency::compute_budget()
+{
+	// The geometry pool is allocated up front, so evicting a mesh does not lower what VMA
+	// reports. Meshes get whatever of the heap budget the rest of the engine leaves over,
+	// up to the size of the pool.
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_engine->_allocator, budgets);
+
+	const VmaBudget& heap = budgets[_engine->_geometryPool.memory_heap()];
+	VkDeviceSize poolSize = _engine->_geometryPool.capacity();
+	VkDeviceSize otherUsage = heap.usage > poolSize ? heap.usage - poolSize : 0;
+	VkDeviceSize budget = heap.budget > otherUsage ? heap.budget - otherUsage : 0;
+
+	budget = std::min(budget, poolSize);
+	if (_budgetOverride > 0)
+	{
+		budget = std::min(budget, _budgetOverride);
+	}
+	return budget;
+}
+
+void
+MeshResidency::update(uint64_t frameNumber)
+{
+	VkDeviceSize budget = compute_budget();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stats.budgetBytes = budget;
+
+	while ((_residentBytes > budget || _poolExhausted) && !_lru.empty())
+	{
+		Entry& entry = _entries[_lru.back()];
+
+		// The oldest mesh may still be read by a frame in flight, so nothing can go this frame.
+		// Meshes whose upload has not completed are left alone as well.
+		if (entry.lastUsedFrame + FRAME_OVERLAP > frameNumber
+			|| !_engine->_uploader.is_complete(entry.asset.meshBuffers.uploadTicket))
+		{
+			break;
+		}
+
+		// a mesh evicted before it was ever drawn still has its ownership transfer pending
+		_engine->_uploader.discard(entry.asset.meshBuffers.uploadTicket);
+		_engine->_geometryPool.free(entry.asset.meshBuffers);
+		entry.state = State::NonResident;
+		_residentBytes -= entry.residentBytes;
+		entry.residentBytes = 0;
+		_lru.pop_back();
+
+		_stats.evictions++;
+		_poolExhausted = false;
+	}
+
+	if (_lru.empty())
+	{
+		_poolExhausted = false;
+	}
+}
+
+void
+MeshResidency::set_budget_override(VkDeviceSize bytes)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_budgetOverride = bytes;
+}
+
+MeshResidency::Stats
+MeshResidency::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Stats stats = _stats;
+	stats.resident = (uint32_t)_lru.size();
+	stats.uploading = _uploadsInFlight;
+	stats.residentBytes = _residentBytes;
+	return stats;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+
+//forward declaration
+class VulkanEngine;
+
+using MeshHandle = uint32_t;
+
+// Keeps the CPU copy of every registered mesh and only as many of them on the
+// GPU as the memory budget allows. Meshes are uploaded on a worker thread the
+// first time they are requested and the least recently drawn ones are evicted
+// when the geometry no longer fits. A mesh that does not even fit the empty pool
+// is only tried once.
+class MeshResidency
+{
+public:
+    struct Stats
+    {
+        // requests that could draw the mesh, and ones that could not
+        uint64_t hits;
+        uint64_t misses;
+
+        uint64_t uploads;
+        uint64_t failedUploads;
+        uint64_t evictions;
+        // meshes larger than the whole geometry pool, never uploaded again
+        uint32_t tooLarge;
+
+        uint32_t registered;
+        uint32_t resident;
+        uint32_t uploading;
+
+        VkDeviceSize residentBytes;
+        VkDeviceSize budgetBytes;
+    };
+
+    void init(VulkanEngine* engine);
+    // Waits for uploads still running and frees every resident mesh
+    void cleanup();
+
+    MeshHandle register_mesh(MeshData&& mesh);
+
+    // Returns the mesh when it can be drawn with cmd, which makes it the most recently used one.
+    // Otherwise starts its upload (once) and returns null, the caller skips the mesh this frame.
+    const MeshAsset* request(MeshHandle handle, VkCommandBuffer cmd, uint64_t frameNumber);
+
+    // Evicts least recently drawn meshes until the resident ones fit the budget.
+    // Call once per frame after waiting on the frame's fence.
+    void update(uint64_t frameNumber);
+
+    // Caps the budget below what the heap allows, 0 removes the cap
+    void set_budget_override(VkDeviceSize bytes);
+
+    Stats stats();
+
+private:
+    enum class State
+    {
+        NonResident,
+        Uploading,
+        Resident,
+        TooLarge
+    };
+
+    struct Entry
+    {
+        // shared with the upload task, which may still run after an eviction
+        std::shared_ptr<const MeshData> data;
+        MeshAsset asset;
+
+        State state {State::NonResident};
+        VkDeviceSize residentBytes {0};
+        uint64_t lastUsedFrame {0};
+        // position in _lru while resident
+        std::list<MeshHandle>::iterator lruPosition;
+    };
+
+    // Runs on a worker thread
+    void upload(MeshHandle handle, std::shared_ptr<const MeshData> data);
+
+    VkDeviceSize compute_budget();
+
+    VulkanEngine* _engine;
+
+    // a deque so entries do not move when meshes are registered
+    std::deque<Entry> _entries;
+    // resident meshes, most recently drawn first
+    std::list<MeshHandle> _lru;
+
+    VkDeviceSize _residentBytes {0};
+    VkDeviceSize _budgetOverride {0};
+    // set when an upload did not fit in the geometry pool, makes the next update evict
+    bool _poolExhausted {false};
+
+    uint32_t _uploadsInFlight {0};
+    std::condition_variable _uploadsDone;
+
+    Stats _stats {};
+
+    // uploads finish on worker threads
+    std::mutex _mutex;
+};
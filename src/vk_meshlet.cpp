@@ -0,0 +1,147 @@
+#include <vk_meshlet.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+namespace
+{
+
+constexpr uint32_t INVALID_MESHLET = ~0u;
+
+// Bounding sphere and normal cone of the triangles in [firstIndex, firstIndex + indexCount)
+Meshlet
+finish_meshlet(const MeshData& mesh, uint32_t firstIndex, uint32_t indexCount)
+{
+    Meshlet meshlet {};
+    meshlet.firstIndex = firstIndex;
+    meshlet.indexCount = indexCount;
+
+    glm::vec3 minPosition(FLT_MAX);
+    glm::vec3 maxPosition(-FLT_MAX);
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++)
+    {
+        minPosition = glm::min(minPosition, mesh.vertices[mesh.indices[i]].position);
+        maxPosition = glm::max(maxPosition, mesh.vertices[mesh.indices[i]].position);
+    }
+
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float radiusSquared = 0.f;
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++)
+    {
+        glm::vec3 offset = mesh.vertices[mesh.indices[i]].position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    meshlet.bounds = glm::vec4(center, std::sqrt(radiusSquared));
+
+    // The cone axis is the average face normal (counter clockwise winding faces out, as in glTF).
+    // Every face normal is within the cone half angle of it.
+    glm::vec3 normals[MESHLET_MAX_TRIANGLES];
+    uint32_t normalCount = 0;
+    glm::vec3 axis(0.f);
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3)
+    {
+        glm::vec3 p0 = mesh.vertices[mesh.indices[i]].position;
+        glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].position;
+        glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].position;
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length > 0.f)
+        {
+            normals[normalCount++] = normal / length;
+            axis += normal / length;
+        }
+    }
+
+    float axisLength = glm::length(axis);
+    if (normalCount == 0 || axisLength == 0.f)
+    {
+        meshlet.cone = glm::vec4(0.f, 0.f, 1.f, 1.f);
+        return meshlet;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.f;
+    for (uint32_t i = 0; i < normalCount; i++)
+    {
+        minDot = std::min(minDot, glm::dot(axis, normals[i]));
+    }
+
+    // A cone of 90 degrees or more can always be seen from the front
+    float cutoff = minDot > 0.f ? std::sqrt(1.f - minDot * minDot) : 1.f;
+    meshlet.cone = glm::vec4(axis, cutoff);
+    return meshlet;
+}
+
+} // namespace
+
+size_t
+build_meshlets(MeshData& mesh)
+{
+    mesh.meshlets.clear();
+
+    bool validIndices = std::all_of(mesh.indices.begin(), mesh.indices.end(),
+        [&](uint32_t index) { return index < mesh.vertices.size(); });
+
+    // meshlet each vertex was last added to, so shared vertices are only counted once
+    std::vector<uint32_t> vertexMeshlet(mesh.vertices.size(), INVALID_MESHLET);
+
+    for (GeoSurface& surface : mesh.surfaces)
+    {
+        surface.firstMeshlet = (uint32_t)mesh.meshlets.size();
+        surface.meshletCount = 0;
+        if (!validIndices)
+        {
+            continue;
+        }
+
+        const uint32_t surfaceEnd = surface.startIndex + surface.count / 3 * 3;
+        uint32_t meshletStart = surface.startIndex;
+        uint32_t meshletVertices = 0;
+        uint32_t meshletId = (uint32_t)mesh.meshlets.size();
+
+        // vertices of triangle i not in the current meshlet yet
+        auto new_vertices = [&](uint32_t i) {
+            uint32_t count = 0;
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t vertex = mesh.indices[i + k];
+                bool repeated = (k > 0 && mesh.indices[i] == vertex) || (k > 1 && mesh.indices[i + 1] == vertex);
+                count += vertexMeshlet[vertex] != meshletId && !repeated ? 1 : 0;
+            }
+            return count;
+        };
+
+        for (uint32_t i = surface.startIndex; i < surfaceEnd; i += 3)
+        {
+            uint32_t newVertices = new_vertices(i);
+            uint32_t triangles = (i - meshletStart) / 3;
+            if (meshletVertices + newVertices > MESHLET_MAX_VERTICES || triangles == MESHLET_MAX_TRIANGLES)
+            {
+                mesh.meshlets.push_back(finish_meshlet(mesh, meshletStart, i - meshletStart));
+                meshletStart = i;
+                meshletVertices = 0;
+                meshletId++;
+                newVertices = new_vertices(i);
+            }
+
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                vertexMeshlet[mesh.indices[i + k]] = meshletId;
+            }
+            meshletVertices += newVertices;
+        }
+
+        if (surfaceEnd > meshletStart)
+        {
+            mesh.meshlets.push_back(finish_meshlet(mesh, meshletStart, surfaceEnd - meshletStart));
+        }
+
+        surface.meshletCount = (uint32_t)mesh.meshlets.size() - surface.firstMeshlet;
+    }
+
+    return mesh.meshlets.size();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+
+// Meshlet size limits. 64 vertices and 124 triangles keep a meshlet within what mesh
+// shading hardware works on in one go, and small enough for culling to be selective.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Splits lods[0] of every surface into meshlets by walking its triangles in order, so
+// meshlets are contiguous index ranges and the index buffer is left as it is. Run it
+// after the vertex cache pass, whose triangle order keeps the meshlets compact.
+// Returns the number of meshlets built.
+size_t build_meshlets(MeshData& mesh);
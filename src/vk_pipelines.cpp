@@ -94,7 +94,7 @@ PipelineBuilder::build_pipeline(VkDevice device)
 
     colorBlending.logicOpEnable = VK_FALSE;
     colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
+    colorBlending.attachmentCount = _renderInfo.colorAttachmentCount;
     colorBlending.pAttachments = &_colorBlendAttachment;
 
     // completely clear VertexInputStateCreateInfo, as we have no need for it
@@ -151,6 +151,15 @@ PipelineBuilder::set_shaders(VkShaderModule vertexShader, VkShaderModule fragmen
         vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
 
+void
+PipelineBuilder::set_vertex_shader(VkShaderModule vertexShader)
+{
+    _shaderStages.clear();
+
+    _shaderStages.push_back(
+        vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
+}
+
 void
 PipelineBuilder::set_input_topology(VkPrimitiveTopology topology)
 {
@@ -35,6 +35,8 @@ public:
     VkPipeline build_pipeline(VkDevice device);
 
     void set_shaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+    // vertex stage only, for depth only passes without a color attachment
+    void set_vertex_shader(VkShaderModule vertexShader);
     void set_input_topology(VkPrimitiveTopology topology);
     void set_polygon_mode(VkPolygonMode mode);
     void set_cull_mode(VkCullModeFlags cullMode, VkFrontFace frontFace);
@@ -0,0 +1,381 @@
+#include <vk_render_graph.h>
+
+#include <cassert>
+
+namespace
+{
+
+struct UsageInfo
+{
+	VkPipelineStageFlags2 stages;
+	VkAccessFlags2 readAccess;
+	VkAccessFlags2 writeAccess;
+	VkImageLayout layout;
+};
+
+UsageInfo
+image_usage_info(RenderGraph::ImageUsage usage)
+{
+	switch (usage)
+	{
+	case RenderGraph::ImageUsage::ComputeStorage:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	case RenderGraph::ImageUsage::FragmentSampled:
+		return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	case RenderGraph::ImageUsage::ColorAttachment:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT,
+			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	case RenderGraph::ImageUsage::DepthAttachment:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL };
+	case RenderGraph::ImageUsage::TransferSrc:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+	case RenderGraph::ImageUsage::TransferDst:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+	}
+	return {};
+}
+
+UsageInfo
+buffer_usage_info(RenderGraph::BufferUsage usage)
+{
+	switch (usage)
+	{
+	case RenderGraph::BufferUsage::ComputeStorage:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::VertexStorage:
+		return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::IndirectCommands:
+		return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::IndexBuffer:
+		return { VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::TransferSrc:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::TransferDst:
+		return { VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+	case RenderGraph::BufferUsage::HostRead:
+		return { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT,
+			VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	}
+	return {};
+}
+
+} // namespace
+
+RenderGraph::PassBuilder&
+RenderGraph::PassBuilder::read(ImageHandle image, ImageUsage usage)
+{
+	UsageInfo info = image_usage_info(usage);
+	_graph.add_access(_pass, image.index, info.stages, info.readAccess, VK_ACCESS_2_NONE, info.layout, true, false);
+	return *this;
+}
+
+RenderGraph::PassBuilder&
+RenderGraph::PassBuilder::write(ImageHandle image, ImageUsage usage)
+{
+	UsageInfo info = image_usage_info(usage);
+	_graph.add_access(_pass, image.index, info.stages, VK_ACCESS_2_NONE, info.writeAccess, info.layout, false, true);
+	return *this;
+}
+
+RenderGraph::PassBuilder&
+RenderGraph::PassBuilder::read(BufferHandle buffer, BufferUsage usage)
+{
+	UsageInfo info = buffer_usage_info(usage);
+	_graph.add_access(_pass, buffer.index, info.stages, info.readAccess, VK_ACCESS_2_NONE, info.layout, true, false);
+	return *this;
+}
+
+RenderGraph::PassBuilder&
+RenderGraph::PassBuilder::write(BufferHandle buffer, BufferUsage usage)
+{
+	UsageInfo info = buffer_usage_info(usage);
+	_graph.add_access(_pass, buffer.index, info.stages, VK_ACCESS_2_NONE, info.writeAccess, info.layout, false, true);
+	return *this;
+}
+
+RenderGraph::PassBuilder&
+RenderGraph::PassBuilder::side_effects()
+{
+	_graph._passes[_pass].sideEffects = true;
+	return *this;
+}
+
+void
+RenderGraph::reset()
+{
+	_resources.clear();
+	_passes.clear();
+}
+
+uint32_t
+RenderGraph::add_resource(std::string_view name, bool image)
+{
+	Resource& resource = _resources.emplace_back();
+	resource.name = name;
+	resource.image = image;
+	return (uint32_t)_resources.size() - 1;
+}
+
+RenderGraph::ImageHandle
+RenderGraph::import_image(std::string_view name, VkImage image, VkImageAspectFlags aspect,
+	VkImageLayout initialLayout, VkPipelineStageFlags2 initialStages)
+{
+	uint32_t index = add_resource(name, true);
+	Resource& resource = _resources[index];
+	resource.vkImage = image;
+	resource.aspect = aspect;
+
+	// the contents are as the caller says, but the last frame's work on the image may still be running
+	if (auto history = _imageHistory.find(image); history != _imageHistory.end())
+	{
+		resource.state.writeStages = history->second.writeStages;
+		resource.state.writeAccess = history->second.writeAccess;
+		resource.state.readStages = history->second.readStages;
+	}
+	resource.state.layout = initialLayout;
+	resource.state.writeStages |= initialStages;
+
+	return { index };
+}
+
+RenderGraph::BufferHandle
+RenderGraph::import_buffer(std::string_view name, VkBuffer buffer)
+{
+	uint32_t index = add_resource(name, false);
+	Resource& resource = _resources[index];
+	resource.vkBuffer = buffer;
+
+	if (auto history = _bufferHistory.find(buffer); history != _bufferHistory.end())
+	{
+		resource.state.writeStages = history->second.writeStages;
+		resource.state.writeAccess = history->second.writeAccess;
+		resource.state.readStages = history->second.readStages;
+	}
+
+	return { index };
+}
+
+void
+RenderGraph::export_image(ImageHandle image, VkImageLayout finalLayout)
+{
+	_resources[image.index].exported = true;
+	_resources[image.index].finalLayout = finalLayout;
+}
+
+void
+RenderGraph::export_buffer(BufferHandle buffer)
+{
+	_resources[buffer.index].exported = true;
+}
+
+RenderGraph::PassBuilder
+RenderGraph::add_pass(std::string_view name, std::function<void(VkCommandBuffer)> record)
+{
+	Pass& pass = _passes.emplace_back();
+	pass.name = name;
+	pass.record = std::move(record);
+	return PassBuilder(*this, (uint32_t)_passes.size() - 1);
+}
+
+void
+RenderGraph::add_access(uint32_t pass, uint32_t resource, VkPipelineStageFlags2 stages, VkAccessFlags2 readAccess,
+	VkAccessFlags2 writeAccess, VkImageLayout layout, bool read, bool write)
+{
+	// a pass using a resource several ways needs them all covered by one barrier
+	for (Access& existing : _passes[pass].accesses)
+	{
+		if (existing.resource == resource)
+		{
+			assert(existing.layout == layout && "a pass can only use an image in one layout");
+			existing.stages |= stages;
+			existing.readAccess |= readAccess;
+			existing.writeAccess |= writeAccess;
+			existing.read |= read;
+			existing.write |= write;
+			return;
+		}
+	}
+
+	_passes[pass].accesses.push_back({ resource, stages, readAccess, writeAccess, layout, read, write });
+}
+
+void
+RenderGraph::cull_passes(std::vector<uint8_t>& alive) const
+{
+	// Backwards from the exports: a pass is needed when it writes something a later needed
+	// pass reads or that is exported. A pure write hides everything written before it.
+	std::vector<uint8_t> needed(_resources.size(), 0);
+	for (size_t i = 0; i < _resources.size(); i++)
+	{
+		needed[i] = _resources[i].exported ? 1 : 0;
+	}
+
+	alive.assign(_passes.size(), 0);
+	for (size_t i = _passes.size(); i-- > 0;)
+	{
+		const Pass& pass = _passes[i];
+		bool live = pass.sideEffects;
+		for (const Access& access : pass.accesses)
+		{
+			live |= access.write && needed[access.resource];
+		}
+		if (!live)
+		{
+			continue;
+		}
+
+		alive[i] = 1;
+		for (const Access& access : pass.accesses)
+		{
+			if (access.write && !access.read)
+			{
+				needed[access.resource] = 0;
+			}
+		}
+		for (const Access& access : pass.accesses)
+		{
+			if (access.read)
+			{
+				needed[access.resource] = 1;
+			}
+		}
+	}
+}
+
+void
+RenderGraph::execute(VkCommandBuffer cmd)
+{
+	_stats = {};
+	_stats.passes = (uint32_t)_passes.size();
+	_culledPassNames.clear();
+
+	std::vector<uint8_t> alive;
+	cull_passes(alive);
+
+	auto flush_barriers = [&]() {
+		if (_barriers.empty())
+		{
+			return;
+		}
+
+		_stats.barrierBatches++;
+		_stats.imageBarriers += _barriers.image_count();
+		_stats.bufferBarriers += _barriers.buffer_count();
+		_barriers.flush(cmd);
+	};
+
+	auto add_barrier = [&](const Resource& resource, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess,
+		VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) {
+		const vkutil::BarrierScope src {srcStages, srcAccess, oldLayout};
+		const vkutil::BarrierScope dst {dstStages, dstAccess, newLayout};
+		if (resource.image)
+		{
+			_barriers.image(resource.vkImage, src, dst, resource.aspect);
+		}
+		else
+		{
+			_barriers.buffer(resource.vkBuffer, src, dst);
+		}
+	};
+
+	for (size_t i = 0; i < _passes.size(); i++)
+	{
+		Pass& pass = _passes[i];
+		if (!alive[i])
+		{
+			_stats.culledPasses++;
+			_culledPassNames.push_back(pass.name);
+			continue;
+		}
+
+		for (const Access& access : pass.accesses)
+		{
+			Resource& resource = _resources[access.resource];
+			ResourceState& state = resource.state;
+			const VkAccessFlags2 dstAccess = access.readAccess | access.writeAccess;
+
+			const bool layoutChange = resource.image && access.layout != state.layout;
+			if (layoutChange || access.write)
+			{
+				// Write after write and write after read, a layout transition is a write as well.
+				// Reads only need an execution dependency, there is nothing of theirs to make available.
+				const VkPipelineStageFlags2 srcStages = state.writeStages | state.readStages;
+				if (layoutChange || srcStages != VK_PIPELINE_STAGE_2_NONE)
+				{
+					// contents the pass does not read can be discarded by the transition
+					const VkImageLayout oldLayout = access.read ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+					add_barrier(resource, srcStages, state.writeAccess, access.stages, dstAccess,
+						layoutChange ? oldLayout : state.layout, access.layout);
+				}
+
+				state.layout = access.layout;
+				state.writeStages = access.stages;
+				state.writeAccess = access.writeAccess;
+				state.readStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.stages;
+				// the pass's own writes are not visible to anything yet, a transition is to the pass
+				state.visibleStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.stages;
+				state.visibleAccess = access.write ? VK_ACCESS_2_NONE : access.readAccess;
+			}
+			else
+			{
+				// Read after write, unless an earlier barrier already covers this stage and access.
+				// Reads after reads need nothing.
+				const bool covered = (access.stages & ~state.visibleStages) == 0 && (access.readAccess & ~state.visibleAccess) == 0;
+				if (state.writeStages != VK_PIPELINE_STAGE_2_NONE && !covered)
+				{
+					add_barrier(resource, state.writeStages, state.writeAccess, access.stages, access.readAccess,
+						state.layout, state.layout);
+					state.visibleStages |= access.stages;
+					state.visibleAccess |= access.readAccess;
+				}
+				state.readStages |= access.stages;
+			}
+		}
+
+		flush_barriers();
+		pass.record(cmd);
+	}
+
+	// Exported images leave in the layout their consumer expects, handed over through
+	// the semaphores of the submission
+	for (Resource& resource : _resources)
+	{
+		if (resource.image && resource.exported && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED
+			&& resource.finalLayout != resource.state.layout)
+		{
+			add_barrier(resource, resource.state.writeStages | resource.state.readStages, resource.state.writeAccess,
+				VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, resource.state.layout, resource.finalLayout);
+			resource.state.layout = resource.finalLayout;
+		}
+	}
+	flush_barriers();
+
+	// Only what this frame imported is kept, so destroyed resources do not linger and a
+	// recycled handle does not inherit their state. A resource skipped for a frame is synced
+	// with its older work by the caller, as the swapchain images are by the acquire semaphore.
+	_imageHistory.clear();
+	_bufferHistory.clear();
+	for (const Resource& resource : _resources)
+	{
+		if (resource.image)
+		{
+			_imageHistory[resource.vkImage] = resource.state;
+		}
+		else
+		{
+			_bufferHistory[resource.vkBuffer] = resource.state;
+		}
+	}
+}
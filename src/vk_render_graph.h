@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vk_barriers.h>
+#include <vk_types.h>
+
+#include <functional>
+#include <unordered_map>
+
+// Frame graph of the passes recorded into one command buffer.
+// Passes declare which images and buffers they read and write and how, the graph then
+// derives the layouts and the narrowest stage and access masks for every hazard,
+// emits the barriers in front of each pass as a single vkCmdPipelineBarrier2, and
+// skips passes whose results never reach an exported resource. Usage per frame:
+//   reset(), import the resources, export the ones that leave the frame,
+//   add_pass() in submission order, then execute().
+class RenderGraph
+{
+public:
+    struct ImageHandle
+    {
+        uint32_t index;
+    };
+
+    struct BufferHandle
+    {
+        uint32_t index;
+    };
+
+    // How a pass uses an image, each usage has one layout, stage and access mask
+    enum class ImageUsage
+    {
+        // storage image in a compute shader, GENERAL layout
+        ComputeStorage,
+        // sampled from a fragment shader
+        FragmentSampled,
+        // read() for blending or loading the previous contents
+        ColorAttachment,
+        DepthAttachment,
+        TransferSrc,
+        TransferDst,
+    };
+
+    enum class BufferUsage
+    {
+        ComputeStorage,
+        VertexStorage,
+        IndirectCommands,
+        IndexBuffer,
+        TransferSrc,
+        TransferDst,
+        HostRead,
+    };
+
+    struct Stats
+    {
+        uint32_t passes;
+        uint32_t culledPasses;
+        // BarrierBuilder flushes, at most one per pass plus one for the exports
+        uint32_t barrierBatches;
+        uint32_t imageBarriers;
+        uint32_t bufferBarriers;
+    };
+
+    class PassBuilder
+    {
+    public:
+        // read() makes the pass depend on the current contents, write() on its own only
+        PassBuilder& read(ImageHandle image, ImageUsage usage);
+        PassBuilder& write(ImageHandle image, ImageUsage usage);
+        PassBuilder& read(BufferHandle buffer, BufferUsage usage);
+        PassBuilder& write(BufferHandle buffer, BufferUsage usage);
+
+        // The pass is never culled, for passes with effects the graph can not see
+        PassBuilder& side_effects();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+
+        RenderGraph& _graph;
+        uint32_t _pass;
+    };
+
+    // Forgets the passes and resources of the last frame, keeps how the last execute() left them
+    void reset();
+
+    // initialLayout is the layout the image is in when the graph starts, initialStages the
+    // stages a semaphore wait of the submission blocks for it, transitions out of it chain on them
+    ImageHandle import_image(std::string_view name, VkImage image, VkImageAspectFlags aspect,
+        VkImageLayout initialLayout, VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE);
+    BufferHandle import_buffer(std::string_view name, VkBuffer buffer);
+
+    // Exported resources outlive the graph, passes are kept alive by contributing to them.
+    // Images end up in finalLayout.
+    void export_image(ImageHandle image, VkImageLayout finalLayout);
+    void export_buffer(BufferHandle buffer);
+
+    // Passes run in the order they are added
+    PassBuilder add_pass(std::string_view name, std::function<void(VkCommandBuffer)> record);
+
+    void execute(VkCommandBuffer cmd);
+
+    // Of the last execute()
+    Stats stats() const { return _stats; }
+    // Names of the passes the last execute() culled
+    std::span<const std::string> culled_passes() const { return _culledPassNames; }
+
+private:
+    struct Access
+    {
+        uint32_t resource;
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 readAccess;
+        VkAccessFlags2 writeAccess;
+        VkImageLayout layout;
+        bool read;
+        bool write;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<Access> accesses;
+        bool sideEffects {false};
+    };
+
+    // Synchronization state of a resource between passes
+    struct ResourceState
+    {
+        VkImageLayout layout {VK_IMAGE_LAYOUT_UNDEFINED};
+        // the last write, including layout transitions
+        VkPipelineStageFlags2 writeStages {VK_PIPELINE_STAGE_2_NONE};
+        VkAccessFlags2 writeAccess {VK_ACCESS_2_NONE};
+        // reads since the last write, later writes have to wait for them
+        VkPipelineStageFlags2 readStages {VK_PIPELINE_STAGE_2_NONE};
+        // stages and accesses the last write was already made visible to
+        VkPipelineStageFlags2 visibleStages {VK_PIPELINE_STAGE_2_NONE};
+        VkAccessFlags2 visibleAccess {VK_ACCESS_2_NONE};
+    };
+
+    struct Resource
+    {
+        std::string name;
+        bool image;
+        VkImage vkImage {VK_NULL_HANDLE};
+        VkBuffer vkBuffer {VK_NULL_HANDLE};
+        VkImageAspectFlags aspect {0};
+        bool exported {false};
+        VkImageLayout finalLayout {VK_IMAGE_LAYOUT_UNDEFINED};
+        ResourceState state;
+    };
+
+    uint32_t add_resource(std::string_view name, bool image);
+    void add_access(uint32_t pass, uint32_t resource, VkPipelineStageFlags2 stages, VkAccessFlags2 readAccess,
+        VkAccessFlags2 writeAccess, VkImageLayout layout, bool read, bool write);
+    void cull_passes(std::vector<uint8_t>& alive) const;
+
+    std::vector<Resource> _resources;
+    std::vector<Pass> _passes;
+
+    // How each resource was used by the last execute(), the first barrier of the next one
+    // has to wait for that work as it is still in flight on the same queue
+    std::unordered_map<VkImage, ResourceState> _imageHistory;
+    std::unordered_map<VkBuffer, ResourceState> _bufferHistory;
+
+    // reused by execute(), flushed in front of every pass
+    vkutil::BarrierBuilder _barriers;
+    std::vector<std::string> _culledPassNames;
+
+    Stats _stats {};
+};
@@ -0,0 +1,137 @@
+#include <vk_scene.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+
+glm::mat4
+local_matrix(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+    return glm::translate(glm::mat4(1.f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.f), scale);
+}
+
+} // namespace
+
+uint32_t
+SceneGraph::add_node(std::string_view name, uint32_t parent, const glm::vec3& translation,
+    const glm::quat& rotation, const glm::vec3& scale, int32_t mesh)
+{
+    const uint32_t node = (uint32_t)_parents.size();
+
+    // the parent's subtree has to end at the new node, otherwise the subtree would not be contiguous
+    assert(parent == SCENE_NO_PARENT || (parent < node && _subtreeEnds[parent] == node));
+
+    _parents.push_back(parent);
+    _subtreeEnds.push_back(node + 1);
+    _translations.push_back(translation);
+    _rotations.push_back(rotation);
+    _scales.push_back(scale);
+    _localMatrices.emplace_back(1.f);
+    _worldMatrices.emplace_back(1.f);
+    _dirty.push_back(1);
+    _meshes.push_back(mesh);
+    _names.emplace_back(name);
+
+    for (uint32_t ancestor = parent; ancestor != SCENE_NO_PARENT; ancestor = _parents[ancestor])
+    {
+        _subtreeEnds[ancestor] = node + 1;
+    }
+
+    if (mesh != SCENE_NO_MESH)
+    {
+        _meshNodes.push_back(node);
+
+        auto usedMesh = std::lower_bound(_usedMeshes.begin(), _usedMeshes.end(), (uint32_t)mesh);
+        if (usedMesh == _usedMeshes.end() || *usedMesh != (uint32_t)mesh)
+        {
+            _usedMeshes.insert(usedMesh, (uint32_t)mesh);
+        }
+    }
+
+    _firstDirty = std::min(_firstDirty, node);
+    return node;
+}
+
+void
+SceneGraph::clear()
+{
+    *this = SceneGraph {};
+}
+
+void
+SceneGraph::mark_dirty(uint32_t node)
+{
+    _dirty[node] = 1;
+    _firstDirty = std::min(_firstDirty, node);
+}
+
+void
+SceneGraph::set_translation(uint32_t node, const glm::vec3& translation)
+{
+    _translations[node] = translation;
+    mark_dirty(node);
+}
+
+void
+SceneGraph::set_rotation(uint32_t node, const glm::quat& rotation)
+{
+    _rotations[node] = rotation;
+    mark_dirty(node);
+}
+
+void
+SceneGraph::set_scale(uint32_t node, const glm::vec3& scale)
+{
+    _scales[node] = scale;
+    mark_dirty(node);
+}
+
+void
+SceneGraph::update_transforms()
+{
+    _updatedNodes = 0;
+
+    const uint32_t nodeCount = (uint32_t)_parents.size();
+    uint32_t node = _firstDirty;
+    while (node < nodeCount)
+    {
+        if (!_dirty[node])
+        {
+            node++;
+            continue;
+        }
+
+        // Everything below a dirty node changes with it. Parents are always updated before
+        // their children, and the subtree is contiguous, so this is one run over the arrays.
+        const uint32_t subtreeEnd = _subtreeEnds[node];
+        for (uint32_t i = node; i < subtreeEnd; i++)
+        {
+            if (_dirty[i])
+            {
+                _localMatrices[i] = local_matrix(_translations[i], _rotations[i], _scales[i]);
+            }
+            const uint32_t parent = _parents[i];
+            _worldMatrices[i] = parent == SCENE_NO_PARENT ? _localMatrices[i] : _worldMatrices[parent] * _localMatrices[i];
+        }
+        std::fill(_dirty.begin() + node, _dirty.begin() + subtreeEnd, 0);
+
+        _updatedNodes += subtreeEnd - node;
+        node = subtreeEnd;
+    }
+
+    _firstDirty = nodeCount;
+}
+
+SceneGraph::Stats
+SceneGraph::stats() const
+{
+    Stats stats {};
+    stats.nodes = (uint32_t)_parents.size();
+    stats.meshNodes = (uint32_t)_meshNodes.size();
+    stats.updatedNodes = _updatedNodes;
+    return stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vk_types.h>
+
+#include <glm/gtc/quaternion.hpp>
+
+// Parent index of root nodes
+constexpr uint32_t SCENE_NO_PARENT = UINT32_MAX;
+// Mesh index of nodes without a mesh
+constexpr int32_t SCENE_NO_MESH = -1;
+
+// Node hierarchy flattened into parallel arrays, one entry per node.
+// Nodes are stored in depth first order: parents come before their children and
+// every subtree is one contiguous range, so world matrices are recomputed in a
+// single forward pass over the arrays, starting only where a subtree is dirty.
+class SceneGraph
+{
+public:
+    struct Stats
+    {
+        uint32_t nodes;
+        uint32_t meshNodes;
+        // world matrices recomputed by the last update_transforms()
+        uint32_t updatedNodes;
+    };
+
+    // Appends a node. Nodes have to be added depth first, so parent is either
+    // SCENE_NO_PARENT or the last added node or one of its ancestors.
+    uint32_t add_node(std::string_view name, uint32_t parent, const glm::vec3& translation,
+        const glm::quat& rotation, const glm::vec3& scale, int32_t mesh = SCENE_NO_MESH);
+    void clear();
+
+    size_t size() const { return _parents.size(); }
+
+    // Local transform, changing it marks the subtree of the node dirty
+    void set_translation(uint32_t node, const glm::vec3& translation);
+    void set_rotation(uint32_t node, const glm::quat& rotation);
+    void set_scale(uint32_t node, const glm::vec3& scale);
+
+    const glm::vec3& translation(uint32_t node) const { return _translations[node]; }
+    const glm::quat& rotation(uint32_t node) const { return _rotations[node]; }
+    const glm::vec3& scale(uint32_t node) const { return _scales[node]; }
+
+    // Recomputes the world matrices of every dirty subtree
+    void update_transforms();
+
+    // Valid after update_transforms()
+    const glm::mat4& world_matrix(uint32_t node) const { return _worldMatrices[node]; }
+
+    uint32_t parent(uint32_t node) const { return _parents[node]; }
+    int32_t mesh(uint32_t node) const { return _meshes[node]; }
+    const std::string& name(uint32_t node) const { return _names[node]; }
+
+    // Nodes with a mesh, in node order
+    std::span<const uint32_t> mesh_nodes() const { return _meshNodes; }
+    // Mesh indices referenced by any node, each once
+    std::span<const uint32_t> used_meshes() const { return _usedMeshes; }
+
+    Stats stats() const;
+
+private:
+    void mark_dirty(uint32_t node);
+
+    std::vector<uint32_t> _parents;
+    // one past the last node of the subtree of each node
+    std::vector<uint32_t> _subtreeEnds;
+    std::vector<glm::vec3> _translations;
+    std::vector<glm::quat> _rotations;
+    std::vector<glm::vec3> _scales;
+    // TRS as a matrix, only rebuilt for nodes whose own transform changed
+    std::vector<glm::mat4> _localMatrices;
+    std::vector<glm::mat4> _worldMatrices;
+    // set on nodes whose local transform changed, cleared by update_transforms()
+    std::vector<uint8_t> _dirty;
+    std::vector<int32_t> _meshes;
+    std::vector<std::string> _names;
+
+    std::vector<uint32_t> _meshNodes;
+    std::vector<uint32_t> _usedMeshes;
+
+    // no node before this one is dirty
+    uint32_t _firstDirty {0};
+    uint32_t _updatedNodes {0};
+};
@@ -0,0 +1,251 @@
+#include <vk_texture_cache.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+
+constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x43544B56; // "VKTC"
+// Bump whenever the file layout or the encoders change
+constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+// The block data starts on this boundary, which covers every BC block size
+constexpr uint64_t TEXTURE_CACHE_ALIGNMENT = 16;
+
+struct TextureCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // requested and resolved compression, they differ for Auto
+    uint32_t requestedCompression;
+    uint32_t compression;
+    uint32_t srgb;
+    uint32_t mipmapped;
+    uint32_t width;
+    uint32_t height;
+    uint64_t contentHash;
+    uint64_t mipCount;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+};
+
+uint64_t
+align_up(uint64_t value)
+{
+    return (value + TEXTURE_CACHE_ALIGNMENT - 1) & ~(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+uint64_t
+mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+const char*
+compression_name(TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::BC1:
+        return "bc1";
+    case TextureCompression::BC3:
+        return "bc3";
+    case TextureCompression::BC7:
+        return "bc7";
+    case TextureCompression::Auto:
+        return "auto";
+    default:
+        return "rgba8";
+    }
+}
+
+// Every level has to be exactly the size its extent needs, and the chain has to halve
+// down to 1x1 (or stop at level 0), because the upload copies each level as it is
+bool
+mips_valid(const TextureMipLevel* mips, uint64_t mipCount, TextureCompression compression, VkExtent2D extent,
+    bool mipmapped, uint64_t dataSize)
+{
+    if (mipCount == 0 || (!mipmapped && mipCount != 1))
+    {
+        return false;
+    }
+
+    uint32_t width = extent.width;
+    uint32_t height = extent.height;
+    for (uint64_t level = 0; level < mipCount; level++)
+    {
+        const TextureMipLevel& mip = mips[level];
+        if (mip.width != width || mip.height != height
+            || mip.size != bc_level_size(compression, width, height)
+            || mip.offset > dataSize || mip.size > dataSize - mip.offset
+            || mip.offset % bc_block_size(compression) != 0)
+        {
+            return false;
+        }
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    const TextureMipLevel& last = mips[mipCount - 1];
+    return !mipmapped || (last.width == 1 && last.height == 1);
+}
+
+} // namespace
+
+uint64_t
+TextureCache::content_hash(std::span<const std::byte> data)
+{
+    // 8 bytes at a time, the images are large enough that a byte wise hash shows up in the import time
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ data.size();
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data.data() + i, sizeof(word));
+        hash = (hash ^ mix(word)) * 0x100000001b3ull;
+    }
+
+    if (i < data.size())
+    {
+        uint64_t tail = 0;
+        memcpy(&tail, data.data() + i, data.size() - i);
+        hash = (hash ^ mix(tail)) * 0x100000001b3ull;
+    }
+    return mix(hash);
+}
+
+std::filesystem::path
+TextureCache::cache_path(const std::filesystem::path& cacheDirectory, const TextureCacheKey& key)
+{
+    std::string fileName = fmt::format("{:016x}-{}{}{}.texcache", key.contentHash, compression_name(key.compression),
+        key.srgb ? "-srgb" : "", key.mipmapped ? "-mips" : "");
+    return cacheDirectory / fileName;
+}
+
+bool
+TextureCache::open(const std::filesystem::path& cachePath, const TextureCacheKey& key)
+{
+    close();
+
+    if (!_file.open(cachePath))
+    {
+        return false;
+    }
+
+    const uint64_t fileSize = _file.size();
+    if (fileSize < sizeof(TextureCacheHeader))
+    {
+        close();
+        return false;
+    }
+
+    const TextureCacheHeader* header = reinterpret_cast<const TextureCacheHeader*>(_file.data());
+    const TextureCompression compression = (TextureCompression)header->compression;
+    const uint64_t mipTableEnd = sizeof(TextureCacheHeader) + header->mipCount * sizeof(TextureMipLevel);
+    bool valid = header->magic == TEXTURE_CACHE_MAGIC
+        && header->version == TEXTURE_CACHE_VERSION
+        && header->requestedCompression == (uint32_t)key.compression
+        && header->srgb == (key.srgb ? 1u : 0u)
+        && header->mipmapped == (key.mipmapped ? 1u : 0u)
+        && header->contentHash == key.contentHash
+        && header->fileSize == fileSize
+        && bc_block_size(compression) != 0
+        && header->width > 0 && header->height > 0
+        && header->mipCount <= 32
+        && header->dataOffset % TEXTURE_CACHE_ALIGNMENT == 0
+        && header->dataOffset >= mipTableEnd && header->dataOffset <= fileSize;
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+
+    const TextureMipLevel* mips = reinterpret_cast<const TextureMipLevel*>(_file.data() + sizeof(TextureCacheHeader));
+    const VkExtent2D extent { header->width, header->height };
+    if (!mips_valid(mips, header->mipCount, compression, extent, key.mipmapped, fileSize - header->dataOffset))
+    {
+        close();
+        return false;
+    }
+
+    _compression = compression;
+    _extent = extent;
+    _mips = { mips, header->mipCount };
+    _data = { _file.data() + header->dataOffset, fileSize - header->dataOffset };
+    return true;
+}
+
+void
+TextureCache::close()
+{
+    _file.close();
+    _compression = TextureCompression::None;
+    _extent = {};
+    _mips = {};
+    _data = {};
+}
+
+bool
+TextureCache::write(const std::filesystem::path& cachePath, const TextureCacheKey& key, VkExtent2D extent,
+    const CompressedTexture& texture)
+{
+    TextureCacheHeader header {};
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.requestedCompression = (uint32_t)key.compression;
+    header.compression = (uint32_t)texture.compression;
+    header.srgb = key.srgb ? 1 : 0;
+    header.mipmapped = key.mipmapped ? 1 : 0;
+    header.width = extent.width;
+    header.height = extent.height;
+    header.contentHash = key.contentHash;
+    header.mipCount = texture.mips.size();
+    header.dataOffset = align_up(sizeof(TextureCacheHeader) + texture.mips.size() * sizeof(TextureMipLevel));
+    header.fileSize = header.dataOffset + texture.data.size();
+
+    std::error_code ec;
+    std::filesystem::create_directories(cachePath.parent_path(), ec);
+
+    // Write next to the final file and swap it in, so a crash never leaves a half written cache.
+    // Identical images of one asset are compressed on different workers at the same time,
+    // so the temporary file is per thread.
+    std::filesystem::path tempPath = cachePath;
+    tempPath += fmt::format(".{:x}.tmp", std::hash<std::thread::id> {}(std::this_thread::get_id()));
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        static constexpr char zeros[TEXTURE_CACHE_ALIGNMENT] = {};
+        const uint64_t tableEnd = sizeof(TextureCacheHeader) + texture.mips.size() * sizeof(TextureMipLevel);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(texture.mips.data()), (std::streamsize)(texture.mips.size() * sizeof(TextureMipLevel)));
+        file.write(zeros, (std::streamsize)(header.dataOffset - tableEnd));
+        file.write(reinterpret_cast<const char*>(texture.data.data()), (std::streamsize)texture.data.size());
+
+        if (!file.good())
+        {
+            file.close();
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_mesh_cache.h>
+#include <vk_texture_compress.h>
+
+#include <filesystem>
+
+// Load options that change the compressed data, part of the cache key next to the content hash
+struct TextureCacheKey
+{
+    // hash of the encoded source image (the png or jpeg bytes, not the decoded pixels)
+    uint64_t contentHash;
+    // as requested, Auto included, the file records what it resolved to
+    TextureCompression compression;
+    bool srgb;
+    bool mipmapped;
+};
+
+// Block compressed mip chain of one source image, baked by the texture import.
+// Files are keyed by the content of the image rather than its path, so the same
+// image imported again (from any asset) maps the baked chain without decoding.
+class TextureCache
+{
+public:
+    // Fast 64 bit hash of the source image bytes
+    static uint64_t content_hash(std::span<const std::byte> data);
+
+    static std::filesystem::path cache_path(const std::filesystem::path& cacheDirectory, const TextureCacheKey& key);
+
+    // Maps the cache file. Fails if it is missing, corrupt or baked for a different key
+    bool open(const std::filesystem::path& cachePath, const TextureCacheKey& key);
+    void close();
+
+    TextureCompression compression() const { return _compression; }
+    VkExtent2D extent() const { return _extent; }
+    std::span<const TextureMipLevel> mips() const { return _mips; }
+    // Data of the whole chain, the mip offsets are relative to its start
+    std::span<const std::byte> data() const { return _data; }
+
+    static bool write(const std::filesystem::path& cachePath, const TextureCacheKey& key, VkExtent2D extent,
+        const CompressedTexture& texture);
+
+private:
+    MappedFile _file;
+    TextureCompression _compression {TextureCompression::None};
+    VkExtent2D _extent {};
+    std::span<const TextureMipLevel> _mips;
+    std::span<const std::byte> _data;
+};
@@ -0,0 +1,739 @@
+#include <vk_texture_compress.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+/*******************************************************
+ * Endpoint fitting shared by the encoders
+ ******************************************************/
+
+// Principal axis of the texels, by power iteration on their covariance
+template <int Channels>
+void
+principal_axis(const float (&texels)[16][Channels], float (&mean)[Channels], float (&axis)[Channels])
+{
+    for (int c = 0; c < Channels; c++)
+    {
+        mean[c] = 0.f;
+        for (int i = 0; i < 16; i++)
+        {
+            mean[c] += texels[i][c];
+        }
+        mean[c] /= 16.f;
+    }
+
+    float covariance[Channels][Channels] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int a = 0; a < Channels; a++)
+        {
+            for (int b = 0; b < Channels; b++)
+            {
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // start along the bounding box diagonal, which is close to the answer for most blocks
+    for (int c = 0; c < Channels; c++)
+    {
+        float low = texels[0][c];
+        float high = texels[0][c];
+        for (int i = 1; i < 16; i++)
+        {
+            low = std::min(low, texels[i][c]);
+            high = std::max(high, texels[i][c]);
+        }
+        axis[c] = high - low;
+    }
+
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[Channels] = {};
+        for (int a = 0; a < Channels; a++)
+        {
+            for (int b = 0; b < Channels; b++)
+            {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+
+        float length = 0.f;
+        for (int c = 0; c < Channels; c++)
+        {
+            length = std::max(length, std::abs(next[c]));
+        }
+        if (length == 0.f)
+        {
+            break;
+        }
+        for (int c = 0; c < Channels; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+}
+
+// Endpoints at the extremes of the texels projected on their principal axis
+template <int Channels>
+void
+fit_endpoints(const float (&texels)[16][Channels], float (&low)[Channels], float (&high)[Channels])
+{
+    float mean[Channels];
+    float axis[Channels];
+    principal_axis(texels, mean, axis);
+
+    float lengthSquared = 0.f;
+    for (int c = 0; c < Channels; c++)
+    {
+        lengthSquared += axis[c] * axis[c];
+    }
+
+    float minT = 0.f;
+    float maxT = 0.f;
+    if (lengthSquared > 0.f)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.f;
+            for (int c = 0; c < Channels; c++)
+            {
+                t += (texels[i][c] - mean[c]) * axis[c];
+            }
+            t /= lengthSquared;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+
+    for (int c = 0; c < Channels; c++)
+    {
+        low[c] = std::clamp(mean[c] + axis[c] * minT, 0.f, 255.f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.f, 255.f);
+    }
+}
+
+// Least squares endpoints for texels already assigned interpolation weights in [0, 1],
+// returns false when every texel got the same weight
+template <int Channels>
+bool
+refine_endpoints(const float (&texels)[16][Channels], const float (&weights)[16], float (&low)[Channels],
+    float (&high)[Channels])
+{
+    float aa = 0.f;
+    float ab = 0.f;
+    float bb = 0.f;
+    float ax[Channels] = {};
+    float bx[Channels] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float b = weights[i];
+        float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < Channels; c++)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+    {
+        return false;
+    }
+
+    for (int c = 0; c < Channels; c++)
+    {
+        low[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.f, 255.f);
+        high[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.f, 255.f);
+    }
+    return true;
+}
+
+/*******************************************************
+ * BC1 color blocks
+ ******************************************************/
+
+uint16_t
+pack_565(const float (&color)[3])
+{
+    uint32_t r = (uint32_t)std::lround(color[0] * 31.f / 255.f);
+    uint32_t g = (uint32_t)std::lround(color[1] * 63.f / 255.f);
+    uint32_t b = (uint32_t)std::lround(color[2] * 31.f / 255.f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+std::array<int, 3>
+unpack_565(uint16_t packed)
+{
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+struct ColorBlock
+{
+    uint16_t color0;
+    uint16_t color1;
+    uint32_t indices;
+    int error;
+};
+
+// Picks the closest of the four colors for every texel, color0 > color1 so decoders use the 4 color mode
+ColorBlock
+assign_color_indices(const float (&texels)[16][3], uint16_t color0, uint16_t color1)
+{
+    // codes 0 and 1 are the endpoints, 2 and 3 the colors a third of the way in from each
+    std::array<int, 3> c0 = unpack_565(color0);
+    std::array<int, 3> c1 = unpack_565(color1);
+    int palette[4][3];
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = c0[c];
+        palette[1][c] = c1[c];
+        palette[2][c] = (2 * c0[c] + c1[c]) / 3;
+        palette[3][c] = (c0[c] + 2 * c1[c]) / 3;
+    }
+
+    ColorBlock block { color0, color1, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        int bestCode = 0;
+        int bestError = INT32_MAX;
+        for (int code = 0; code < (color0 == color1 ? 1 : 4); code++)
+        {
+            int error = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                int d = (int)std::lround(texels[i][c]) - palette[code][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestCode = code;
+            }
+        }
+        block.indices |= (uint32_t)bestCode << (2 * i);
+        block.error += bestError;
+    }
+    return block;
+}
+
+ColorBlock
+quantize_color_block(const float (&texels)[16][3], const float (&low)[3], const float (&high)[3])
+{
+    uint16_t color0 = pack_565(high);
+    uint16_t color1 = pack_565(low);
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+    return assign_color_indices(texels, color0, color1);
+}
+
+ColorBlock
+encode_color_block(const uint8_t* rgba)
+{
+    float texels[16][3];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            texels[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    float low[3];
+    float high[3];
+    fit_endpoints(texels, low, high);
+    ColorBlock best = quantize_color_block(texels, low, high);
+
+    // one least squares pass on the chosen indices, kept only when it helps
+    static constexpr float CODE_WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+        // weights run from color1 (0) to color0 (1)
+        weights[i] = 1.f - CODE_WEIGHTS[(best.indices >> (2 * i)) & 3];
+    }
+    if (best.color0 != best.color1 && refine_endpoints(texels, weights, low, high))
+    {
+        ColorBlock refined = quantize_color_block(texels, low, high);
+        if (refined.error < best.error)
+        {
+            best = refined;
+        }
+    }
+    return best;
+}
+
+void
+write_color_block(const ColorBlock& color, uint8_t* block)
+{
+    block[0] = (uint8_t)(color.color0 & 0xFF);
+    block[1] = (uint8_t)(color.color0 >> 8);
+    block[2] = (uint8_t)(color.color1 & 0xFF);
+    block[3] = (uint8_t)(color.color1 >> 8);
+    for (int i = 0; i < 4; i++)
+    {
+        block[4 + i] = (uint8_t)(color.indices >> (8 * i));
+    }
+}
+
+/*******************************************************
+ * BC3 alpha blocks
+ ******************************************************/
+
+void
+encode_alpha_block(const uint8_t* rgba, uint8_t* block)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        alpha0 = std::max<int>(alpha0, rgba[i * 4 + 3]);
+        alpha1 = std::min<int>(alpha1, rgba[i * 4 + 3]);
+    }
+
+    // alpha0 > alpha1 selects the mode with six interpolated values between the endpoints
+    int palette[8] = { alpha0, alpha1 };
+    for (int step = 1; step < 7; step++)
+    {
+        palette[step + 1] = ((7 - step) * alpha0 + step * alpha1) / 7;
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int alpha = rgba[i * 4 + 3];
+            int bestCode = 0;
+            for (int code = 1; code < 8; code++)
+            {
+                if (std::abs(palette[code] - alpha) < std::abs(palette[bestCode] - alpha))
+                {
+                    bestCode = code;
+                }
+            }
+            indices |= (uint64_t)bestCode << (3 * i);
+        }
+    }
+
+    block[0] = (uint8_t)alpha0;
+    block[1] = (uint8_t)alpha1;
+    for (int i = 0; i < 6; i++)
+    {
+        block[2 + i] = (uint8_t)(indices >> (8 * i));
+    }
+}
+
+/*******************************************************
+ * BC7 mode 6
+ ******************************************************/
+
+constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Endpoint
+{
+    // 7 bit channels, the p-bit is the shared lowest bit of the 8 bit value
+    int channels[4];
+    int pbit;
+
+    int value(int c) const { return (channels[c] << 1) | pbit; }
+};
+
+// Quantizes an RGBA endpoint trying both p-bits
+Bc7Endpoint
+quantize_bc7_endpoint(const float (&color)[4])
+{
+    Bc7Endpoint best {};
+    float bestError = -1.f;
+    for (int pbit = 0; pbit < 2; pbit++)
+    {
+        Bc7Endpoint endpoint {};
+        endpoint.pbit = pbit;
+        float error = 0.f;
+        for (int c = 0; c < 4; c++)
+        {
+            endpoint.channels[c] = std::clamp((int)std::lround((color[c] - pbit) / 2.f), 0, 127);
+            float d = color[c] - endpoint.value(c);
+            error += d * d;
+        }
+        if (bestError < 0.f || error < bestError)
+        {
+            best = endpoint;
+            bestError = error;
+        }
+    }
+    return best;
+}
+
+struct Bc7Block
+{
+    Bc7Endpoint endpoints[2];
+    uint8_t indices[16];
+    int error;
+};
+
+Bc7Block
+assign_bc7_indices(const float (&texels)[16][4], const Bc7Endpoint& endpoint0, const Bc7Endpoint& endpoint1)
+{
+    int palette[16][4];
+    for (int step = 0; step < 16; step++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            palette[step][c] = ((64 - BC7_WEIGHTS[step]) * endpoint0.value(c) + BC7_WEIGHTS[step] * endpoint1.value(c) + 32) >> 6;
+        }
+    }
+
+    Bc7Block block { { endpoint0, endpoint1 }, {}, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        int bestStep = 0;
+        int bestError = INT32_MAX;
+        for (int step = 0; step < 16; step++)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int d = (int)std::lround(texels[i][c]) - palette[step][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestStep = step;
+            }
+        }
+        block.indices[i] = (uint8_t)bestStep;
+        block.error += bestError;
+    }
+    return block;
+}
+
+// Little endian bit stream, the first field lands in the lowest bits of byte 0
+class BitWriter
+{
+public:
+    explicit BitWriter(uint8_t* data) : _data(data) { memset(_data, 0, 16); }
+
+    void write(uint32_t value, int bitCount)
+    {
+        for (int bit = 0; bit < bitCount; bit++, _position++)
+        {
+            if (value & (1u << bit))
+            {
+                _data[_position >> 3] |= (uint8_t)(1u << (_position & 7));
+            }
+        }
+    }
+
+private:
+    uint8_t* _data;
+    int _position {0};
+};
+
+/*******************************************************
+ * Mip chain
+ ******************************************************/
+
+float
+srgb_to_linear(uint8_t value)
+{
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> values;
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table[value];
+}
+
+uint8_t
+linear_to_srgb(float value)
+{
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    return (uint8_t)std::clamp((int)std::lround(c * 255.f), 0, 255);
+}
+
+// 2x2 box filter, odd rows and columns fold into the last texel of the smaller level
+std::vector<uint8_t>
+downsample(const uint8_t* source, uint32_t width, uint32_t height, bool srgb)
+{
+    const uint32_t halfWidth = std::max(width / 2, 1u);
+    const uint32_t halfHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> result((size_t)halfWidth * halfHeight * 4);
+
+    for (uint32_t y = 0; y < halfHeight; y++)
+    {
+        for (uint32_t x = 0; x < halfWidth; x++)
+        {
+            const uint32_t x0 = std::min(x * 2, width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            const uint32_t y0 = std::min(y * 2, height - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+            const uint8_t* texels[4] = {
+                &source[((size_t)y0 * width + x0) * 4],
+                &source[((size_t)y0 * width + x1) * 4],
+                &source[((size_t)y1 * width + x0) * 4],
+                &source[((size_t)y1 * width + x1) * 4],
+            };
+
+            uint8_t* out = &result[((size_t)y * halfWidth + x) * 4];
+            for (int c = 0; c < 4; c++)
+            {
+                if (srgb && c < 3)
+                {
+                    float sum = 0.f;
+                    for (const uint8_t* texel : texels)
+                    {
+                        sum += srgb_to_linear(texel[c]);
+                    }
+                    out[c] = linear_to_srgb(sum * 0.25f);
+                }
+                else
+                {
+                    int sum = 0;
+                    for (const uint8_t* texel : texels)
+                    {
+                        sum += texel[c];
+                    }
+                    out[c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+void
+compress_level(const uint8_t* rgba, uint32_t width, uint32_t height, TextureCompression compression, std::byte* output)
+{
+    const size_t blockSize = bc_block_size(compression);
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+
+    uint8_t texels[16 * 4];
+    for (uint32_t by = 0; by < blocksY; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            // blocks past the edge repeat the last row and column
+            for (uint32_t ty = 0; ty < 4; ty++)
+            {
+                for (uint32_t tx = 0; tx < 4; tx++)
+                {
+                    uint32_t x = std::min(bx * 4 + tx, width - 1);
+                    uint32_t y = std::min(by * 4 + ty, height - 1);
+                    memcpy(&texels[(ty * 4 + tx) * 4], &rgba[((size_t)y * width + x) * 4], 4);
+                }
+            }
+
+            uint8_t* block = reinterpret_cast<uint8_t*>(output) + ((size_t)by * blocksX + bx) * blockSize;
+            switch (compression)
+            {
+            case TextureCompression::BC1:
+                encode_bc1_block(texels, block);
+                break;
+            case TextureCompression::BC3:
+                encode_bc3_block(texels, block);
+                break;
+            case TextureCompression::BC7:
+                encode_bc7_block(texels, block);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+} // namespace
+
+size_t
+bc_block_size(TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::BC1:
+        return BC1_BLOCK_SIZE;
+    case TextureCompression::BC3:
+        return BC3_BLOCK_SIZE;
+    case TextureCompression::BC7:
+        return BC7_BLOCK_SIZE;
+    default:
+        return 0;
+    }
+}
+
+VkFormat
+bc_format(TextureCompression compression, bool srgb)
+{
+    switch (compression)
+    {
+    case TextureCompression::BC1:
+        return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case TextureCompression::BC3:
+        return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case TextureCompression::BC7:
+        return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default:
+        return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+uint64_t
+bc_level_size(TextureCompression compression, uint32_t width, uint32_t height)
+{
+    return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * bc_block_size(compression);
+}
+
+void
+encode_bc1_block(const uint8_t* texels, uint8_t* block)
+{
+    write_color_block(encode_color_block(texels), block);
+}
+
+void
+encode_bc3_block(const uint8_t* texels, uint8_t* block)
+{
+    encode_alpha_block(texels, block);
+    write_color_block(encode_color_block(texels), block + 8);
+}
+
+void
+encode_bc7_block(const uint8_t* texels, uint8_t* block)
+{
+    float colors[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            colors[i][c] = texels[i * 4 + c];
+        }
+    }
+
+    float low[4];
+    float high[4];
+    fit_endpoints(colors, low, high);
+    Bc7Block best = assign_bc7_indices(colors, quantize_bc7_endpoint(low), quantize_bc7_endpoint(high));
+
+    // one least squares pass on the chosen indices, kept only when it helps
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+        weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.f;
+    }
+    if (refine_endpoints(colors, weights, low, high))
+    {
+        Bc7Block refined = assign_bc7_indices(colors, quantize_bc7_endpoint(low), quantize_bc7_endpoint(high));
+        if (refined.error < best.error)
+        {
+            best = refined;
+        }
+    }
+
+    // the highest index bit of texel 0 is implied 0, swapping the endpoints flips the indices
+    if (best.indices[0] >= 8)
+    {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        for (uint8_t& index : best.indices)
+        {
+            index = (uint8_t)(15 - index);
+        }
+    }
+
+    BitWriter writer(block);
+    writer.write(1u << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        writer.write((uint32_t)best.endpoints[0].channels[c], 7);
+        writer.write((uint32_t)best.endpoints[1].channels[c], 7);
+    }
+    writer.write((uint32_t)best.endpoints[0].pbit, 1);
+    writer.write((uint32_t)best.endpoints[1].pbit, 1);
+    writer.write(best.indices[0], 3);
+    for (int i = 1; i < 16; i++)
+    {
+        writer.write(best.indices[i], 4);
+    }
+}
+
+bool
+has_transparency(const uint8_t* rgba, size_t texelCount)
+{
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        if (rgba[i * 4 + 3] != 255)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+TextureCompression
+resolve_compression(TextureCompression compression, const uint8_t* rgba, size_t texelCount)
+{
+    if (compression != TextureCompression::Auto)
+    {
+        return compression;
+    }
+    return has_transparency(rgba, texelCount) ? TextureCompression::BC3 : TextureCompression::BC1;
+}
+
+CompressedTexture
+compress_texture(const uint8_t* rgba, VkExtent2D size, TextureCompression compression, bool srgb, bool mipmapped)
+{
+    CompressedTexture texture;
+    texture.compression = compression;
+
+    uint32_t width = size.width;
+    uint32_t height = size.height;
+    const uint32_t levelCount = mipmapped
+        ? (uint32_t)std::floor(std::log2(std::max(width, height))) + 1
+        : 1;
+
+    // lay the chain out first so the data is allocated once
+    uint64_t offset = 0;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        TextureMipLevel mip { width, height, offset, bc_level_size(compression, width, height) };
+        texture.mips.push_back(mip);
+        offset += mip.size;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    texture.data.resize(offset);
+
+    std::vector<uint8_t> levelTexels;
+    const uint8_t* texels = rgba;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        const TextureMipLevel& mip = texture.mips[level];
+        if (level > 0)
+        {
+            const TextureMipLevel& previous = texture.mips[level - 1];
+            levelTexels = downsample(texels, previous.width, previous.height, srgb);
+            texels = levelTexels.data();
+        }
+        compress_level(texels, mip.width, mip.height, compression, texture.data.data() + mip.offset);
+    }
+
+    return texture;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vk_types.h>
+
+// Bytes of one 4x4 block
+constexpr size_t BC1_BLOCK_SIZE = 8;
+constexpr size_t BC3_BLOCK_SIZE = 16;
+constexpr size_t BC7_BLOCK_SIZE = 16;
+
+// One level of a compressed mip chain, offset is into the data of the chain
+struct TextureMipLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Block compressed mip chain of one image, level 0 first
+struct CompressedTexture
+{
+    TextureCompression compression;
+    std::vector<TextureMipLevel> mips;
+    std::vector<std::byte> data;
+};
+
+size_t bc_block_size(TextureCompression compression);
+VkFormat bc_format(TextureCompression compression, bool srgb);
+
+// Size of a level with the width and height rounded up to whole blocks
+uint64_t bc_level_size(TextureCompression compression, uint32_t width, uint32_t height);
+
+// Encoders for one block of 16 RGBA8 texels in row order
+void encode_bc1_block(const uint8_t* texels, uint8_t* block);
+void encode_bc3_block(const uint8_t* texels, uint8_t* block);
+// Mode 6 only: one subset, 7 bit RGBA endpoints with a p-bit each and 16 interpolation steps
+void encode_bc7_block(const uint8_t* texels, uint8_t* block);
+
+// True when any texel has an alpha below 255
+bool has_transparency(const uint8_t* rgba, size_t texelCount);
+
+// Resolves Auto to BC1 or BC3 depending on the alpha of the image
+TextureCompression resolve_compression(TextureCompression compression, const uint8_t* rgba, size_t texelCount);
+
+// Builds the mip chain on the CPU with a box filter (averaged in linear light for sRGB
+// images, which the GPU blit does not do) and compresses every level.
+// compression must not be None or Auto.
+CompressedTexture compress_texture(const uint8_t* rgba, VkExtent2D size, TextureCompression compression, bool srgb,
+    bool mipmapped);
@@ -0,0 +1,794 @@
+#include <vk_upload.h>
+
+#include <vk_barriers.h>
+#include <vk_engine.h>
+#include <vk_images.h>
+#include <vk_initializers.h>
+#include <vk_vertex_format.h>
+
+#include <algorithm>
+#include <iterator>
+
+/*******************************************************
+ * AsyncUploader
+ ******************************************************/
+bool
+AsyncUploader::init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily,
+	std::mutex* queueMutex)
+{
+	_device = device;
+	_queue = queue;
+	_queueMutex = queueMutex;
+	_queueFamily = queueFamily;
+	_graphicsQueueFamily = graphicsQueueFamily;
+
+	VkCommandPoolCreateInfo commandPoolInfo = vkinit::command_pool_create_info(_queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VK_CHECK(vkCreateCommandPool(_device, &commandPoolInfo, nullptr, &_commandPool));
+
+	VkSemaphoreTypeCreateInfo timelineInfo { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphore_create_info();
+	semaphoreInfo.pNext = &timelineInfo;
+	VK_CHECK(vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_timeline));
+
+	return true;
+}
+
+void
+AsyncUploader::cleanup()
+{
+	// wait for everything still in flight so the callbacks can free their resources
+	if (_nextValue > 1)
+	{
+		wait(UploadTicket { _nextValue - 1 });
+	}
+	collect();
+
+	vkDestroySemaphore(_device, _timeline, nullptr);
+	vkDestroyCommandPool(_device, _commandPool, nullptr);
+}
+
+UploadTicket
+AsyncUploader::submit(std::function<void(VkCommandBuffer cmd)>&& function,
+	std::span<const BufferRange> releasedRanges, std::function<void()>&& onComplete)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	VkCommandBuffer cmd;
+	if (!_freeCommandBuffers.empty())
+	{
+		cmd = _freeCommandBuffers.back();
+		_freeCommandBuffers.pop_back();
+		VK_CHECK(vkResetCommandBuffer(cmd, 0));
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(_commandPool, 1);
+		VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo, &cmd));
+	}
+
+	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+	function(cmd);
+
+	const uint64_t value = _nextValue++;
+
+	// Release half of the queue family ownership transfer, the graphics queue acquires in acquire()
+	if (transfers_ownership() && !releasedRanges.empty())
+	{
+		// nothing on this queue waits for the copies any more, the acquire does
+		vkutil::BarrierScope copyWrite {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+		vkutil::BarrierBuilder barriers;
+		for (const BufferRange& range : releasedRanges)
+		{
+			barriers.buffer_ownership(range.buffer, copyWrite, vkutil::scope::None, _queueFamily, _graphicsQueueFamily,
+				range.offset, range.size);
+		}
+		barriers.flush(cmd);
+
+		_pendingAcquires[value].assign(releasedRanges.begin(), releasedRanges.end());
+	}
+
+	VK_CHECK(vkEndCommandBuffer(cmd));
+
+	VkCommandBufferSubmitInfo cmdinfo = vkinit::command_buffer_submit_info(cmd);
+	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, _timeline);
+	signalInfo.value = value;
+
+	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, nullptr);
+	{
+		std::unique_lock<std::mutex> queueLock;
+		if (_queueMutex)
+		{
+			queueLock = std::unique_lock<std::mutex>(*_queueMutex);
+		}
+		VK_CHECK(vkQueueSubmit2(_queue, 1, &submit, VK_NULL_HANDLE));
+	}
+
+	_inFlight.push_back(InFlightUpload { value, cmd, std::move(onComplete) });
+
+	return UploadTicket { value };
+}
+
+uint64_t
+AsyncUploader::completed_value()
+{
+	uint64_t value;
+	VK_CHECK(vkGetSemaphoreCounterValue(_device, _timeline, &value));
+	return value;
+}
+
+bool
+AsyncUploader::is_complete(UploadTicket ticket)
+{
+	return ticket.value == 0 || completed_value() >= ticket.value;
+}
+
+void
+AsyncUploader::wait(UploadTicket ticket)
+{
+	if (ticket.value == 0)
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &_timeline;
+	waitInfo.pValues = &ticket.value;
+	VK_CHECK(vkWaitSemaphores(_device, &waitInfo, 9999999999));
+}
+
+bool
+AsyncUploader::acquire(VkCommandBuffer cmd, UploadTicket ticket)
+{
+	if (!is_complete(ticket))
+	{
+		return false;
+	}
+
+	if (ticket.value == 0)
+	{
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// The graphics submit waits on the timeline even without an ownership transfer,
+	// that wait is what makes the copied data visible to the graphics queue
+	_graphicsWaitValue = std::max(_graphicsWaitValue, ticket.value);
+
+	auto pending = _pendingAcquires.find(ticket.value);
+	if (pending == _pendingAcquires.end())
+	{
+		return true;
+	}
+
+	// the timeline wait already covers the copies, so only the reads of the geometry are blocked
+	vkutil::BarrierScope geometryRead {
+		VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_INDEX_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+	vkutil::BarrierBuilder barriers;
+	for (const BufferRange& range : pending->second)
+	{
+		barriers.buffer_ownership(range.buffer, vkutil::scope::None, geometryRead, _queueFamily, _graphicsQueueFamily,
+			range.offset, range.size);
+	}
+	barriers.flush(cmd);
+
+	_pendingAcquires.erase(pending);
+
+	return true;
+}
+
+void
+AsyncUploader::discard(UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_pendingAcquires.erase(ticket.value);
+}
+
+uint64_t
+AsyncUploader::take_graphics_wait_value()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	uint64_t value = _graphicsWaitValue;
+	_graphicsWaitValue = 0;
+	return value;
+}
+
+void
+AsyncUploader::collect()
+{
+	std::vector<std::function<void()>> completed;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		const uint64_t completedValue = completed_value();
+		while (!_inFlight.empty() && _inFlight.front().value <= completedValue)
+		{
+			_freeCommandBuffers.push_back(_inFlight.front().cmd);
+			if (_inFlight.front().onComplete)
+			{
+				completed.push_back(std::move(_inFlight.front().onComplete));
+			}
+			_inFlight.pop_front();
+		}
+	}
+
+	// run outside the lock, callbacks are free to submit more uploads
+	for (std::function<void()>& onComplete : completed)
+	{
+		onComplete();
+	}
+}
+
+/*******************************************************
+ * StagingRing
+ ******************************************************/
+void
+StagingRing::init(VulkanEngine* engine, VkDeviceSize capacity)
+{
+	_engine = engine;
+	_capacity = capacity;
+
+	// CPU_ONLY memory from create_buffer is persistently mapped
+	_buffer = _engine->create_buffer(_capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+	_data = (std::byte*)_buffer.allocation->GetMappedData();
+
+	_stats.capacity = _capacity;
+}
+
+void
+StagingRing::cleanup()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// everything still queued has to finish reading before the memory goes away
+	for (const Region& region : _regions)
+	{
+		_engine->_uploader.wait(region.ticket);
+	}
+	for (const DedicatedBuffer& dedicated : _dedicated)
+	{
+		_engine->_uploader.wait(dedicated.ticket);
+		_engine->destroy_buffer(dedicated.buffer);
+	}
+	_regions.clear();
+	_dedicated.clear();
+
+	_engine->destroy_buffer(_buffer);
+}
+
+VkDeviceSize
+StagingRing::used_locked() const
+{
+	if (_regions.empty())
+	{
+		return 0;
+	}
+
+	const VkDeviceSize tail = _regions.front().begin;
+	return tail < _head ? _head - tail : _capacity - tail + _head;
+}
+
+VkDeviceSize
+StagingRing::find_space(VkDeviceSize size, VkDeviceSize alignment, bool& wraps) const
+{
+	wraps = false;
+
+	if (_regions.empty())
+	{
+		return size <= _capacity ? 0 : _capacity;
+	}
+
+	const VkDeviceSize tail = _regions.front().begin;
+	const VkDeviceSize alignedHead = (_head + alignment - 1) / alignment * alignment;
+
+	if (tail < _head)
+	{
+		// free space is [head, capacity) followed by [0, tail)
+		if (alignedHead + size <= _capacity)
+		{
+			return alignedHead;
+		}
+		if (size <= tail)
+		{
+			wraps = true;
+			return 0;
+		}
+	}
+	else if (alignedHead + size <= tail)
+	{
+		// wrapped already, free space is [head, tail)
+		return alignedHead;
+	}
+
+	return _capacity;
+}
+
+StagingAllocation
+StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_stats.allocations++;
+	size = std::max<VkDeviceSize>(size, 1);
+
+	if (size <= _capacity)
+	{
+		reclaim_locked();
+
+		bool wraps = false;
+		VkDeviceSize offset = find_space(size, alignment, wraps);
+
+		// Full, wait for the oldest upload to finish as long as it has been submitted
+		while (offset == _capacity && !_regions.empty() && _regions.front().released)
+		{
+			_stats.stalls++;
+			_engine->_uploader.wait(_regions.front().ticket);
+			reclaim_locked();
+			offset = find_space(size, alignment, wraps);
+		}
+
+		if (offset != _capacity)
+		{
+			if (_regions.empty())
+			{
+				_head = 0;
+			}
+			else if (wraps)
+			{
+				// the unused end of the ring is given back with the last region
+				_regions.back().end = _capacity;
+			}
+
+			Region region;
+			region.id = _nextRegionId++;
+			region.begin = wraps || _regions.empty() ? offset : _head;
+			region.end = offset + size;
+			region.released = false;
+			_regions.push_back(region);
+			_head = region.end;
+
+			_stats.peakUsed = std::max(_stats.peakUsed, used_locked());
+
+			return StagingAllocation { _buffer.buffer, offset, _data + offset, region.id, {} };
+		}
+	}
+
+	// Too big for the ring, or waiting on memory that has not been submitted yet
+	_stats.fallbacks++;
+
+	StagingAllocation allocation;
+	allocation.dedicated = _engine->create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+	allocation.buffer = allocation.dedicated.buffer;
+	allocation.offset = 0;
+	allocation.data = (std::byte*)allocation.dedicated.allocation->GetMappedData();
+	allocation.regionId = 0;
+	return allocation;
+}
+
+void
+StagingRing::release(const StagingAllocation& allocation, UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (allocation.regionId == 0)
+	{
+		_dedicated.push_back(DedicatedBuffer { allocation.dedicated, ticket });
+	}
+	else
+	{
+		// recent allocations are at the back
+		for (auto it = _regions.rbegin(); it != _regions.rend(); it++)
+		{
+			if (it->id == allocation.regionId)
+			{
+				it->ticket = ticket;
+				it->released = true;
+				break;
+			}
+		}
+	}
+
+	reclaim_locked();
+}
+
+void
+StagingRing::reclaim()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	reclaim_locked();
+}
+
+void
+StagingRing::reclaim_locked()
+{
+	// regions are reused strictly in order, so stop at the first one still in use
+	while (!_regions.empty() && _regions.front().released && _engine->_uploader.is_complete(_regions.front().ticket))
+	{
+		_regions.pop_front();
+	}
+
+	std::erase_if(_dedicated, [this](const DedicatedBuffer& dedicated) {
+		if (!_engine->_uploader.is_complete(dedicated.ticket))
+		{
+			return false;
+		}
+		_engine->destroy_buffer(dedicated.buffer);
+		return true;
+	});
+}
+
+StagingRing::Stats
+StagingRing::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_stats.used = used_locked();
+	return _stats;
+}
+
+/*******************************************************
+ * MeshUploadBatch
+ ******************************************************/
+namespace
+{
+
+// Meshlets follow the vertices of a mesh, aligned for std430 reads through buffer device addresses
+size_t
+meshlet_offset(size_t vertexDataSize)
+{
+	return (vertexDataSize + 15) & ~size_t(15);
+}
+
+} // namespace
+
+MeshUploadBatch::~MeshUploadBatch()
+{
+	// Never leave buffers handed out by add() without their contents
+	flush();
+}
+
+std::optional<GPUMeshBuffers>
+MeshUploadBatch::add(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+	std::span<const Meshlet> meshlets)
+{
+	return add_raw(indices, std::as_bytes(vertices), vertices.size(), meshlets);
+}
+
+std::optional<GPUMeshBuffers>
+MeshUploadBatch::add(std::span<const uint32_t> indices, std::span<const PackedVertex> vertices,
+	const VertexQuantization& quantization, std::span<const Meshlet> meshlets)
+{
+	std::optional<GPUMeshBuffers> newSurface = add_raw(indices, std::as_bytes(vertices), vertices.size(), meshlets);
+	if (newSurface)
+	{
+		newSurface->vertexFormat = VertexFormat::Packed;
+		newSurface->quantization = quantization;
+	}
+	return newSurface;
+}
+
+std::optional<GPUMeshBuffers>
+MeshUploadBatch::add(const MeshData& mesh)
+{
+	if (mesh.vertexFormat == VertexFormat::Packed)
+	{
+		return add(mesh.indices, mesh.packedVertices, mesh.quantization, mesh.meshlets);
+	}
+	return add(mesh.indices, mesh.vertices, mesh.meshlets);
+}
+
+std::optional<GPUMeshBuffers>
+MeshUploadBatch::add_raw(std::span<const uint32_t> indices, std::span<const std::byte> vertexData,
+	size_t vertexCount, std::span<const Meshlet> meshlets)
+{
+	GeometryPool& pool = _engine->_geometryPool;
+
+	GPUMeshBuffers newSurface;
+	newSurface.indexType = vertexCount <= UINT16_MAX ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	const size_t meshletOffset = meshlet_offset(vertexData.size());
+	const size_t vertexBufferSize = meshlets.empty() ? vertexData.size() : meshletOffset + meshlets.size_bytes();
+	const size_t indexBufferSize = indices.size() * index_size(newSurface.indexType);
+
+	// claim ranges of the shared geometry buffers
+	if (!pool.allocate_vertices(vertexBufferSize, newSurface.vertexRange))
+	{
+		return {};
+	}
+	if (!pool.allocate_indices(indexBufferSize, newSurface.indexRange))
+	{
+		pool.free(newSurface);
+		return {};
+	}
+
+	newSurface.vertexBufferAddress = pool.vertex_buffer_address() + newSurface.vertexRange.offset;
+	if (!meshlets.empty())
+	{
+		newSurface.meshletBufferAddress = newSurface.vertexBufferAddress + meshletOffset;
+	}
+	newSurface.firstIndex = (uint32_t)(newSurface.indexRange.offset / index_size(newSurface.indexType));
+
+	_pending.push_back(PendingMesh { indices, vertexData, std::as_bytes(meshlets), newSurface.indexType, newSurface });
+	_stagingSize += vertexBufferSize + indexBufferSize;
+
+	return newSurface;
+}
+
+StagingAllocation
+MeshUploadBatch::stage(std::vector<VkBufferCopy>& vertexCopies, std::vector<VkBufferCopy>& indexCopies)
+{
+	// One slice of staging memory holding the data of every mesh in the batch
+	StagingAllocation staging = _engine->_stagingRing.allocate(_stagingSize);
+
+	vertexCopies.resize(_pending.size());
+	indexCopies.resize(_pending.size());
+
+	size_t offset = 0;
+	for (size_t i = 0; i < _pending.size(); i++)
+	{
+		const PendingMesh& mesh = _pending[i];
+		const size_t vertexBufferSize = mesh.meshBuffers.vertexRange.size;
+		const size_t indexBufferSize = mesh.indices.size() * index_size(mesh.indexType);
+
+		// copy vertex buffer, followed by the meshlets
+		memcpy(staging.data + offset, mesh.vertexData.data(), mesh.vertexData.size());
+		if (!mesh.meshletData.empty())
+		{
+			const size_t meshletOffset = meshlet_offset(mesh.vertexData.size());
+			memset(staging.data + offset + mesh.vertexData.size(), 0, meshletOffset - mesh.vertexData.size());
+			memcpy(staging.data + offset + meshletOffset, mesh.meshletData.data(), mesh.meshletData.size());
+		}
+		vertexCopies[i] = VkBufferCopy { .srcOffset = staging.offset + offset, .dstOffset = mesh.meshBuffers.vertexRange.offset, .size = vertexBufferSize };
+		offset += vertexBufferSize;
+
+		// copy index buffer, narrowing on the way if needed
+		if (mesh.indexType == VK_INDEX_TYPE_UINT16)
+		{
+			uint16_t* indices16 = reinterpret_cast<uint16_t*>(staging.data + offset);
+			for (size_t index = 0; index < mesh.indices.size(); index++)
+			{
+				indices16[index] = (uint16_t)mesh.indices[index];
+			}
+		}
+		else
+		{
+			memcpy(staging.data + offset, mesh.indices.data(), indexBufferSize);
+		}
+		indexCopies[i] = VkBufferCopy { .srcOffset = staging.offset + offset, .dstOffset = mesh.meshBuffers.indexRange.offset, .size = indexBufferSize };
+		offset += indexBufferSize;
+	}
+
+	return staging;
+}
+
+void
+MeshUploadBatch::record_copies(VkCommandBuffer cmd, VkBuffer staging,
+	const std::vector<VkBufferCopy>& vertexCopies, const std::vector<VkBufferCopy>& indexCopies)
+{
+	// zero sized copies are not allowed
+	auto nonEmpty = [](const VkBufferCopy& copy) { return copy.size > 0; };
+
+	std::vector<VkBufferCopy> regions;
+	std::copy_if(vertexCopies.begin(), vertexCopies.end(), std::back_inserter(regions), nonEmpty);
+	if (!regions.empty())
+	{
+		vkCmdCopyBuffer(cmd, staging, _engine->_geometryPool.vertex_buffer(), (uint32_t)regions.size(), regions.data());
+	}
+
+	regions.clear();
+	std::copy_if(indexCopies.begin(), indexCopies.end(), std::back_inserter(regions), nonEmpty);
+	if (!regions.empty())
+	{
+		vkCmdCopyBuffer(cmd, staging, _engine->_geometryPool.index_buffer(), (uint32_t)regions.size(), regions.data());
+	}
+}
+
+void
+MeshUploadBatch::flush()
+{
+	if (_pending.empty())
+	{
+		return;
+	}
+
+	std::vector<VkBufferCopy> vertexCopies;
+	std::vector<VkBufferCopy> indexCopies;
+	StagingAllocation staging = stage(vertexCopies, indexCopies);
+
+	_engine->immediate_submit([&](VkCommandBuffer cmd) {
+		record_copies(cmd, staging.buffer, vertexCopies, indexCopies);
+	});
+
+	// the copies are done once immediate_submit returns
+	_engine->_stagingRing.release(staging, UploadTicket {});
+
+	_pending.clear();
+	_stagingSize = 0;
+}
+
+UploadTicket
+MeshUploadBatch::submit()
+{
+	if (_pending.empty())
+	{
+		return UploadTicket {};
+	}
+
+	std::vector<VkBufferCopy> vertexCopies;
+	std::vector<VkBufferCopy> indexCopies;
+	StagingAllocation staging = stage(vertexCopies, indexCopies);
+
+	std::vector<BufferRange> releasedRanges;
+	for (const PendingMesh& mesh : _pending)
+	{
+		const GPUMeshBuffers& meshBuffers = mesh.meshBuffers;
+		if (meshBuffers.vertexRange.size > 0)
+		{
+			releasedRanges.push_back(BufferRange { _engine->_geometryPool.vertex_buffer(), meshBuffers.vertexRange.offset, meshBuffers.vertexRange.size });
+		}
+		if (meshBuffers.indexRange.size > 0)
+		{
+			releasedRanges.push_back(BufferRange { _engine->_geometryPool.index_buffer(), meshBuffers.indexRange.offset, meshBuffers.indexRange.size });
+		}
+	}
+
+	UploadTicket ticket = _engine->_uploader.submit(
+		[&](VkCommandBuffer cmd) {
+			record_copies(cmd, staging.buffer, vertexCopies, indexCopies);
+		},
+		releasedRanges);
+
+	// staging memory is reused once the transfer queue is done with it
+	_engine->_stagingRing.release(staging, ticket);
+
+	_pending.clear();
+	_stagingSize = 0;
+
+	return ticket;
+}
+
+void
+MeshUploadBatch::discard()
+{
+	for (PendingMesh& mesh : _pending)
+	{
+		_engine->_geometryPool.free(mesh.meshBuffers);
+	}
+
+	_pending.clear();
+	_stagingSize = 0;
+}
+
+/*******************************************************
+ * TextureUploadBatch
+ ******************************************************/
+TextureUploadBatch::~TextureUploadBatch()
+{
+	// Never leave images handed out by add() without their contents
+	flush();
+}
+
+AllocatedImage
+TextureUploadBatch::add(std::span<const std::byte> pixels, VkExtent2D size, VkFormat format, bool mipmapped)
+{
+	// the mip chain is blitted from level 0, so the image is a transfer source as well
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (mipmapped)
+	{
+		usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+
+	PendingImage& pending = _pending.emplace_back();
+	pending.image = _engine->create_image(VkExtent3D { size.width, size.height, 1 }, format, usage, mipmapped);
+
+	// buffer to image copies need the offset aligned to the texel size
+	pending.staging = _engine->_stagingRing.allocate(pixels.size(), 16);
+	memcpy(pending.staging.data, pixels.data(), pixels.size());
+	_pendingBytes += pixels.size();
+
+	return pending.image;
+}
+
+AllocatedImage
+TextureUploadBatch::add_compressed(std::span<const std::byte> data, std::span<const TextureMipLevel> mips,
+	VkExtent2D size, VkFormat format)
+{
+	PendingImage& pending = _pending.emplace_back();
+	pending.image = _engine->create_image(VkExtent3D { size.width, size.height, 1 }, format,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, mips.size() > 1);
+	pending.mips.assign(mips.begin(), mips.end());
+
+	// every level starts on a whole block, so 16 keeps all the copy offsets block aligned
+	pending.staging = _engine->_stagingRing.allocate(data.size(), 16);
+	memcpy(pending.staging.data, data.data(), data.size());
+	_pendingBytes += data.size();
+
+	return pending.image;
+}
+
+void
+TextureUploadBatch::flush()
+{
+	if (_pending.empty())
+	{
+		return;
+	}
+
+	_engine->immediate_submit([&](VkCommandBuffer cmd) {
+		// the old contents are discarded, so only the copies wait and all images move together
+		vkutil::BarrierBuilder barriers;
+		for (const PendingImage& pending : _pending)
+		{
+			barriers.image(pending.image.image, vkutil::scope::None, vkutil::scope::TransferDst);
+		}
+		barriers.flush(cmd);
+
+		for (const PendingImage& pending : _pending)
+		{
+			const AllocatedImage& image = pending.image;
+
+			if (!pending.mips.empty())
+			{
+				std::vector<VkBufferImageCopy> copyRegions;
+				copyRegions.reserve(pending.mips.size());
+				for (uint32_t level = 0; level < pending.mips.size(); level++)
+				{
+					const TextureMipLevel& mip = pending.mips[level];
+
+					VkBufferImageCopy copyRegion {};
+					copyRegion.bufferOffset = pending.staging.offset + mip.offset;
+					copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					copyRegion.imageSubresource.mipLevel = level;
+					copyRegion.imageSubresource.baseArrayLayer = 0;
+					copyRegion.imageSubresource.layerCount = 1;
+					copyRegion.imageExtent = VkExtent3D { mip.width, mip.height, 1 };
+					copyRegions.push_back(copyRegion);
+				}
+
+				vkCmdCopyBufferToImage(cmd, pending.staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					(uint32_t)copyRegions.size(), copyRegions.data());
+				barriers.image(image.image, vkutil::scope::TransferDst, vkutil::scope::ShaderSampled);
+				continue;
+			}
+
+			VkBufferImageCopy copyRegion {};
+			copyRegion.bufferOffset = pending.staging.offset;
+			copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copyRegion.imageSubresource.mipLevel = 0;
+			copyRegion.imageSubresource.baseArrayLayer = 0;
+			copyRegion.imageSubresource.layerCount = 1;
+			copyRegion.imageExtent = image.imageExtent;
+
+			vkCmdCopyBufferToImage(cmd, pending.staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+			if (image.mipLevels > 1)
+			{
+				vkutil::generate_mipmaps(cmd, image.image, VkExtent2D { image.imageExtent.width, image.imageExtent.height }, image.mipLevels);
+			}
+			else
+			{
+				barriers.image(image.image, vkutil::scope::TransferDst, vkutil::scope::ShaderSampled);
+			}
+		}
+
+		// images without generated mips become readable together after all the copies
+		barriers.flush(cmd);
+	});
+
+	// the copies are done once immediate_submit returns
+	for (const PendingImage& pending : _pending)
+	{
+		_engine->_stagingRing.release(pending.staging, UploadTicket {});
+	}
+
+	_pending.clear();
+	_pendingBytes = 0;
+}
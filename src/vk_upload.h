@@ -0,0 +1,269 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vk_loader.h>
+#include <vk_texture_compress.h>
+
+#include <mutex>
+#include <unordered_map>
+
+//forward declaration
+class VulkanEngine;
+
+// Part of a buffer written by an upload
+struct BufferRange
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// Submits uploads to a transfer queue without blocking the CPU.
+// Every submit signals the next value of a timeline semaphore, which is
+// returned as the ticket of that upload. When the transfer queue belongs to a
+// different family than the graphics queue, the uploaded buffer ranges are released
+// by the transfer queue and acquired again by the graphics queue in acquire().
+class AsyncUploader
+{
+public:
+    // queueMutex guards the queue when it is shared with the render loop, null for a queue of our own
+    bool init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily,
+        std::mutex* queueMutex);
+    void cleanup();
+
+    // Records function into a fresh command buffer and submits it straight away.
+    // Ownership of releasedRanges is handed to the graphics queue family.
+    // onComplete is called from collect() once the GPU has finished the upload.
+    UploadTicket submit(std::function<void(VkCommandBuffer cmd)>&& function,
+        std::span<const BufferRange> releasedRanges, std::function<void()>&& onComplete = {});
+
+    bool is_complete(UploadTicket ticket);
+    void wait(UploadTicket ticket);
+
+    // Makes the buffer ranges of a finished upload usable on the graphics queue. Has
+    // to be recorded before they are used, and returns false while the upload is
+    // still in flight so the caller can skip the resource for this frame.
+    bool acquire(VkCommandBuffer cmd, UploadTicket ticket);
+    // Drops the ownership transfer of an upload whose ranges are freed without ever being acquired
+    void discard(UploadTicket ticket);
+
+    // Timeline value the next graphics submit has to wait on for the uploads it
+    // acquired, or 0 when there is nothing to wait on. Resets after each call.
+    uint64_t take_graphics_wait_value();
+
+    // Recycles command buffers and runs completion callbacks of finished uploads
+    void collect();
+
+    VkSemaphore semaphore() const { return _timeline; }
+    uint32_t queue_family() const { return _queueFamily; }
+    bool transfers_ownership() const { return _queueFamily != _graphicsQueueFamily; }
+
+private:
+    struct InFlightUpload
+    {
+        uint64_t value;
+        VkCommandBuffer cmd;
+        std::function<void()> onComplete;
+    };
+
+    uint64_t completed_value();
+
+    VkDevice _device;
+    VkQueue _queue;
+    std::mutex* _queueMutex;
+    uint32_t _queueFamily;
+    uint32_t _graphicsQueueFamily;
+
+    VkCommandPool _commandPool;
+    VkSemaphore _timeline;
+    uint64_t _nextValue {1};
+
+    std::deque<InFlightUpload> _inFlight;
+    std::vector<VkCommandBuffer> _freeCommandBuffers;
+
+    // ranges released by the transfer queue that the graphics queue still has to acquire
+    std::unordered_map<uint64_t, std::vector<BufferRange>> _pendingAcquires;
+    uint64_t _graphicsWaitValue {0};
+
+    // uploads may be submitted from any thread
+    std::mutex _mutex;
+};
+
+// Staging memory handed out by StagingRing, either a slice of the ring buffer
+// or a dedicated buffer when the request does not fit in the ring
+struct StagingAllocation
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    std::byte* data;
+
+    uint64_t regionId {0}; // 0 for dedicated buffers
+    AllocatedBuffer dedicated;
+};
+
+// Persistently mapped staging buffer used as a ring. Every allocation is tied to
+// the upload ticket that reads it and reclaimed in order once that upload is done.
+// Requests larger than the ring, or that can not wait for space, fall back to a
+// dedicated staging buffer.
+class StagingRing
+{
+public:
+    struct Stats
+    {
+        VkDeviceSize capacity;
+        VkDeviceSize used;
+        VkDeviceSize peakUsed;
+        uint64_t allocations;
+        uint64_t stalls;    // times an allocation had to wait on the GPU for space
+        uint64_t fallbacks; // dedicated staging buffers created instead
+    };
+
+    void init(VulkanEngine* engine, VkDeviceSize capacity);
+    void cleanup();
+
+    StagingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+    // Hands the allocation back, it is reused once ticket completes (a 0 ticket completes right away)
+    void release(const StagingAllocation& allocation, UploadTicket ticket);
+
+    // Reclaims every region whose upload has completed
+    void reclaim();
+
+    Stats stats();
+
+private:
+    struct Region
+    {
+        uint64_t id;
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        UploadTicket ticket;
+        bool released;
+    };
+
+    struct DedicatedBuffer
+    {
+        AllocatedBuffer buffer;
+        UploadTicket ticket;
+    };
+
+    void reclaim_locked();
+    VkDeviceSize used_locked() const;
+    // Offset for a new region, or capacity when there is no room right now
+    VkDeviceSize find_space(VkDeviceSize size, VkDeviceSize alignment, bool& wraps) const;
+
+    VulkanEngine* _engine;
+    AllocatedBuffer _buffer;
+    std::byte* _data;
+    VkDeviceSize _capacity {0};
+
+    std::deque<Region> _regions; // oldest first
+    VkDeviceSize _head {0};
+    uint64_t _nextRegionId {1};
+
+    std::vector<DedicatedBuffer> _dedicated;
+
+    Stats _stats {};
+    std::mutex _mutex;
+};
+
+// Collects many mesh uploads and sends them to the GPU together, using one
+// staging buffer, one command buffer and one queue submit for the whole batch
+class MeshUploadBatch
+{
+public:
+    explicit MeshUploadBatch(VulkanEngine* engine) : _engine(engine) {}
+    ~MeshUploadBatch();
+
+    MeshUploadBatch(const MeshUploadBatch&) = delete;
+    MeshUploadBatch& operator=(const MeshUploadBatch&) = delete;
+
+    // Creates the GPU buffers for a mesh straight away, the data itself is copied
+    // on flush()/submit() so the spans have to stay valid until then.
+    // Indices are narrowed to 16 bits while staging whenever the vertex count allows it.
+    // Meshlets go into the vertex range, after the vertices.
+    // Returns nothing when the geometry pool has no room left for the mesh.
+    std::optional<GPUMeshBuffers> add(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+        std::span<const Meshlet> meshlets = {});
+    std::optional<GPUMeshBuffers> add(std::span<const uint32_t> indices, std::span<const PackedVertex> vertices,
+        const VertexQuantization& quantization, std::span<const Meshlet> meshlets = {});
+    // Uploads the vertices matching mesh.vertexFormat
+    std::optional<GPUMeshBuffers> add(const MeshData& mesh);
+
+    // Copies every pending mesh to the GPU and blocks until the copies are done
+    void flush();
+
+    // Copies every pending mesh to the GPU through the engine's async uploader.
+    // The buffers can not be used until the returned ticket completes.
+    UploadTicket submit();
+
+    // Frees the pool ranges of every pending mesh without uploading anything
+    void discard();
+
+    size_t pending_count() const { return _pending.size(); }
+
+private:
+    struct PendingMesh
+    {
+        std::span<const uint32_t> indices;
+        std::span<const std::byte> vertexData;
+        std::span<const std::byte> meshletData;
+        VkIndexType indexType;
+        GPUMeshBuffers meshBuffers;
+    };
+
+    std::optional<GPUMeshBuffers> add_raw(std::span<const uint32_t> indices, std::span<const std::byte> vertexData,
+        size_t vertexCount, std::span<const Meshlet> meshlets);
+
+    // Copies the data of every pending mesh into staging memory
+    StagingAllocation stage(std::vector<VkBufferCopy>& vertexCopies, std::vector<VkBufferCopy>& indexCopies);
+    void record_copies(VkCommandBuffer cmd, VkBuffer staging,
+        const std::vector<VkBufferCopy>& vertexCopies, const std::vector<VkBufferCopy>& indexCopies);
+
+    VulkanEngine* _engine;
+    std::vector<PendingMesh> _pending;
+    size_t _stagingSize {0};
+};
+
+// Collects texture uploads and sends them to the GPU together. Pixels are copied to
+// staging memory as soon as they are added, so the caller can free them right away.
+// Mip chains are blitted on the GPU, which needs the graphics queue, so the batch goes
+// through immediate_submit rather than the transfer queue. Block compressed images
+// bring their own mip chain and are only copied.
+class TextureUploadBatch
+{
+public:
+    explicit TextureUploadBatch(VulkanEngine* engine) : _engine(engine) {}
+    ~TextureUploadBatch();
+
+    TextureUploadBatch(const TextureUploadBatch&) = delete;
+    TextureUploadBatch& operator=(const TextureUploadBatch&) = delete;
+
+    // Creates a sampled image for tightly packed pixels of format (4 bytes per texel).
+    // The image can not be used before flush() returns.
+    AllocatedImage add(std::span<const std::byte> pixels, VkExtent2D size, VkFormat format, bool mipmapped);
+
+    // Creates a sampled image of a block compressed format (VK_FORMAT_BC*) from a full mip chain
+    // or a single level, with the offsets of mips relative to the start of data
+    AllocatedImage add_compressed(std::span<const std::byte> data, std::span<const TextureMipLevel> mips,
+        VkExtent2D size, VkFormat format);
+
+    // Records the copies and mip chains of every pending image into one command buffer
+    // and blocks until they are done
+    void flush();
+
+    size_t pending_count() const { return _pending.size(); }
+    VkDeviceSize pending_bytes() const { return _pendingBytes; }
+
+private:
+    struct PendingImage
+    {
+        AllocatedImage image;
+        StagingAllocation staging;
+        // levels copied as they are, empty when level 0 is copied and the rest blitted
+        std::vector<TextureMipLevel> mips;
+    };
+
+    VulkanEngine* _engine;
+    std::vector<PendingImage> _pending;
+    VkDeviceSize _pendingBytes {0};
+};
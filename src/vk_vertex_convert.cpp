@@ -0,0 +1,148 @@
+#include <vk_vertex_convert.h>
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#define VERTEX_CONVERT_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_CONVERT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The SIMD interleave writes each half of a Vertex as one 16 byte store
+static_assert(sizeof(Vertex) == 48, "Vertex layout changed, update the interleave kernels");
+static_assert(offsetof(Vertex, uv_x) == 12 && offsetof(Vertex, normal) == 16
+        && offsetof(Vertex, uv_y) == 28 && offsetof(Vertex, color) == 32,
+    "Vertex layout changed, update the interleave kernels");
+
+namespace
+{
+
+void
+interleave_vertex(const VertexStreams& streams, bool normalsAsColors, size_t i, Vertex& out)
+{
+    out.position = streams.positions[i];
+    out.normal = streams.normals ? streams.normals[i] : glm::vec3 { 1, 0, 0 };
+    out.uv_x = streams.uvs ? streams.uvs[i].x : 0.f;
+    out.uv_y = streams.uvs ? streams.uvs[i].y : 0.f;
+
+    if (normalsAsColors)
+    {
+        out.color = glm::vec4(out.normal, 1.f);
+    }
+    else
+    {
+        out.color = streams.colors ? streams.colors[i] : glm::vec4 { 1.f };
+    }
+}
+
+} // namespace
+
+void
+interleave_vertices_scalar(const VertexStreams& streams, bool normalsAsColors, Vertex* out)
+{
+    for (size_t i = 0; i < streams.count; i++)
+    {
+        interleave_vertex(streams, normalsAsColors, i, out[i]);
+    }
+}
+
+void
+rebase_indices_scalar(uint32_t* indices, size_t count, uint32_t base)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        indices[i] += base;
+    }
+}
+
+void
+interleave_vertices(const VertexStreams& streams, bool normalsAsColors, Vertex* out)
+{
+    size_t i = 0;
+
+#if VERTEX_CONVERT_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 defaultNormal = _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+
+    // vec3 streams are read with 16 byte loads, so the last vertex is left to the scalar tail
+    for (; i + 1 < streams.count; i++)
+    {
+        __m128 uv = streams.uvs ? _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(&streams.uvs[i]))) : zero;
+        __m128 position = _mm_loadu_ps(&streams.positions[i].x);
+        __m128 normal = streams.normals ? _mm_loadu_ps(&streams.normals[i].x) : defaultNormal;
+
+        // [x y z ?] + [u v 0 0] -> [x y z u]
+        __m128 t = _mm_shuffle_ps(position, uv, _MM_SHUFFLE(0, 0, 0, 2));
+        __m128 low = _mm_shuffle_ps(position, t, _MM_SHUFFLE(2, 0, 1, 0));
+
+        // [nx ny nz ?] + [u v 0 0] -> [nx ny nz v]
+        t = _mm_shuffle_ps(normal, uv, _MM_SHUFFLE(1, 1, 0, 2));
+        __m128 high = _mm_shuffle_ps(normal, t, _MM_SHUFFLE(2, 0, 1, 0));
+
+        __m128 color;
+        if (normalsAsColors)
+        {
+            // [nx ny nz 1]
+            t = _mm_shuffle_ps(normal, one, _MM_SHUFFLE(0, 0, 0, 2));
+            color = _mm_shuffle_ps(normal, t, _MM_SHUFFLE(2, 0, 1, 0));
+        }
+        else
+        {
+            color = streams.colors ? _mm_loadu_ps(&streams.colors[i].x) : one;
+        }
+
+        float* dst = &out[i].position.x;
+        _mm_storeu_ps(dst, low);
+        _mm_storeu_ps(dst + 4, high);
+        _mm_storeu_ps(dst + 8, color);
+    }
+#endif
+
+    for (; i < streams.count; i++)
+    {
+        interleave_vertex(streams, normalsAsColors, i, out[i]);
+    }
+}
+
+void
+rebase_indices(uint32_t* indices, size_t count, uint32_t base)
+{
+    size_t i = 0;
+
+#if VERTEX_CONVERT_AVX2
+    const __m256i base8 = _mm256_set1_epi32((int)base);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i* dst = reinterpret_cast<__m256i*>(indices + i);
+        _mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), base8));
+    }
+#endif
+
+#if VERTEX_CONVERT_SSE2
+    const __m128i base4 = _mm_set1_epi32((int)base);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i* dst = reinterpret_cast<__m128i*>(indices + i);
+        _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), base4));
+    }
+#endif
+
+    rebase_indices_scalar(indices + i, count - i, base);
+}
+
+const char*
+vertex_convert_isa()
+{
+#if VERTEX_CONVERT_AVX2
+    return "AVX2";
+#elif VERTEX_CONVERT_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
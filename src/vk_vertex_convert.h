@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vk_types.h>
+
+// Tightly packed attribute arrays of one primitive, as copied out of the glTF accessors.
+// Missing attributes are null and get the loader defaults.
+struct VertexStreams
+{
+    const glm::vec3* positions {nullptr};
+    const glm::vec3* normals {nullptr};
+    const glm::vec2* uvs {nullptr};
+    const glm::vec4* colors {nullptr};
+    size_t count {0};
+};
+
+// Interleaves the streams into Vertex records in a single pass.
+// normalsAsColors replaces the vertex colors with the normals, for debug display.
+void interleave_vertices(const VertexStreams& streams, bool normalsAsColors, Vertex* out);
+
+// Adds base to every index in place
+void rebase_indices(uint32_t* indices, size_t count, uint32_t base);
+
+// Plain loop versions of the kernels above, the SIMD paths must match them exactly
+void interleave_vertices_scalar(const VertexStreams& streams, bool normalsAsColors, Vertex* out);
+void rebase_indices_scalar(uint32_t* indices, size_t count, uint32_t base);
+
+// Instruction set the kernels were built for, for logging
+const char* vertex_convert_isa();
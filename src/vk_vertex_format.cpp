@@ -0,0 +1,94 @@
+#include <vk_vertex_format.h>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+
+// Octahedral normal encoding, maps the unit sphere onto [0, 1]^2
+glm::vec2
+octahedral_encode(glm::vec3 n)
+{
+    float length = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    if (length <= 0.f)
+    {
+        return glm::vec2(0.5f, 0.5f);
+    }
+    n /= length;
+
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.f)
+    {
+        // fold the lower hemisphere over the diagonals
+        glm::vec2 signs(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+        e = (1.f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+    }
+
+    return e * 0.5f + 0.5f;
+}
+
+} // namespace
+
+size_t
+vertex_stride(VertexFormat format)
+{
+    switch (format)
+    {
+        case VertexFormat::Packed:
+            return sizeof(PackedVertex);
+        case VertexFormat::Standard:
+        default:
+            return sizeof(Vertex);
+    }
+}
+
+size_t
+index_size(VkIndexType indexType)
+{
+    return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+VertexQuantization
+pack_vertices(std::span<const Vertex> vertices, std::vector<PackedVertex>& packed)
+{
+    packed.resize(vertices.size());
+
+    VertexQuantization quantization;
+    if (vertices.empty())
+    {
+        return quantization;
+    }
+
+    glm::vec3 minPosition = vertices[0].position;
+    glm::vec3 maxPosition = vertices[0].position;
+    for (const Vertex& vtx : vertices)
+    {
+        minPosition = glm::min(minPosition, vtx.position);
+        maxPosition = glm::max(maxPosition, vtx.position);
+    }
+
+    // snorm16 covers [-1, 1], so center on the bounds and scale by the half extent.
+    // Flat axes still get a small scale to avoid dividing by zero.
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    glm::vec3 halfExtent = glm::max((maxPosition - minPosition) * 0.5f, glm::vec3(1e-6f));
+    quantization.positionScale = glm::vec4(halfExtent, 0.f);
+    quantization.positionOffset = glm::vec4(center, 0.f);
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& vtx = vertices[i];
+        glm::vec3 position = (vtx.position - center) / halfExtent;
+        glm::vec2 normal = octahedral_encode(vtx.normal);
+
+        PackedVertex& out = packed[i];
+        out.positionXY = glm::packSnorm2x16(glm::vec2(position.x, position.y));
+        out.positionZNormal = (glm::packSnorm2x16(glm::vec2(position.z, 0.f)) & 0xFFFFu)
+            | (glm::packUnorm4x8(glm::vec4(0.f, 0.f, normal.x, normal.y)) & 0xFFFF0000u);
+        out.uv = glm::packHalf2x16(glm::vec2(vtx.uv_x, vtx.uv_y));
+        out.color = glm::packUnorm4x8(vtx.color);
+    }
+
+    return quantization;
+}
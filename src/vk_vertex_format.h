@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vk_types.h>
+
+// Byte size of one vertex in the given format
+size_t vertex_stride(VertexFormat format);
+
+// Byte size of one index of the given type
+size_t index_size(VkIndexType indexType);
+
+// Packs vertices into the compressed layout. Positions are quantized relative to
+// the bounds of the whole span, the returned quantization maps them back.
+VertexQuantization pack_vertices(std::span<const Vertex> vertices, std::vector<PackedVertex>& packed);